@@ -0,0 +1,85 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+#include "Mesh.h"
+#include "MassSpringSolver.h"
+#include "Aerodynamics.h"
+#include "BenchUtil.h"
+
+// Aerodynamic force stage benchmark
+// Times the wind, drag and lift stage against the solver iterations of the same time
+// step on uniform grids, the stage should stay below a tenth of the step.
+//
+// usage: aero-bench [--sizes 129,257,501] [--iter n] [--steps n]
+
+int main(int argc, char** argv) {
+	std::vector<unsigned int> sizes;
+	unsigned int n_iter = 10, n_steps = 20;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg(argv[i]);
+		if (arg == "--sizes" && i + 1 < argc) {
+			std::string list(argv[++i]);
+			for (size_t p = 0; p < list.size();) {
+				size_t q = list.find(',', p);
+				if (q == std::string::npos) q = list.size();
+				sizes.push_back(std::atoi(list.substr(p, q - p).c_str()));
+				p = q + 1;
+			}
+		}
+		else if (arg == "--iter" && i + 1 < argc) n_iter = std::atoi(argv[++i]);
+		else if (arg == "--steps" && i + 1 < argc) n_steps = std::atoi(argv[++i]);
+	}
+	if (sizes.empty()) sizes = { 129, 257, 501 };
+
+	// same parameters as the app
+	const float w = 2.0f, h = 0.008f, k = 1.0f, a = 0.993f, g = 9.8f;
+
+	std::cout << std::left << std::setw(12) << "grid" << std::right << std::setw(12) << "triangles"
+		<< std::setw(12) << "aero ms" << std::setw(12) << "solve ms" << std::setw(10) << "share" << std::endl;
+	for (unsigned int n : sizes) {
+		MeshBuilder meshBuilder;
+		meshBuilder.uniformGrid(w, n);
+		Mesh* mesh = meshBuilder.getResult();
+		MassSpringBuilder massSpringBuilder;
+		const float m = 0.25f / (n * n);
+		massSpringBuilder.uniformGrid(n, h, w / (n - 1) * 1.05f, k, m, a, g * m);
+		mass_spring_system* system = massSpringBuilder.getResult();
+
+		std::vector<float> vbuff(mesh->vbuff(), mesh->vbuff() + mesh->vbuffLen());
+		std::vector<float> prev(vbuff);
+		MassSpringSolver solver(system, vbuff.data());
+		AerodynamicForce aero(system, mesh->ibuff(), mesh->ibuffLen());
+		aero.windField().setMean(Eigen::Vector3f(0, 2, 0));
+		aero.windField().setTurbulence(1.0f, 0.5f);
+		aero.setCoefficients(0.2f, 1.0f, 0.5f);
+
+		double aero_ms = 0, solve_ms = 0;
+		for (unsigned int s = 0; s < n_steps; s++) {
+			Clock::time_point start = Clock::now();
+			aero.apply(vbuff.data(), prev.data(), s * h);
+			aero_ms += msSince(start);
+			prev = vbuff;
+
+			start = Clock::now();
+			solver.solve(n_iter);
+			solve_ms += msSince(start);
+		}
+		aero_ms /= n_steps;
+		solve_ms /= n_steps;
+
+		std::cout << std::left << std::setw(12) << n << std::right << std::fixed << std::setprecision(2)
+			<< std::setw(12) << mesh->ibuffLen() / 3
+			<< std::setw(12) << aero_ms
+			<< std::setw(12) << solve_ms
+			<< std::setw(9) << 100.0 * aero_ms / (aero_ms + solve_ms) << "%" << std::endl;
+
+		delete system;
+		delete mesh;
+	}
+	return 0;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Helpers shared by the benchmarks: wall clock timing, comma separated option lists and the
+// OpenMP thread count, which is 1 in builds without OpenMP.
+typedef std::chrono::high_resolution_clock Clock;
+
+inline double msSince(Clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// "1,2,8" to { "1", "2", "8" }
+inline std::vector<std::string> splitList(const std::string& list) {
+	std::vector<std::string> result;
+	for (size_t p = 0; p < list.size();) {
+		size_t q = list.find(',', p);
+		if (q == std::string::npos) q = list.size();
+		result.push_back(list.substr(p, q - p));
+		p = q + 1;
+	}
+	return result;
+}
+
+inline std::vector<unsigned int> parseList(const std::string& list) {
+	std::vector<unsigned int> result;
+	for (const std::string& item : splitList(list)) result.push_back(std::atoi(item.c_str()));
+	return result;
+}
+
+inline std::vector<float> parseFloatList(const std::string& list) {
+	std::vector<float> result;
+	for (const std::string& item : splitList(list)) result.push_back((float)std::atof(item.c_str()));
+	return result;
+}
+
+// threads of the next parallel region
+inline int maxThreads() {
+#ifdef _OPENMP
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+// processors available, independent of setThreads()
+inline int numCores() {
+#ifdef _OPENMP
+	return omp_get_num_procs();
+#else
+	return 1;
+#endif
+}
+
+inline void setThreads(int n) {
+#ifdef _OPENMP
+	omp_set_num_threads(n);
+#else
+	(void)n;
+#endif
+}
@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+#include "Mesh.h"
+#include "MassSpringSolver.h"
+#include "BenchUtil.h"
+
+// Continuous collision benchmark
+// Drops a grid cloth onto a small sphere and onto a thin plate and runs the same simulated time
+// with growing time steps. The discrete sphere node only pushes out points that end a step
+// inside, the continuous node stops every point at the first impact along its step. Reports the
+// solves and time spent and the points that went through the obstacle.
+//
+// usage: collision-bench [--size n] [--time s] [--steps 0.004,0.008,0.016,0.032]
+
+enum Obstacle { SPHERE, PLATE };
+static const char* OBSTACLE_NAMES[] = { "sphere", "plate" };
+static const float RADIUS = 0.1f, HALF_WIDTH = 0.3f, DEPTH = -0.5f; // obstacle size and height
+
+struct Result {
+	unsigned int solves;
+	double ms;
+	unsigned int tunneled; // points that went through the obstacle during any step
+};
+
+// the step from p0 to p1 passed through the obstacle
+static bool tunnels(Obstacle obstacle, const Eigen::Vector3f& p0, const Eigen::Vector3f& p1) {
+	if (obstacle == PLATE) {
+		if (p0.z() < DEPTH || p1.z() >= DEPTH) return false;
+		Eigen::Vector3f q = p0 + (p0.z() - DEPTH) / (p0.z() - p1.z()) * (p1 - p0);
+		return std::abs(q.x()) < HALF_WIDTH && std::abs(q.y()) < HALF_WIDTH;
+	}
+	// closest approach of the segment to the sphere center, well inside the radius
+	const Eigen::Vector3f center(0.0f, 0.0f, DEPTH);
+	Eigen::Vector3f d = p1 - p0;
+	float s = d.squaredNorm() > 0.0f ? std::min(std::max((center - p0).dot(d) / d.squaredNorm(), 0.0f), 1.0f) : 0.0f;
+	return (p0 + s * d - center).norm() < 0.5f * RADIUS;
+}
+
+static Result run(Obstacle obstacle, bool continuous, unsigned int n, float h, float time) {
+	const float w = 2.0f, k = 1.0f, a = 0.993f, g = 9.8f, m = 0.25f / (n * n);
+	const unsigned int n_iter = 5;
+
+	MeshBuilder meshBuilder;
+	meshBuilder.uniformGrid(w, n);
+	Mesh* mesh = meshBuilder.getResult();
+	std::vector<float> vbuff(mesh->vbuff(), mesh->vbuff() + mesh->vbuffLen());
+	std::vector<float> prev_vbuff(vbuff);
+	delete mesh;
+
+	MassSpringBuilder massSpringBuilder;
+	massSpringBuilder.uniformGrid(n, h, w / (n - 1) * 1.05f, k, m, a, g * m);
+	mass_spring_system* system = massSpringBuilder.getResult();
+	MassSpringSolver solver(system, vbuff.data());
+
+	// plate of two triangles facing the cloth
+	const Eigen::Vector3f center(0.0f, 0.0f, DEPTH);
+	const float plate[] = {
+		-HALF_WIDTH, -HALF_WIDTH, DEPTH, HALF_WIDTH, -HALF_WIDTH, DEPTH,
+		HALF_WIDTH, HALF_WIDTH, DEPTH, -HALF_WIDTH, HALF_WIDTH, DEPTH
+	};
+	const unsigned int plate_ibuff[] = { 0, 1, 2, 0, 2, 3 };
+
+	CgRootNode root(system, vbuff.data());
+	CgSphereCollisionNode sphere(system, vbuff.data(), RADIUS, center);
+	CgContinuousCollisionNode ccd(system, vbuff.data(), prev_vbuff.data());
+	if (obstacle == SPHERE) ccd.addSphere(center, RADIUS);
+	else ccd.addMesh(plate, 4, plate_ibuff, 6);
+	if (continuous) root.addChild(&ccd);
+	else root.addChild(&sphere);
+
+	Result result = { 0, 0.0, 0 };
+	CgSatisfyVisitor visitor;
+	std::vector<bool> tunneled(system->n_points, false);
+	const unsigned int n_steps = (unsigned int)std::ceil(time / h);
+	for (unsigned int s = 0; s < n_steps; s++) {
+		prev_vbuff = vbuff;
+		Clock::time_point start = Clock::now();
+		solver.solve(n_iter);
+		visitor.satisfy(root);
+		result.ms += msSince(start);
+
+		for (unsigned int i = 0; i < system->n_points; i++) {
+			Eigen::Vector3f p0(prev_vbuff[3 * i + 0], prev_vbuff[3 * i + 1], prev_vbuff[3 * i + 2]);
+			Eigen::Vector3f p1(vbuff[3 * i + 0], vbuff[3 * i + 1], vbuff[3 * i + 2]);
+			if (tunnels(obstacle, p0, p1)) tunneled[i] = true;
+		}
+	}
+	result.solves = n_steps;
+	for (bool t : tunneled) result.tunneled += t;
+
+	delete system;
+	return result;
+}
+
+int main(int argc, char** argv) {
+	std::vector<float> steps;
+	unsigned int n = 33;
+	float time = 1.0f;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg(argv[i]);
+		if (arg == "--size" && i + 1 < argc) n = std::atoi(argv[++i]);
+		else if (arg == "--time" && i + 1 < argc) time = (float)std::atof(argv[++i]);
+		else if (arg == "--steps" && i + 1 < argc) steps = parseFloatList(argv[++i]);
+	}
+	if (steps.empty()) steps = { 0.004f, 0.008f, 0.016f, 0.032f };
+
+	std::cout << "grid " << n << ", " << time << " s simulated" << std::endl;
+	std::cout << std::left << std::setw(10) << "obstacle" << std::setw(10) << "mode" << std::right
+		<< std::setw(10) << "step" << std::setw(10) << "solves" << std::setw(12) << "total ms"
+		<< std::setw(12) << "tunneled" << std::endl;
+	for (int obstacle = SPHERE; obstacle <= PLATE; obstacle++) {
+		for (float h : steps) {
+			// the discrete node only handles spheres
+			for (int continuous = obstacle == PLATE ? 1 : 0; continuous < 2; continuous++) {
+				Result r = run((Obstacle)obstacle, continuous != 0, n, h, time);
+				std::cout << std::left << std::setw(10) << OBSTACLE_NAMES[obstacle]
+					<< std::setw(10) << (continuous ? "ccd" : "discrete") << std::right << std::fixed
+					<< std::setprecision(3) << std::setw(10) << h
+					<< std::setw(10) << r.solves
+					<< std::setprecision(2) << std::setw(12) << r.ms
+					<< std::setw(12) << r.tunneled << std::endl;
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,138 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+#include "Mesh.h"
+#include "MassSpringSolver.h"
+#include "Aerodynamics.h"
+#include "Parallel.h"
+#include "BenchUtil.h"
+
+// Deterministic execution check
+// Runs the hang demo with turbulent wind, the deformation pass, a sphere and an early exit on
+// the residual for a number of frames at several thread counts, with and without the
+// deterministic mode, and hashes the final vertex buffer. In deterministic mode every hash has
+// to match the first one, the exit code is 1 otherwise. Also reports the frame time of both
+// modes. Thread counts above the core count still interleave differently, so they are checked
+// as well.
+//
+// usage: determinism-bench [--size n] [--frames n] [--threads 1,2,8,32] [--runs n] [--solver name]
+
+// FNV-1a over the raw bytes, any difference in any bit changes it
+static uint64_t hashBuffer(const std::vector<float>& vbuff) {
+	uint64_t hash = 14695981039346656037ull;
+	const unsigned char* bytes = (const unsigned char*)vbuff.data();
+	for (size_t i = 0; i < vbuff.size() * sizeof(float); i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+struct Result {
+	double frame_ms;
+	uint64_t hash;
+};
+
+// two time steps per 60 Hz frame as in the app
+static Result run(unsigned int n, unsigned int n_frames, const std::string& solverName) {
+	const float w = 2.0f, h = 0.008f, k = 1.0f, a = 0.993f, g = 9.8f, m = 0.25f / (n * n);
+	const unsigned int n_iter = 10, substeps = 2;
+
+	MeshBuilder meshBuilder;
+	meshBuilder.uniformGrid(w, n);
+	Mesh* mesh = meshBuilder.getResult();
+	std::vector<float> vbuff(mesh->vbuff(), mesh->vbuff() + mesh->vbuffLen());
+	std::vector<unsigned int> ibuff(mesh->ibuff(), mesh->ibuff() + mesh->ibuffLen());
+	std::vector<float> prev_vbuff(vbuff);
+	delete mesh;
+
+	MassSpringBuilder massSpringBuilder;
+	massSpringBuilder.uniformGrid(n, h, w / (n - 1) * 1.05f, k, m, a, g * m);
+	mass_spring_system* system = massSpringBuilder.getResult();
+	std::vector<unsigned int> springs = massSpringBuilder.getShearIndex();
+	std::vector<unsigned int> structural = massSpringBuilder.getStructIndex();
+	springs.insert(springs.end(), structural.begin(), structural.end());
+
+	MassSpringSolver solver(system, vbuff.data(), LinearSolver::create(solverName));
+	solver.setTolerance(1e-3f);
+
+	AerodynamicForce aerodynamics(system, ibuff.data(), (unsigned int)ibuff.size());
+	aerodynamics.setCoefficients(0.2f, 1.0f, 0.5f);
+	aerodynamics.windField().setMean(Eigen::Vector3f(0.0f, 1.0f, 2.0f));
+	aerodynamics.windField().setTurbulence(0.5f, 0.5f);
+
+	CgRootNode root(system, vbuff.data());
+	CgSpringDeformationNode deformation(system, vbuff.data(), 0.4f, 15);
+	deformation.addSprings(springs);
+	root.addChild(&deformation);
+	CgPointFixNode cornerFixer(system, vbuff.data());
+	cornerFixer.fixPoint(0);
+	cornerFixer.fixPoint(n - 1);
+	deformation.addChild(&cornerFixer);
+	CgSphereCollisionNode sphere(system, vbuff.data(), 0.64f, Eigen::Vector3f(0.0f, 0.0f, -1.0f));
+	root.addChild(&sphere);
+
+	CgSatisfyVisitor visitor;
+	float time = 0.0f;
+	Clock::time_point start = Clock::now();
+	for (unsigned int f = 0; f < n_frames; f++) {
+		for (unsigned int s = 0; s < substeps; s++) {
+			aerodynamics.apply(vbuff.data(), prev_vbuff.data(), time);
+			prev_vbuff = vbuff;
+			solver.solve(n_iter);
+			visitor.satisfy(root);
+			time += h;
+		}
+	}
+	Result result = { msSince(start) / n_frames, hashBuffer(vbuff) };
+
+	delete system;
+	return result;
+}
+
+int main(int argc, char** argv) {
+	std::vector<unsigned int> threads;
+	unsigned int n = 65, n_frames = 200, n_runs = 2;
+	std::string solverName = "llt-amd";
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg(argv[i]);
+		if (arg == "--size" && i + 1 < argc) n = std::atoi(argv[++i]);
+		else if (arg == "--frames" && i + 1 < argc) n_frames = std::atoi(argv[++i]);
+		else if (arg == "--threads" && i + 1 < argc) threads = parseList(argv[++i]);
+		else if (arg == "--runs" && i + 1 < argc) n_runs = std::atoi(argv[++i]);
+		else if (arg == "--solver" && i + 1 < argc) solverName = argv[++i];
+	}
+	if (threads.empty()) threads = { 1, 2, 8, 32 };
+
+	std::cout << "grid " << n << ", " << n_frames << " frames, " << solverName << std::endl;
+	std::cout << std::left << std::setw(16) << "mode" << std::right << std::setw(10) << "threads"
+		<< std::setw(8) << "run" << std::setw(12) << "frame ms" << std::setw(20) << "hash"
+		<< std::setw(8) << "same" << std::endl;
+	bool deterministic = true;
+	for (int mode = 0; mode < 2; mode++) {
+		Parallel::setDeterministic(mode == 1);
+		uint64_t reference = 0;
+		for (size_t t = 0; t < threads.size(); t++) {
+			setThreads(threads[t]);
+			for (unsigned int r = 0; r < n_runs; r++) {
+				Result result = run(n, n_frames, solverName);
+				if (t == 0 && r == 0) reference = result.hash;
+				bool same = result.hash == reference;
+				if (mode == 1 && !same) deterministic = false;
+				std::cout << std::left << std::setw(16) << (mode ? "deterministic" : "default")
+					<< std::right << std::setw(10) << threads[t] << std::setw(8) << r
+					<< std::fixed << std::setprecision(3) << std::setw(12) << result.frame_ms
+					<< std::setw(20) << std::hex << result.hash << std::dec
+					<< std::setw(8) << (same ? "yes" : "no") << std::endl;
+			}
+		}
+	}
+	std::cout << (deterministic ? "deterministic mode is bit-identical" : "deterministic mode DIFFERS") << std::endl;
+	return deterministic ? 0 : 1;
+}
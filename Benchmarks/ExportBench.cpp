@@ -0,0 +1,202 @@
+#include <GL/glew.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+#include "Headless.h"
+#include "FrameCapture.h"
+#include "FrameEncoder.h"
+#include "BenchUtil.h"
+
+// Frame export benchmark
+// Renders a waving grid cloth offscreen in a headless context and exports every frame, once
+// with a synchronous glReadPixels into client memory and once through the pixel buffer ring for
+// every ring size. Encoding runs on the encoder thread in both cases, so the difference is the
+// render thread waiting for the readback. Reports end-to-end export frames/s, from the first
+// draw to the last frame written, and the render thread's time per frame.
+//
+// usage: export-bench [--size 1280x720] [--frames n] [--grid n] [--slots 1,3] [--format png|raw]...
+//        [--out dir]
+
+// already projected, x and y in clip space, z towards the viewer
+static const char* VERTEX_SHADER =
+	"#version 430\n"
+	"layout(location=0) in vec3 aPosition;\n"
+	"layout(location=1) in vec3 aNormal;\n"
+	"out vec3 vNormal;\n"
+	"void main() { vNormal = aNormal; gl_Position = vec4(aPosition.xy, -0.5 * aPosition.z, 1.0); }\n";
+
+static const char* FRAGMENT_SHADER =
+	"#version 430\n"
+	"in vec3 vNormal;\n"
+	"out vec4 fragColor;\n"
+	"void main() {\n"
+	"    vec3 albedo = vec3(0.0, 0.3, 0.7);\n"
+	"    float diffuse = max(0.0, dot(normalize(vec3(-0.3, -0.3, 1.0)), normalize(vNormal)));\n"
+	"    fragColor = vec4((diffuse + 0.01) * albedo, 1.0);\n"
+	"}\n";
+
+// n x n grid with a travelling wave, positions and normals
+class WaveCloth {
+private:
+	unsigned int n;
+	std::vector<float> vbuff, nbuff, tbuff;
+	std::vector<unsigned int> ibuff;
+	ProgramInput input;
+
+public:
+	WaveCloth(unsigned int n) : n(n), vbuff(3 * n * n), nbuff(3 * n * n), tbuff(2 * n * n) {
+		for (unsigned int i = 0; i + 1 < n; i++) {
+			for (unsigned int j = 0; j + 1 < n; j++) {
+				unsigned int a = i * n + j, b = a + 1, c = a + n, d = c + 1;
+				ibuff.insert(ibuff.end(), { a, b, d, a, d, c });
+			}
+		}
+		input.setTextureData(tbuff.data(), (unsigned int)tbuff.size());
+		input.setIndexData(ibuff.data(), (unsigned int)ibuff.size());
+	}
+
+	void update(float t) {
+		const float k = 6.0f, s = 0.15f;
+		for (unsigned int i = 0; i < n; i++) {
+			for (unsigned int j = 0; j < n; j++) {
+				float x = 1.8f * j / (n - 1) - 0.9f, y = 1.8f * i / (n - 1) - 0.9f;
+				float phase = k * (x + 0.5f * y) - t;
+				float* v = &vbuff[3 * (i * n + j)];
+				float* m = &nbuff[3 * (i * n + j)];
+				v[0] = x; v[1] = y; v[2] = s * std::sin(phase);
+				m[0] = -s * k * std::cos(phase); m[1] = -0.5f * s * k * std::cos(phase); m[2] = 1.0f;
+			}
+		}
+		input.setPositionData(vbuff.data(), (unsigned int)vbuff.size());
+		input.setNormalData(nbuff.data(), (unsigned int)nbuff.size());
+	}
+
+	void draw(const GLProgram& program) {
+		glUseProgram(program);
+		glBindVertexArray(input);
+		glEnableVertexAttribArray(0);
+		glEnableVertexAttribArray(1);
+		glDrawElements(GL_TRIANGLES, (GLsizei)ibuff.size(), GL_UNSIGNED_INT, 0);
+		glDisableVertexAttribArray(0);
+		glDisableVertexAttribArray(1);
+		glBindVertexArray(0);
+		glUseProgram(0);
+	}
+};
+
+struct Result {
+	double fps, render_ms, readback_ms, encode_ms;
+	unsigned long long encoded, dropped;
+};
+
+// slots == 0 reads back synchronously
+static Result run(WaveCloth& cloth, const GLProgram& program, const std::string& out, FrameEncoder::Format format,
+	unsigned int width, unsigned int height, unsigned int n_frames, unsigned int slots) {
+	FrameEncoder encoder(out, format, width, height, 16);
+	FrameCapture capture(width, height, &encoder, std::max(slots, 1u));
+	std::vector<unsigned char> pixels(4 * width * height);
+	double render_ms = 0.0, readback_ms = 0.0;
+
+	Clock::time_point start = Clock::now();
+	for (unsigned int f = 0; f < n_frames; f++) {
+		Clock::time_point frame_start = Clock::now();
+		capture.bind();
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		cloth.update(0.1f * f);
+		cloth.draw(program);
+		render_ms += msSince(frame_start);
+
+		Clock::time_point readback_start = Clock::now();
+		if (slots > 0) capture.capture();
+		else {
+			glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+			encoder.push(pixels.data());
+		}
+		readback_ms += msSince(readback_start);
+		capture.unbind();
+	}
+	capture.finish();
+	encoder.close();
+
+	Result r;
+	r.fps = encoder.encodedFrames() / (msSince(start) / 1000.0);
+	r.render_ms = render_ms / n_frames;
+	r.readback_ms = readback_ms / n_frames;
+	r.encode_ms = encoder.encodeMs();
+	r.encoded = encoder.encodedFrames();
+	r.dropped = encoder.droppedFrames();
+	return r;
+}
+
+int main(int argc, char** argv) {
+	unsigned int width = 1280, height = 720, n_frames = 120, grid = 129;
+	std::vector<unsigned int> slot_counts;
+	std::vector<std::string> formats;
+	std::string out = "export-bench-frames";
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg(argv[i]);
+		if (arg == "--size" && i + 1 < argc) std::sscanf(argv[++i], "%ux%u", &width, &height);
+		else if (arg == "--frames" && i + 1 < argc) n_frames = std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--grid" && i + 1 < argc) grid = std::max(2, std::atoi(argv[++i]));
+		else if (arg == "--slots" && i + 1 < argc) slot_counts = parseList(argv[++i]);
+		else if (arg == "--format" && i + 1 < argc) formats.push_back(argv[++i]);
+		else if (arg == "--out" && i + 1 < argc) out = argv[++i];
+	}
+	if (slot_counts.empty()) slot_counts = { 1, 3 };
+	if (formats.empty()) formats = { "png", "raw" };
+
+	try {
+		HeadlessContext context;
+		glewInit();
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glEnable(GL_DEPTH_TEST);
+		glEnable(GL_FRAMEBUFFER_SRGB);
+		glClearColor(0.25f, 0.25f, 0.25f, 1.0f);
+
+		GLShader vertex_shader(GL_VERTEX_SHADER), fragment_shader(GL_FRAGMENT_SHADER);
+		vertex_shader.compile(VERTEX_SHADER);
+		fragment_shader.compile(FRAGMENT_SHADER);
+		GLProgram program;
+		program.link(vertex_shader, fragment_shader);
+		WaveCloth cloth(grid);
+
+		mkdir(out.c_str(), 0755);
+		std::cout << context.renderer() << std::endl;
+		std::cout << width << "x" << height << ", grid " << grid << ", " << n_frames << " frames to " << out << std::endl;
+		std::cout << std::left << std::setw(8) << "format" << std::setw(12) << "readback" << std::right
+			<< std::setw(12) << "frames/s" << std::setw(12) << "render ms" << std::setw(14) << "readback ms"
+			<< std::setw(12) << "encode ms" << std::setw(10) << "dropped" << std::endl;
+
+		std::vector<unsigned int> modes(1, 0);
+		modes.insert(modes.end(), slot_counts.begin(), slot_counts.end());
+		for (const std::string& name : formats) {
+			FrameEncoder::Format format = FrameEncoder::parseFormat(name);
+			for (unsigned int slots : modes) {
+				Result r = run(cloth, program, out, format, width, height, n_frames, slots);
+				std::cout << std::left << std::setw(8) << name
+					<< std::setw(12) << (slots == 0 ? "sync" : "pbo x" + std::to_string(slots))
+					<< std::right << std::fixed << std::setprecision(1)
+					<< std::setw(12) << r.fps
+					<< std::setprecision(2) << std::setw(12) << r.render_ms
+					<< std::setw(14) << r.readback_ms
+					<< std::setw(12) << r.encode_ms
+					<< std::setw(10) << r.dropped << std::endl;
+			}
+		}
+	}
+	catch (const std::runtime_error& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
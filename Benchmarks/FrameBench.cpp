@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "FrameServer.h"
+#include "BenchUtil.h"
+
+// Shared-memory frame ring benchmark
+// Publishes grid sized frames into a frame ring while a dummy consumer process follows the
+// newest frame. Reports the publish cost, the copy throughput, and the latency from publishing
+// to a consistent copy in the consumer. The consumer also checks every frame it accepts for
+// torn data.
+//
+// usage: frame-bench [--sizes 33,129,257,513] [--frames n] [--slots n] [--period us]
+
+// consumer results, sent back through a pipe
+struct ConsumerStats {
+	unsigned long long frames; // frames copied
+	unsigned long long missed; // frames overwritten before the consumer got to them
+	unsigned long long retries; // reads that lost the race against the writer
+	unsigned long long corrupt; // accepted frames with mixed contents, must stay 0
+	double p50_us, p99_us, max_us; // publish to copy latency
+};
+
+static ConsumerStats consume(const std::string& name, unsigned int warmup) {
+	FrameReader reader(name);
+	const unsigned int n = reader.nPoints();
+	std::vector<float> vbuff(3 * n), nbuff(3 * n);
+	std::vector<double> latencies;
+	ConsumerStats stats = {};
+
+	unsigned long long last = 0;
+	for (;;) {
+		unsigned long long frame = reader.latestFrame();
+		if (frame == last) {
+			if (reader.closed()) break;
+			std::this_thread::yield();
+			continue;
+		}
+		FrameReader::Info info;
+		if (!reader.readFrame(frame, vbuff.data(), nbuff.data(), &info)) {
+			stats.retries++;
+			continue;
+		}
+		double us = (FrameReader::now() - info.publish_ns) / 1000.0;
+
+		// the publisher stamps the frame number into the first and last values of both buffers
+		float stamp = (float)frame;
+		if (vbuff[0] != stamp || vbuff[3 * n - 1] != stamp || nbuff[0] != stamp || nbuff[3 * n - 1] != stamp)
+			stats.corrupt++;
+		stats.frames++;
+		stats.missed += frame - last - 1;
+		last = frame;
+		if (frame > warmup) latencies.push_back(us);
+	}
+
+	if (!latencies.empty()) {
+		std::sort(latencies.begin(), latencies.end());
+		stats.p50_us = latencies[latencies.size() / 2];
+		stats.p99_us = latencies[latencies.size() * 99 / 100];
+		stats.max_us = latencies.back();
+	}
+	return stats;
+}
+
+int main(int argc, char** argv) {
+	std::vector<unsigned int> sizes;
+	unsigned int n_frames = 2000, n_slots = 4, period_us = 1000;
+	const unsigned int warmup = 20;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg(argv[i]);
+		if (arg == "--sizes" && i + 1 < argc) sizes = parseList(argv[++i]);
+		else if (arg == "--frames" && i + 1 < argc) n_frames = std::atoi(argv[++i]);
+		else if (arg == "--slots" && i + 1 < argc) n_slots = std::atoi(argv[++i]);
+		else if (arg == "--period" && i + 1 < argc) period_us = std::atoi(argv[++i]);
+	}
+	if (sizes.empty()) sizes = { 33, 129, 257, 513 };
+	const std::string name = "/fms-frame-bench-" + std::to_string(getpid());
+
+	std::cout << n_frames << " frames every " << period_us << " us, " << n_slots << " slots" << std::endl;
+	std::cout << std::left << std::setw(8) << "grid" << std::right << std::setw(10) << "MB/frame"
+		<< std::setw(12) << "publish us" << std::setw(10) << "GB/s" << std::setw(10) << "read"
+		<< std::setw(10) << "missed" << std::setw(10) << "retries" << std::setw(10) << "corrupt"
+		<< std::setw(10) << "p50 us" << std::setw(10) << "p99 us" << std::setw(10) << "max us" << std::endl;
+	for (unsigned int n : sizes) {
+		const unsigned int n_points = n * n;
+		std::vector<float> vbuff(3 * n_points), nbuff(3 * n_points);
+		for (unsigned int i = 0; i < 3 * n_points; i++) {
+			vbuff[i] = (float)i / n_points;
+			nbuff[i] = 1.0f;
+		}
+
+		FrameServer* server = new FrameServer(name, n_points, n_slots);
+		int fds[2];
+		if (pipe(fds) != 0) return 1;
+		pid_t pid = fork();
+		if (pid == 0) {
+			// dummy consumer, leaves without running the server's destructor
+			close(fds[0]);
+			ConsumerStats stats = consume(name, warmup);
+			ssize_t written = write(fds[1], &stats, sizeof(stats));
+			_exit(written == sizeof(stats) ? 0 : 1);
+		}
+		close(fds[1]);
+
+		// give the consumer time to map the ring
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+		double publish_ms = 0;
+		Clock::time_point next = Clock::now();
+		for (unsigned int f = 1; f <= n_frames; f++) {
+			float stamp = (float)f;
+			vbuff[0] = vbuff[3 * n_points - 1] = nbuff[0] = nbuff[3 * n_points - 1] = stamp;
+			Clock::time_point start = Clock::now();
+			server->publish(vbuff.data(), nbuff.data(), f * 0.016);
+			publish_ms += msSince(start);
+			next += std::chrono::microseconds(period_us);
+			std::this_thread::sleep_until(next);
+		}
+		delete server;
+
+		ConsumerStats stats = {};
+		bool ok = read(fds[0], &stats, sizeof(stats)) == sizeof(stats);
+		close(fds[0]);
+		int status = 0;
+		waitpid(pid, &status, 0);
+		if (!ok) {
+			std::cerr << "consumer failed for grid " << n << std::endl;
+			continue;
+		}
+
+		double mb = 2.0 * 3 * sizeof(float) * n_points / (1024.0 * 1024.0);
+		double publish_us = 1000.0 * publish_ms / n_frames;
+		std::cout << std::left << std::setw(8) << n << std::right << std::fixed << std::setprecision(2)
+			<< std::setw(10) << mb
+			<< std::setw(12) << publish_us
+			<< std::setw(10) << mb / 1024.0 / (publish_us * 1e-6)
+			<< std::setw(10) << stats.frames
+			<< std::setw(10) << stats.missed
+			<< std::setw(10) << stats.retries
+			<< std::setw(10) << stats.corrupt
+			<< std::setw(10) << stats.p50_us
+			<< std::setw(10) << stats.p99_us
+			<< std::setw(10) << stats.max_us << std::endl;
+	}
+	return 0;
+}
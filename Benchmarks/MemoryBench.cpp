@@ -0,0 +1,160 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Mesh.h"
+#include "MassSpringSolver.h"
+#include "LinearSolver.h"
+#include "Memory.h"
+#include "BenchUtil.h"
+
+// Solver state allocator benchmark
+// Builds the system and solver of large grid cloths with every state allocator and times
+// construction and time steps. Positions come from the allocator too, like in the simulation
+// thread. Reports the memory held by the system and solver, how much of the process is backed
+// by huge pages (Linux), the allocations of building the system, one per parameter vector and
+// the spring list, and the largest position difference to the first allocator, which should be
+// zero: allocators only move memory, the arithmetic stays the same.
+//
+// usage: memory-bench [--sizes 257,513,1025] [--memory <allocator>]... [--solver <backend>]
+//        [--steps n] [--iter n]
+
+typedef std::vector<float, StateAllocator<float> > StateBuffer;
+
+// counts the allocations of the allocator it wraps
+class CountingAllocator : public Allocator {
+private:
+	Allocator* allocator;
+
+public:
+	unsigned long long allocations;
+
+	CountingAllocator(Allocator* allocator) : allocator(allocator), allocations(0) {}
+	~CountingAllocator() { delete allocator; }
+
+	virtual void* allocate(size_t bytes) { allocations++; return allocator->allocate(bytes); }
+	virtual void deallocate(void* p, size_t bytes) { allocator->deallocate(p, bytes); }
+	virtual void prepare(const void* p, size_t bytes) { allocator->prepare(p, bytes); }
+	virtual std::string name() const { return allocator->name(); }
+};
+
+// transparent and reserved huge pages of the process in MB, 0 where there is no smaps_rollup
+static double hugePageMB() {
+	std::ifstream in("/proc/self/smaps_rollup");
+	std::string line, key;
+	double kb, total = 0.0;
+	while (std::getline(in, line)) {
+		std::istringstream fields(line);
+		if (!(fields >> key >> kb)) continue;
+		if (key == "AnonHugePages:" || key == "Private_Hugetlb:" || key == "Shared_Hugetlb:") total += kb;
+	}
+	return total / 1024.0;
+}
+
+struct Result {
+	double construct_ms, step_ms, state_mb, huge_mb;
+	unsigned long long system_allocations;
+	std::vector<float> positions;
+};
+
+static Result run(unsigned int n, const std::string& backend, unsigned int n_steps, unsigned int n_iter,
+	CountingAllocator& allocator) {
+	const float w = 2.0f, h = 0.008f, k = 1.0f, a = 0.993f, g = 9.8f, m = 0.25f / (n * n);
+	Result r;
+
+	MeshBuilder meshBuilder;
+	meshBuilder.uniformGrid(w, n);
+	Mesh* mesh = meshBuilder.getResult();
+	StateBuffer vbuff(mesh->vbuff(), mesh->vbuff() + mesh->vbuffLen());
+	delete mesh;
+
+	// building the springs writes the system vectors first, so it counts as construction
+	Clock::time_point start = Clock::now();
+	unsigned long long allocations = allocator.allocations;
+	MassSpringBuilder massSpringBuilder;
+	massSpringBuilder.uniformGrid(n, h, w / (n - 1) * 1.05f, k, m, a, g * m);
+	mass_spring_system* system = massSpringBuilder.getResult();
+	r.system_allocations = allocator.allocations - allocations;
+	MassSpringSolver* solver = new MassSpringSolver(system, vbuff.data(), LinearSolver::create(backend));
+	r.construct_ms = msSince(start);
+
+	// pin the top corners so the cloth swings instead of falling freely
+	CgRootNode root(system, vbuff.data());
+	CgPointFixNode fixer(system, vbuff.data());
+	fixer.fixPoint(0);
+	fixer.fixPoint(n - 1);
+	root.addChild(&fixer);
+	CgSatisfyVisitor visitor;
+
+	start = Clock::now();
+	for (unsigned int s = 0; s < n_steps; s++) {
+		solver->solve(n_iter);
+		visitor.satisfy(root);
+	}
+	r.step_ms = msSince(start) / n_steps;
+	r.state_mb = (system->memoryUsage() + solver->memoryUsage() + vbuff.size() * sizeof(float)) / 1048576.0;
+	r.huge_mb = hugePageMB();
+	r.positions.assign(vbuff.begin(), vbuff.end());
+
+	delete solver;
+	delete system;
+	return r;
+}
+
+int main(int argc, char** argv) {
+	std::vector<unsigned int> sizes;
+	std::vector<std::string> allocators;
+	std::string backend = "llt-amd";
+	unsigned int n_steps = 20, n_iter = 10;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg(argv[i]);
+		if (arg == "--sizes" && i + 1 < argc) sizes = parseList(argv[++i]);
+		else if (arg == "--memory" && i + 1 < argc) allocators.push_back(argv[++i]);
+		else if (arg == "--solver" && i + 1 < argc) backend = argv[++i];
+		else if (arg == "--steps" && i + 1 < argc) n_steps = std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--iter" && i + 1 < argc) n_iter = std::atoi(argv[++i]);
+	}
+	if (sizes.empty()) sizes = { 257, 513, 1025 };
+	if (allocators.empty()) allocators = Allocator::available();
+
+	std::cout << backend << ", " << n_steps << " steps of " << n_iter << " iterations" << std::endl;
+	std::cout << std::left << std::setw(10) << "mesh" << std::setw(16) << "allocator" << std::right
+		<< std::setw(14) << "construct ms" << std::setw(12) << "step ms" << std::setw(12) << "state MB"
+		<< std::setw(12) << "huge MB" << std::setw(14) << "system allocs" << std::setw(12) << "max diff" << std::endl;
+	for (unsigned int n : sizes) {
+		std::vector<float> reference;
+		for (const std::string& name : allocators) {
+			try {
+				CountingAllocator* allocator = new CountingAllocator(Allocator::create(name));
+				Allocator::setDefault(allocator);
+				Result r = run(n, backend, n_steps, n_iter, *allocator);
+				if (reference.empty()) reference = r.positions;
+				float difference = 0.0f;
+				for (size_t i = 0; i < reference.size(); i++)
+					difference = std::max(difference, std::abs(reference[i] - r.positions[i]));
+
+				std::cout << std::left << std::setw(10) << ("grid " + std::to_string(n)) << std::setw(16) << name
+					<< std::right << std::fixed << std::setprecision(2)
+					<< std::setw(14) << r.construct_ms
+					<< std::setw(12) << r.step_ms
+					<< std::setprecision(1) << std::setw(12) << r.state_mb
+					<< std::setw(12) << r.huge_mb
+					<< std::setw(14) << r.system_allocations
+					<< std::scientific << std::setprecision(1) << std::setw(12) << difference << std::endl;
+			}
+			catch (std::exception& e) {
+				std::cerr << "grid " << n << " " << name << ": " << e.what() << std::endl;
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,304 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Mesh.h"
+#include "MassSpringSolver.h"
+#include "LinearSolver.h"
+#include "Profiler.h"
+#include "TimedSolver.h"
+
+// Pipeline stage microbenchmark
+// Times every stage of building and stepping a grid cloth: mesh building, the spring builder,
+// the solver constructor with its assembly, pattern analysis and numeric factorization, local
+// and global steps, every constraint node and the normal update. Each stage runs warm-up rounds first, then
+// repetitions until the count or the time budget is reached, summarized by min, median, mean,
+// standard deviation and max. Local and global steps are private to the solver and read from its
+// profiler probes, so this target links a core built with FMS_PROFILING.
+//
+// Results go to a JSON file, one result per line. --compare reads such a file as the baseline
+// and flags every stage whose median got slower by more than the threshold, the exit code is 1
+// if any did. Solver stages stop at --solver-max, the factor of a 2049 grid needs tens of GB.
+//
+// usage: pipeline-bench [--sizes 33,65,129,257,513,1025,2049] [--warmup n] [--reps n] [--budget s]
+//                       [--solver name] [--solver-max n] [--json out.json]
+//                       [--compare baseline.json] [--threshold 0.1]
+
+struct Settings {
+	unsigned int warmup = 2; // untimed rounds per stage
+	unsigned int reps = 10; // timed rounds per stage
+	double budget_ms = 2000; // stop repeating after this, at least 3 rounds
+	std::string solver = "llt-amd";
+	unsigned int solver_max = 1025; // largest grid for solver stages
+};
+
+struct Summary {
+	std::string stage;
+	unsigned int grid;
+	unsigned int reps;
+	double min, median, mean, stddev, max; // ms
+};
+
+static Summary summarize(const std::string& stage, unsigned int n, std::vector<double> samples) {
+	Summary s = { stage, n, (unsigned int)samples.size(), 0, 0, 0, 0, 0 };
+	if (samples.empty()) return s;
+	std::sort(samples.begin(), samples.end());
+	const size_t m = samples.size();
+	s.min = samples.front();
+	s.max = samples.back();
+	s.median = m % 2 ? samples[m / 2] : 0.5 * (samples[m / 2 - 1] + samples[m / 2]);
+	for (double x : samples) s.mean += x / m;
+	for (double x : samples) s.stddev += (x - s.mean) * (x - s.mean);
+	s.stddev = m > 1 ? std::sqrt(s.stddev / (m - 1)) : 0.0;
+	return s;
+}
+
+// run() returns the ms of one round, anything it does outside its own timer is not counted
+template <typename F>
+static Summary measure(const std::string& stage, unsigned int n, const Settings& settings, F run) {
+	for (unsigned int r = 0; r < settings.warmup; r++) run();
+	std::vector<double> samples;
+	double total = 0;
+	while (samples.size() < settings.reps && (samples.size() < 3 || total < settings.budget_ms)) {
+		samples.push_back(run());
+		total += samples.back();
+	}
+	return summarize(stage, n, samples);
+}
+
+// constraint nodes work on a copy of the grid reset before every round
+template <typename F>
+static Summary measureNode(const std::string& stage, unsigned int n, const Settings& settings,
+	const std::vector<float>& initial, std::vector<float>& vbuff, F satisfy) {
+	return measure(stage, n, settings, [&]() {
+		std::copy(initial.begin(), initial.end(), vbuff.begin());
+		Clock::time_point start = Clock::now();
+		satisfy();
+		return msSince(start);
+	});
+}
+
+static std::vector<Summary> run(unsigned int n, const Settings& settings) {
+	const float w = 2.0f, h = 0.008f, k = 1.0f, a = 0.993f, g = 9.8f, m = 0.25f / (n * n);
+	std::vector<Summary> results;
+
+	// building
+	results.push_back(measure("mesh.uniformGrid", n, settings, [&]() {
+		Clock::time_point start = Clock::now();
+		MeshBuilder meshBuilder;
+		meshBuilder.uniformGrid(w, n);
+		Mesh* mesh = meshBuilder.getResult();
+		double ms = msSince(start);
+		delete mesh;
+		return ms;
+	}));
+	results.push_back(measure("builder.uniformGrid", n, settings, [&]() {
+		Clock::time_point start = Clock::now();
+		MassSpringBuilder massSpringBuilder;
+		massSpringBuilder.uniformGrid(n, h, w / (n - 1) * 1.05f, k, m, a, g * m);
+		mass_spring_system* system = massSpringBuilder.getResult();
+		double ms = msSince(start);
+		delete system;
+		return ms;
+	}));
+
+	MeshBuilder meshBuilder;
+	meshBuilder.uniformGrid(w, n);
+	Mesh* mesh = meshBuilder.getResult();
+	const std::vector<float> grid(mesh->vbuff(), mesh->vbuff() + mesh->vbuffLen());
+	MassSpringBuilder massSpringBuilder;
+	massSpringBuilder.uniformGrid(n, h, w / (n - 1) * 1.05f, k, m, a, g * m);
+	mass_spring_system* system = massSpringBuilder.getResult();
+	std::vector<float> vbuff(grid);
+
+	// solver
+	if (n <= settings.solver_max) {
+		std::vector<double> assemble, analyze, factor;
+		results.push_back(measure("solver.construct", n, settings, [&]() {
+			TimedSolver* timed = new TimedSolver(LinearSolver::create(settings.solver));
+			Clock::time_point start = Clock::now();
+			MassSpringSolver* solver = new MassSpringSolver(system, vbuff.data(), timed);
+			double ms = msSince(start);
+			assemble.push_back(ms - timed->analyze_ms - timed->factor_ms);
+			analyze.push_back(timed->analyze_ms);
+			factor.push_back(timed->factor_ms);
+			delete solver;
+			return ms;
+		}));
+		assemble.erase(assemble.begin(), assemble.begin() + std::min<size_t>(settings.warmup, assemble.size()));
+		analyze.erase(analyze.begin(), analyze.begin() + std::min<size_t>(settings.warmup, analyze.size()));
+		factor.erase(factor.begin(), factor.begin() + std::min<size_t>(settings.warmup, factor.size()));
+		results.push_back(summarize("solver.assemble", n, assemble)); // constructor minus the backend calls
+		results.push_back(summarize("solver.analyzePattern", n, analyze));
+		results.push_back(summarize("solver.factorize", n, factor));
+
+		// one iteration per round, the probes time both steps
+		MassSpringSolver solver(system, vbuff.data(), LinearSolver::create(settings.solver));
+		for (unsigned int r = 0; r < settings.warmup; r++) solver.solve(1);
+		Profiler::clear();
+		double total = 0;
+		for (unsigned int r = 0; r < settings.reps && (r < 3 || total < settings.budget_ms); r++) {
+			Clock::time_point start = Clock::now();
+			solver.solve(1);
+			total += msSince(start);
+		}
+		results.push_back(summarize("solver.localStep", n, Profiler::durations("localStep")));
+		results.push_back(summarize("solver.globalStep", n, Profiler::durations("globalStep")));
+		Profiler::clear();
+	}
+
+	// constraint nodes, on a grid stretched by half along x so every node has work to do
+	std::vector<float> stretched(grid), prev(grid);
+	for (size_t i = 0; i < stretched.size(); i += 3) {
+		stretched[i] *= 1.5f;
+		prev[i] = stretched[i];
+		prev[i + 2] += 0.5f;
+	}
+	std::vector<unsigned int> springs = massSpringBuilder.getShearIndex();
+	std::vector<unsigned int> structural = massSpringBuilder.getStructIndex();
+	springs.insert(springs.end(), structural.begin(), structural.end());
+
+	CgPointFixNode fixer(system, vbuff.data());
+	fixer.fixPoint(0);
+	fixer.fixPoint(n - 1);
+	results.push_back(measureNode("cg.pointFix", n, settings, stretched, vbuff, [&]() { fixer.satisfy(); }));
+
+	CgSpringDeformationNode deformation(system, vbuff.data(), 0.4f, 15);
+	deformation.addSprings(springs);
+	deformation.addChild(&fixer);
+	results.push_back(measureNode("cg.springDeformation", n, settings, stretched, vbuff, [&]() { deformation.satisfy(); }));
+
+	CgSphereCollisionNode sphere(system, vbuff.data(), 0.64f, Eigen::Vector3f(0.0f, 0.0f, -0.3f));
+	results.push_back(measureNode("cg.sphereCollision", n, settings, stretched, vbuff, [&]() { sphere.satisfy(); }));
+
+	CgContinuousCollisionNode ccd(system, vbuff.data(), prev.data());
+	ccd.addSphere(Eigen::Vector3f(0.0f, 0.0f, -0.3f), 0.64f);
+	results.push_back(measureNode("cg.continuousCollision", n, settings, stretched, vbuff, [&]() { ccd.satisfy(); }));
+
+	// normals, the simulation thread's raw buffer update and OpenMesh's
+	std::vector<float> nbuff(grid.size());
+	results.push_back(measure("normals.compute", n, settings, [&]() {
+		Clock::time_point start = Clock::now();
+		Mesh::computeNormals(stretched.data(), n * n, mesh->ibuff(), mesh->ibuffLen(), nbuff.data());
+		return msSince(start);
+	}));
+	mesh->request_face_normals();
+	results.push_back(measure("normals.openmesh", n, settings, [&]() {
+		Clock::time_point start = Clock::now();
+		mesh->update_normals();
+		return msSince(start);
+	}));
+	mesh->release_face_normals();
+
+	delete system;
+	delete mesh;
+	return results;
+}
+
+// J S O N //////////////////////////////////////////////////////////////////////////////////////////
+static void writeJson(const std::string& path, const Settings& settings, const std::vector<Summary>& results) {
+	std::ofstream out(path);
+	if (!out) throw std::runtime_error("Failed to open " + path);
+	out << std::setprecision(6);
+	out << "{\n  \"benchmark\": \"pipeline-bench\",\n  \"threads\": " << maxThreads()
+		<< ",\n  \"solver\": \"" << settings.solver << "\",\n  \"warmup\": " << settings.warmup
+		<< ",\n  \"reps\": " << settings.reps << ",\n  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); i++) {
+		const Summary& s = results[i];
+		out << "    {\"stage\": \"" << s.stage << "\", \"grid\": " << s.grid << ", \"reps\": " << s.reps
+			<< ", \"min_ms\": " << s.min << ", \"median_ms\": " << s.median << ", \"mean_ms\": " << s.mean
+			<< ", \"stddev_ms\": " << s.stddev << ", \"max_ms\": " << s.max << "}"
+			<< (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	out << "  ]\n}\n";
+	if (!out) throw std::runtime_error("Failed to write " + path);
+}
+
+// reads the result lines of a file written by writeJson, (stage, grid) -> median
+static std::map<std::pair<std::string, unsigned int>, double> readBaseline(const std::string& path) {
+	std::ifstream in(path);
+	if (!in) throw std::runtime_error("Failed to open baseline " + path);
+	std::map<std::pair<std::string, unsigned int>, double> baseline;
+	auto field = [](const std::string& line, const std::string& key) {
+		size_t p = line.find("\"" + key + "\": ");
+		return p == std::string::npos ? std::string() : line.substr(p + key.size() + 4);
+	};
+	std::string line;
+	while (std::getline(in, line)) {
+		std::string stage = field(line, "stage"), grid = field(line, "grid"), median = field(line, "median_ms");
+		if (stage.size() < 2 || grid.empty() || median.empty()) continue;
+		stage = stage.substr(1, stage.find('"', 1) - 1);
+		baseline[std::make_pair(stage, (unsigned int)std::atoi(grid.c_str()))] = std::atof(median.c_str());
+	}
+	return baseline;
+}
+
+int main(int argc, char** argv) {
+	std::vector<unsigned int> sizes;
+	Settings settings;
+	std::string jsonPath = "pipeline-bench.json", comparePath;
+	double threshold = 0.1;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg(argv[i]);
+		if (arg == "--sizes" && i + 1 < argc) sizes = parseList(argv[++i]);
+		else if (arg == "--warmup" && i + 1 < argc) settings.warmup = std::atoi(argv[++i]);
+		else if (arg == "--reps" && i + 1 < argc) settings.reps = std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--budget" && i + 1 < argc) settings.budget_ms = 1000.0 * std::atof(argv[++i]);
+		else if (arg == "--solver" && i + 1 < argc) settings.solver = argv[++i];
+		else if (arg == "--solver-max" && i + 1 < argc) settings.solver_max = std::atoi(argv[++i]);
+		else if (arg == "--json" && i + 1 < argc) jsonPath = argv[++i];
+		else if (arg == "--compare" && i + 1 < argc) comparePath = argv[++i];
+		else if (arg == "--threshold" && i + 1 < argc) threshold = std::atof(argv[++i]);
+	}
+	if (sizes.empty()) sizes = { 33, 65, 129, 257, 513, 1025, 2049 };
+	if (!Profiler::enabled) std::cerr << "profiling disabled, local and global steps are not timed" << std::endl;
+
+	std::cout << maxThreads() << " threads, " << settings.solver << ", " << settings.warmup << " warm-up, "
+		<< settings.reps << " reps" << std::endl;
+	std::cout << std::left << std::setw(26) << "stage" << std::setw(8) << "grid" << std::right
+		<< std::setw(6) << "reps" << std::setw(12) << "min ms" << std::setw(12) << "median ms"
+		<< std::setw(12) << "mean ms" << std::setw(12) << "stddev ms" << std::setw(12) << "max ms" << std::endl;
+	std::vector<Summary> results;
+	for (unsigned int n : sizes) {
+		for (const Summary& s : run(n, settings)) {
+			std::cout << std::left << std::setw(26) << s.stage << std::setw(8) << s.grid << std::right
+				<< std::setw(6) << s.reps << std::fixed << std::setprecision(3)
+				<< std::setw(12) << s.min << std::setw(12) << s.median << std::setw(12) << s.mean
+				<< std::setw(12) << s.stddev << std::setw(12) << s.max << std::endl;
+			results.push_back(s);
+		}
+	}
+	writeJson(jsonPath, settings, results);
+	std::cout << "results written to " << jsonPath << std::endl;
+	if (comparePath.empty()) return 0;
+
+	// medians against the baseline, stages missing on either side are skipped
+	std::map<std::pair<std::string, unsigned int>, double> baseline = readBaseline(comparePath);
+	unsigned int regressions = 0;
+	std::cout << std::endl << "baseline " << comparePath << ", threshold " << 100.0 * threshold << "%" << std::endl;
+	std::cout << std::left << std::setw(26) << "stage" << std::setw(8) << "grid" << std::right
+		<< std::setw(12) << "base ms" << std::setw(12) << "now ms" << std::setw(10) << "change" << std::endl;
+	for (const Summary& s : results) {
+		auto it = baseline.find(std::make_pair(s.stage, s.grid));
+		if (it == baseline.end() || it->second <= 0.0 || s.reps == 0) continue;
+		double change = s.median / it->second - 1.0;
+		bool regressed = change > threshold;
+		regressions += regressed;
+		std::cout << std::left << std::setw(26) << s.stage << std::setw(8) << s.grid << std::right
+			<< std::fixed << std::setprecision(3) << std::setw(12) << it->second << std::setw(12) << s.median
+			<< std::setprecision(1) << std::setw(9) << 100.0 * change << "%"
+			<< (regressed ? "  REGRESSION" : "") << std::endl;
+	}
+	std::cout << regressions << " regressions" << std::endl;
+	return regressions > 0 ? 1 : 0;
+}
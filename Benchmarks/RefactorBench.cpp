@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Mesh.h"
+#include "MassSpringSolver.h"
+#include "LinearSolver.h"
+#include "BenchUtil.h"
+
+// Parameter change benchmark
+// Changes stiffness, mass and time step on grid cloths the two possible ways: building a new
+// solver, which assembles, orders, analyzes and factors A, or setParameters() on a running one,
+// which keeps the pattern analysis and only refactors. Reports the best time of both per
+// backend and the largest position difference between the two after a few time steps, which
+// should be zero or rounding.
+//
+// usage: refactor-bench [--sizes 33,65,129] [--solver <backend>]... [--reps n]
+
+// the slider move: twice as stiff, half again as heavy, half the time step
+static void changeParameters(mass_spring_system& system) {
+	system.stiffnesses *= 2.0f;
+	system.masses *= 1.5f;
+	system.time_step *= 0.5f;
+}
+
+static void run(unsigned int n, const std::string& backend, unsigned int reps) {
+	const float w = 2.0f, h = 0.008f, k = 1.0f, a = 0.993f, g = 9.8f, m = 0.25f / (n * n);
+	const unsigned int n_steps = 10, n_iter = 5;
+
+	MeshBuilder meshBuilder;
+	meshBuilder.uniformGrid(w, n);
+	Mesh* mesh = meshBuilder.getResult();
+	const std::vector<float> grid(mesh->vbuff(), mesh->vbuff() + mesh->vbuffLen());
+	delete mesh;
+
+	MassSpringBuilder massSpringBuilder;
+	massSpringBuilder.uniformGrid(n, h, w / (n - 1) * 1.05f, k, m, a, g * m);
+	mass_spring_system* system = massSpringBuilder.getResult();
+	mass_spring_system* changed = new mass_spring_system(*system);
+	changeParameters(*changed);
+
+	// full construction with the new parameters
+	std::vector<float> built(grid);
+	double construct_ms = 1e30;
+	for (unsigned int r = 0; r < reps; r++) {
+		Clock::time_point start = Clock::now();
+		MassSpringSolver solver(changed, built.data(), LinearSolver::create(backend));
+		construct_ms = std::min(construct_ms, msSince(start));
+	}
+
+	// refactor, switching between the old and the new parameters
+	std::vector<float> refactored(grid);
+	MassSpringSolver solver(system, refactored.data(), LinearSolver::create(backend));
+	const mass_spring_system original(*system);
+	double refactor_ms = 1e30;
+	for (unsigned int r = 0; r < reps; r++) {
+		solver.setParameters(original.stiffnesses, original.masses, original.time_step);
+		Clock::time_point start = Clock::now();
+		solver.setParameters(changed->stiffnesses, changed->masses, changed->time_step);
+		refactor_ms = std::min(refactor_ms, msSince(start));
+	}
+
+	// both have to step the same
+	MassSpringSolver reference(changed, built.data(), LinearSolver::create(backend));
+	for (unsigned int s = 0; s < n_steps; s++) {
+		reference.solve(n_iter);
+		solver.solve(n_iter);
+	}
+	float difference = 0.0f;
+	for (size_t i = 0; i < grid.size(); i++)
+		difference = std::max(difference, std::abs(built[i] - refactored[i]));
+
+	std::cout << std::left << std::setw(10) << ("grid " + std::to_string(n)) << std::setw(20) << backend
+		<< std::right << std::fixed << std::setprecision(2)
+		<< std::setw(14) << construct_ms
+		<< std::setw(14) << refactor_ms
+		<< std::setw(10) << construct_ms / refactor_ms
+		<< std::scientific << std::setprecision(1) << std::setw(12) << difference << std::endl;
+
+	delete changed;
+	delete system;
+}
+
+int main(int argc, char** argv) {
+	std::vector<unsigned int> sizes;
+	std::vector<std::string> backends;
+	unsigned int reps = 5;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg(argv[i]);
+		if (arg == "--sizes" && i + 1 < argc) sizes = parseList(argv[++i]);
+		else if (arg == "--solver" && i + 1 < argc) backends.push_back(argv[++i]);
+		else if (arg == "--reps" && i + 1 < argc) reps = std::atoi(argv[++i]);
+	}
+	if (sizes.empty()) sizes = { 33, 65, 129 };
+	if (backends.empty()) backends = LinearSolver::available();
+
+	std::cout << std::left << std::setw(10) << "mesh" << std::setw(20) << "backend" << std::right
+		<< std::setw(14) << "construct ms" << std::setw(14) << "refactor ms" << std::setw(10) << "speedup"
+		<< std::setw(12) << "max diff" << std::endl;
+	for (unsigned int n : sizes) {
+		for (const std::string& backend : backends) {
+			try {
+				run(n, backend, reps);
+			}
+			catch (std::exception& e) {
+				std::cerr << "grid " << n << " " << backend << ": " << e.what() << std::endl;
+			}
+		}
+	}
+	return 0;
+}
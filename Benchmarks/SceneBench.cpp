@@ -0,0 +1,84 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+#include "Mesh.h"
+#include "MassSpringSolver.h"
+#include "Scene.h"
+#include "BenchUtil.h"
+
+// Multi-cloth scene benchmark
+// Builds scenes of identical grid cloths and times the concurrent block factorization and
+// solves, serially and with one thread per object, to report the parallel speedup.
+//
+// usage: scene-bench [--objects 1,2,4,8,16,32] [--size n] [--iter n] [--steps n]
+
+int main(int argc, char** argv) {
+	std::vector<unsigned int> counts;
+	unsigned int n = 65, n_iter = 10, n_steps = 10;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg(argv[i]);
+		if (arg == "--objects" && i + 1 < argc) counts = parseList(argv[++i]);
+		else if (arg == "--size" && i + 1 < argc) n = std::atoi(argv[++i]);
+		else if (arg == "--iter" && i + 1 < argc) n_iter = std::atoi(argv[++i]);
+		else if (arg == "--steps" && i + 1 < argc) n_steps = std::atoi(argv[++i]);
+	}
+	if (counts.empty()) counts = { 1, 2, 4, 8, 16, 32 };
+
+	// same parameters as the app
+	const float w = 2.0f, h = 0.008f, k = 1.0f, a = 0.993f, g = 9.8f, m = 0.25f / (n * n);
+	MeshBuilder meshBuilder;
+	meshBuilder.uniformGrid(w, n);
+	Mesh* mesh = meshBuilder.getResult();
+
+	std::cout << "grid " << n << ", " << numCores() << " cores" << std::endl;
+	std::cout << std::left << std::setw(10) << "objects" << std::right << std::setw(10) << "threads"
+		<< std::setw(12) << "factor ms" << std::setw(12) << "step ms" << std::setw(10) << "speedup"
+		<< std::setw(12) << "efficiency" << std::endl;
+	for (unsigned int count : counts) {
+		double serial_ms = 0;
+		std::vector<int> threads = { 1 };
+		if (std::min((int)count, numCores()) > 1) threads.push_back(std::min((int)count, numCores()));
+		for (int t : threads) {
+			setThreads(t);
+
+			// stacked copies of the grid
+			std::vector<float> vbuff;
+			for (unsigned int c = 0; c < count; c++) {
+				vbuff.insert(vbuff.end(), mesh->vbuff(), mesh->vbuff() + mesh->vbuffLen());
+				for (unsigned int i = vbuff.size() - mesh->vbuffLen() + 2; i < vbuff.size(); i += 3)
+					vbuff[i] += 0.25f * c;
+			}
+
+			ClothScene scene;
+			for (unsigned int c = 0; c < count; c++) {
+				MassSpringBuilder massSpringBuilder;
+				massSpringBuilder.uniformGrid(n, h, w / (n - 1) * 1.05f, k, m, a, g * m);
+				scene.addObject(massSpringBuilder.getResult());
+			}
+			Clock::time_point start = Clock::now();
+			scene.build(vbuff.data(), "llt-amd");
+			double factor_ms = msSince(start);
+
+			start = Clock::now();
+			for (unsigned int s = 0; s < n_steps; s++) scene.solve(n_iter);
+			double step_ms = msSince(start) / n_steps;
+			if (t == 1) serial_ms = step_ms;
+
+			std::cout << std::left << std::setw(10) << count << std::right << std::fixed
+				<< std::setprecision(2) << std::setw(10) << t
+				<< std::setw(12) << factor_ms
+				<< std::setw(12) << step_ms
+				<< std::setw(10) << serial_ms / step_ms
+				<< std::setw(12) << serial_ms / step_ms / t << std::endl;
+		}
+	}
+
+	delete mesh;
+	return 0;
+}
@@ -0,0 +1,186 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+#include "Mesh.h"
+#include "MassSpringSolver.h"
+#include "Sleep.h"
+#include "BenchUtil.h"
+
+// Rest detection benchmark
+// Runs the hang demo frame by frame the way the simulation thread does, with sleeping off and
+// on: forces and collider bounds are checked first, then two time steps with the constraint
+// pass and the normal update, then the kinetic energy. Frames in which the cloth sleeps skip
+// everything but the checks. Reports when the cloth fell asleep and the mean frame time before
+// and after. Then wakes it the three possible ways, a released pin, a gust and a sphere moved
+// into the cloth, and checks that each one wakes it and that a sphere moved elsewhere does
+// not. The exit code is 1 if one of them fails.
+//
+// usage: sleep-bench [--size n] [--time s] [--energy joules] [--frames n]
+
+struct Cloth {
+	unsigned int n;
+	std::vector<float> vbuff, prev_vbuff, nbuff;
+	std::vector<unsigned int> ibuff;
+	mass_spring_system* system;
+	MassSpringSolver* solver;
+	CgRootNode* root;
+	CgSpringDeformationNode* deformation;
+	CgPointFixNode* fixer;
+	CgSphereCollisionNode* sphere;
+	SleepTracker sleep;
+	SleepTracker::BoxList colliders;
+
+	Cloth(unsigned int n, float energy, unsigned int frames) : n(n) {
+		const float w = 2.0f, h = 0.008f, k = 1.0f, a = 0.993f, g = 9.8f, m = 0.25f / (n * n);
+
+		MeshBuilder meshBuilder;
+		meshBuilder.uniformGrid(w, n);
+		Mesh* mesh = meshBuilder.getResult();
+		vbuff.assign(mesh->vbuff(), mesh->vbuff() + mesh->vbuffLen());
+		ibuff.assign(mesh->ibuff(), mesh->ibuff() + mesh->ibuffLen());
+		prev_vbuff = nbuff = vbuff;
+		delete mesh;
+
+		MassSpringBuilder massSpringBuilder;
+		massSpringBuilder.uniformGrid(n, h, w / (n - 1) * 1.05f, k, m, a, g * m);
+		system = massSpringBuilder.getResult();
+		solver = new MassSpringSolver(system, vbuff.data());
+		std::vector<unsigned int> springs = massSpringBuilder.getShearIndex();
+		std::vector<unsigned int> structural = massSpringBuilder.getStructIndex();
+		springs.insert(springs.end(), structural.begin(), structural.end());
+
+		// hang from the top corners, a sphere parked far off to the side
+		root = new CgRootNode(system, vbuff.data());
+		deformation = new CgSpringDeformationNode(system, vbuff.data(), 0.12f, 15);
+		deformation->addSprings(springs);
+		root->addChild(deformation);
+		fixer = new CgPointFixNode(system, vbuff.data());
+		fixer->fixPoint(0);
+		fixer->fixPoint(n - 1);
+		deformation->addChild(fixer);
+		sphere = new CgSphereCollisionNode(system, vbuff.data(), 0.3f, Eigen::Vector3f(5.0f, 0.0f, 0.0f));
+		root->addChild(sphere);
+
+		sleep.addIsland(0, system->n_points);
+		sleep.setThreshold(energy, frames);
+	}
+
+	~Cloth() {
+		delete sphere;
+		delete fixer;
+		delete deformation;
+		delete root;
+		delete solver;
+		delete system;
+	}
+
+	// one 60 Hz frame, two time steps, returns false if it was skipped
+	bool frame() {
+		CgBoundsVisitor bounds;
+		bounds.collect(*root, colliders);
+		sleep.check(system->fext.data(), colliders);
+		if (sleep.allAsleep()) return false;
+
+		CgSatisfyVisitor visitor;
+		for (int s = 0; s < 2; s++) {
+			prev_vbuff = vbuff;
+			solver->solve(5);
+			visitor.satisfy(*root);
+		}
+		Mesh::computeNormals(vbuff.data(), system->n_points, ibuff.data(), (unsigned int)ibuff.size(), nbuff.data());
+		sleep.update(0, solver->kineticEnergy(), vbuff.data(), system->fext.data());
+		return true;
+	}
+};
+
+struct Timeline {
+	int slept_at; // frame the cloth fell asleep, -1 if never
+	unsigned int skipped;
+	double awake_ms, asleep_ms; // mean frame time
+};
+
+static Timeline run(Cloth& cloth, unsigned int n_frames) {
+	Timeline t = { -1, 0, 0.0, 0.0 };
+	unsigned int awake = 0;
+	for (unsigned int f = 0; f < n_frames; f++) {
+		Clock::time_point start = Clock::now();
+		bool simulated = cloth.frame();
+		double ms = msSince(start);
+		if (simulated) {
+			t.awake_ms += ms;
+			awake++;
+		}
+		else t.asleep_ms += ms;
+		if (t.slept_at < 0 && cloth.sleep.allAsleep()) t.slept_at = f;
+		t.skipped += !simulated;
+	}
+	t.awake_ms = awake ? t.awake_ms / awake : 0.0;
+	t.asleep_ms = t.skipped ? t.asleep_ms / t.skipped : 0.0;
+	return t;
+}
+
+// settles the cloth, applies the change and runs one frame
+template <typename F>
+static bool wakes(unsigned int n, float energy, unsigned int frames, unsigned int n_frames, F change) {
+	Cloth cloth(n, energy, frames);
+	run(cloth, n_frames);
+	if (!cloth.sleep.allAsleep()) return false;
+	change(cloth);
+	return cloth.frame();
+}
+
+int main(int argc, char** argv) {
+	unsigned int n = 33, frames = 30;
+	float time = 30.0f, energy = 1e-6f;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg(argv[i]);
+		if (arg == "--size" && i + 1 < argc) n = std::atoi(argv[++i]);
+		else if (arg == "--time" && i + 1 < argc) time = (float)std::atof(argv[++i]);
+		else if (arg == "--energy" && i + 1 < argc) energy = (float)std::atof(argv[++i]);
+		else if (arg == "--frames" && i + 1 < argc) frames = std::atoi(argv[++i]);
+	}
+	const unsigned int n_frames = (unsigned int)(time * 60);
+
+	std::cout << "grid " << n << ", " << time << " s, sleep below " << energy << " J for " << frames
+		<< " frames" << std::endl;
+	std::cout << std::left << std::setw(10) << "sleeping" << std::right << std::setw(12) << "asleep at"
+		<< std::setw(10) << "skipped" << std::setw(12) << "awake ms" << std::setw(12) << "asleep ms"
+		<< std::setw(12) << "total ms" << std::endl;
+	for (int enabled = 0; enabled < 2; enabled++) {
+		Cloth cloth(n, enabled ? energy : 0.0f, frames);
+		Clock::time_point start = Clock::now();
+		Timeline t = run(cloth, n_frames);
+		double total = msSince(start);
+		std::cout << std::left << std::setw(10) << (enabled ? "on" : "off") << std::right << std::fixed
+			<< std::setprecision(2) << std::setw(12) << (t.slept_at < 0 ? -1.0 : t.slept_at / 60.0)
+			<< std::setw(10) << t.skipped << std::setprecision(3) << std::setw(12) << t.awake_ms
+			<< std::setw(12) << t.asleep_ms << std::setprecision(1) << std::setw(12) << total << std::endl;
+	}
+
+	// each change has to wake the settled cloth, pins wake it as the command handler does
+	bool ok = true;
+	auto report = [&](const char* label, bool woke, bool expected) {
+		std::cout << std::left << std::setw(28) << label << (woke ? "woke" : "slept")
+			<< (woke == expected ? "" : "  FAILED") << std::endl;
+		ok = ok && woke == expected;
+	};
+	report("released pin", wakes(n, energy, frames, n_frames, [](Cloth& c) {
+		c.fixer->releasePoint(0);
+		c.sleep.wakePoint(0);
+	}), true);
+	report("gust", wakes(n, energy, frames, n_frames, [](Cloth& c) {
+		for (unsigned int i = 0; i < c.system->n_points; i++) c.system->fext[3 * i + 1] += 0.5f * c.system->fext[3 * i + 2];
+	}), true);
+	report("sphere moved into cloth", wakes(n, energy, frames, n_frames, [](Cloth& c) {
+		c.sphere->setCenter(Eigen::Vector3f(0.0f, 1.0f, -1.0f));
+	}), true);
+	report("sphere moved elsewhere", wakes(n, energy, frames, n_frames, [](Cloth& c) {
+		c.sphere->setCenter(Eigen::Vector3f(-5.0f, 0.0f, 0.0f));
+	}), false);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Mesh.h"
+#include "MassSpringSolver.h"
+#include "LinearSolver.h"
+#include "TimedSolver.h"
+
+// Global step linear solver benchmark
+// Times pattern analysis, numeric factorization and solves for every backend on
+// uniform grids and OBJ meshes, and reports the fill of the factor and the memory held
+// per vertex by the system and the solver.
+//
+// usage: solver-bench [--sizes 33,65,129] [--solver <backend>]... [--iter n] [file.obj]...
+
+struct BenchMesh {
+	std::string label;
+	Mesh* mesh;
+	mass_spring_system* system;
+};
+
+static void run(const BenchMesh& m, const std::string& backend, unsigned int n_iter) {
+	std::vector<float> vbuff(m.mesh->vbuff(), m.mesh->vbuff() + m.mesh->vbuffLen());
+	TimedSolver* timed = new TimedSolver(LinearSolver::create(backend));
+
+	Clock::time_point start = Clock::now();
+	MassSpringSolver solver(m.system, vbuff.data(), timed);
+	double setup_ms = msSince(start);
+	solver.solve(n_iter);
+	double bytes = (double)(m.system->memoryUsage() + solver.memoryUsage()) / m.system->n_points;
+
+	std::cout << std::left << std::setw(16) << m.label
+		<< std::setw(20) << backend << std::right << std::fixed << std::setprecision(2)
+		<< std::setw(10) << 3 * m.system->n_points
+		<< std::setw(12) << timed->factorNonZeros()
+		<< std::setw(12) << timed->analyze_ms
+		<< std::setw(12) << timed->factor_ms
+		<< std::setw(12) << timed->solve_total / timed->solves
+		<< std::setw(12) << setup_ms
+		<< std::setw(14) << bytes << std::endl;
+}
+
+int main(int argc, char** argv) {
+	std::vector<unsigned int> sizes;
+	std::vector<std::string> backends, objs;
+	unsigned int n_iter = 10;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg(argv[i]);
+		if (arg == "--sizes" && i + 1 < argc) {
+			std::string list(argv[++i]);
+			for (size_t p = 0; p < list.size();) {
+				size_t q = list.find(',', p);
+				if (q == std::string::npos) q = list.size();
+				sizes.push_back(std::atoi(list.substr(p, q - p).c_str()));
+				p = q + 1;
+			}
+		}
+		else if (arg == "--solver" && i + 1 < argc) backends.push_back(argv[++i]);
+		else if (arg == "--iter" && i + 1 < argc) n_iter = std::atoi(argv[++i]);
+		else objs.push_back(arg);
+	}
+	if (sizes.empty() && objs.empty()) sizes = { 33, 65, 129 };
+	if (backends.empty()) backends = LinearSolver::available();
+
+	// same parameters as the app
+	const float w = 2.0f, h = 0.008f, k = 1.0f, a = 0.993f, g = 9.8f, rho = 0.25f / (w * w);
+
+	std::vector<BenchMesh> meshes;
+	for (unsigned int n : sizes) {
+		MeshBuilder meshBuilder;
+		meshBuilder.uniformGrid(w, n);
+		MassSpringBuilder massSpringBuilder;
+		const float m = 0.25f / (n * n);
+		massSpringBuilder.uniformGrid(n, h, w / (n - 1) * 1.05f, k, m, a, g * m);
+		meshes.push_back({ "grid " + std::to_string(n), meshBuilder.getResult(), massSpringBuilder.getResult() });
+	}
+	for (const std::string& path : objs) {
+		MeshBuilder meshBuilder;
+		try {
+			meshBuilder.loadObj(path);
+		}
+		catch (std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			continue;
+		}
+		Mesh* mesh = meshBuilder.getResult();
+		unsigned int n_points = mesh->vbuffLen() / 3;
+		MassSpringBuilder massSpringBuilder;
+		massSpringBuilder.triangleMesh(mesh->vbuff(), n_points, mesh->ibuff(), mesh->ibuffLen(),
+			h, k, rho, a, g);
+		meshes.push_back({ path.substr(path.find_last_of("/\\") + 1), mesh, massSpringBuilder.getResult() });
+	}
+
+	std::cout << std::left << std::setw(16) << "mesh" << std::setw(20) << "backend" << std::right
+		<< std::setw(10) << "dof" << std::setw(12) << "nnz(L)" << std::setw(12) << "analyze ms"
+		<< std::setw(12) << "factor ms" << std::setw(12) << "solve ms" << std::setw(12) << "setup ms"
+		<< std::setw(14) << "bytes/vertex" << std::endl;
+	for (const BenchMesh& m : meshes) {
+		for (const std::string& backend : backends) {
+			try {
+				run(m, backend, n_iter);
+			}
+			catch (std::exception& e) {
+				std::cerr << m.label << " " << backend << ": " << e.what() << std::endl;
+			}
+		}
+	}
+
+	for (BenchMesh& m : meshes) {
+		delete m.system;
+		delete m.mesh;
+	}
+	return 0;
+}
@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+#include "Mesh.h"
+#include "MassSpringSolver.h"
+#include "BenchUtil.h"
+
+// Strain limiting benchmark
+// Runs the hang and drop demos with the separate CgSpringDeformationNode pass and with the
+// strain limit folded into the local step, and without limiting for reference. Reports the
+// frame time and the largest strain of the limited springs over the run. The local limit does not
+// hold on the hang demo, the solver does not see the pinned corners, which is why the app keeps
+// the pass there.
+//
+// usage: strain-bench [--sizes 33,65] [--frames n] [--weight w]
+
+enum Mode { NONE, PASS, LOCAL };
+static const char* MODE_NAMES[] = { "none", "pass", "local" };
+
+struct Result {
+	double frame_ms;
+	float max_strain; // over all frames
+	float final_strain; // last frame
+};
+
+static float maxStrain(const mass_spring_system* system, const float* vbuff, const std::vector<unsigned int>& springs) {
+	float strain = 0.0f;
+	for (unsigned int k : springs) {
+		const mass_spring_system::Edge& e = system->spring_list[k];
+		float dx = vbuff[3 * e.first + 0] - vbuff[3 * e.second + 0];
+		float dy = vbuff[3 * e.first + 1] - vbuff[3 * e.second + 1];
+		float dz = vbuff[3 * e.first + 2] - vbuff[3 * e.second + 2];
+		strain = std::max(strain, std::sqrt(dx * dx + dy * dy + dz * dz) / system->rest_lengths[k] - 1.0f);
+	}
+	return strain;
+}
+
+// demo setups of the app, two time steps per 60 Hz frame
+static Result run(bool drop, Mode mode, unsigned int n, unsigned int n_frames, float weight) {
+	const float w = 2.0f, h = 0.008f, k = 1.0f, a = 0.993f, g = 9.8f, m = 0.25f / (n * n);
+	const unsigned int n_iter = 5, substeps = 2, deformIter = 15;
+	const float tauc = drop ? 0.12f : 0.4f;
+
+	MeshBuilder meshBuilder;
+	meshBuilder.uniformGrid(w, n);
+	Mesh* mesh = meshBuilder.getResult();
+	std::vector<float> vbuff(mesh->vbuff(), mesh->vbuff() + mesh->vbuffLen());
+	delete mesh;
+
+	MassSpringBuilder massSpringBuilder;
+	massSpringBuilder.uniformGrid(n, h, w / (n - 1) * 1.05f, k, m, a, g * m);
+	mass_spring_system* system = massSpringBuilder.getResult();
+	std::vector<unsigned int> springs = massSpringBuilder.getShearIndex();
+	std::vector<unsigned int> structural = massSpringBuilder.getStructIndex();
+	springs.insert(springs.end(), structural.begin(), structural.end());
+
+	MassSpringSolver solver(system, vbuff.data());
+	if (mode == LOCAL) solver.setStrainLimit(tauc, weight, springs);
+
+	// constraint graph, fixers and the sphere hang below the deformation pass as in the app
+	CgRootNode root(system, vbuff.data());
+	CgSpringNode* parent = &root;
+	CgSpringDeformationNode deformation(system, vbuff.data(), tauc, deformIter);
+	if (mode == PASS) {
+		deformation.addSprings(springs);
+		root.addChild(&deformation);
+		parent = &deformation;
+	}
+	CgPointFixNode cornerFixer(system, vbuff.data());
+	CgSphereCollisionNode sphere(system, vbuff.data(), 0.64f, Eigen::Vector3f(0, 0, -1));
+	if (drop) root.addChild(&sphere);
+	else {
+		cornerFixer.fixPoint(0);
+		cornerFixer.fixPoint(n - 1);
+		parent->addChild(&cornerFixer);
+	}
+
+	Result result = { 0.0, 0.0f, 0.0f };
+	CgSatisfyVisitor visitor;
+	for (unsigned int f = 0; f < n_frames; f++) {
+		Clock::time_point start = Clock::now();
+		for (unsigned int s = 0; s < substeps; s++) {
+			solver.solve(n_iter);
+			visitor.satisfy(root);
+		}
+		result.frame_ms += msSince(start);
+		result.final_strain = maxStrain(system, vbuff.data(), springs);
+		result.max_strain = std::max(result.max_strain, result.final_strain);
+	}
+	result.frame_ms /= n_frames;
+
+	delete system;
+	return result;
+}
+
+int main(int argc, char** argv) {
+	std::vector<unsigned int> sizes;
+	unsigned int n_frames = 300;
+	float weight = 100.0f;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg(argv[i]);
+		if (arg == "--sizes" && i + 1 < argc) {
+			std::string list(argv[++i]);
+			for (size_t p = 0; p < list.size();) {
+				size_t q = list.find(',', p);
+				if (q == std::string::npos) q = list.size();
+				sizes.push_back(std::atoi(list.substr(p, q - p).c_str()));
+				p = q + 1;
+			}
+		}
+		else if (arg == "--frames" && i + 1 < argc) n_frames = std::atoi(argv[++i]);
+		else if (arg == "--weight" && i + 1 < argc) weight = (float)std::atof(argv[++i]);
+	}
+	if (sizes.empty()) sizes = { 33, 65 };
+
+	std::cout << n_frames << " frames, limit weight " << weight << std::endl;
+	std::cout << std::left << std::setw(8) << "demo" << std::setw(8) << "grid" << std::setw(8) << "mode"
+		<< std::right << std::setw(12) << "frame ms" << std::setw(14) << "max strain"
+		<< std::setw(14) << "final strain" << std::endl;
+	for (int drop = 0; drop < 2; drop++) {
+		for (unsigned int n : sizes) {
+			for (int mode = NONE; mode <= LOCAL; mode++) {
+				Result r = run(drop != 0, (Mode)mode, n, n_frames, weight);
+				std::cout << std::left << std::setw(8) << (drop ? "drop" : "hang") << std::setw(8) << n
+					<< std::setw(8) << MODE_NAMES[mode] << std::right << std::fixed
+					<< std::setprecision(3) << std::setw(12) << r.frame_ms
+					<< std::setw(14) << r.max_strain
+					<< std::setw(14) << r.final_strain << std::endl;
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <string>
+
+#include "LinearSolver.h"
+#include "BenchUtil.h"
+
+// Backend wrapper that times the calls made by the solver, takes ownership of the backend
+class TimedSolver : public LinearSolver {
+private:
+	LinearSolver* backend;
+
+public:
+	double analyze_ms = 0, factor_ms = 0; // last call
+	mutable double solve_total = 0;
+	mutable unsigned int solves = 0;
+
+	TimedSolver(LinearSolver* backend) : backend(backend) {}
+	~TimedSolver() { delete backend; }
+
+	virtual void analyzePattern(const SparseMatrix& A) {
+		Clock::time_point start = Clock::now();
+		backend->analyzePattern(A);
+		analyze_ms = msSince(start);
+	}
+
+	virtual void factorize(const SparseMatrix& A) {
+		Clock::time_point start = Clock::now();
+		backend->factorize(A);
+		factor_ms = msSince(start);
+	}
+
+	virtual void solve(const VectorRef& b, ResultRef x) const {
+		Clock::time_point start = Clock::now();
+		backend->solve(b, x);
+		solve_total += msSince(start);
+		solves++;
+	}
+
+	virtual long factorNonZeros() const { return backend->factorNonZeros(); }
+	virtual size_t memoryUsage() const { return backend->memoryUsage(); }
+	virtual std::string name() const { return backend->name(); }
+};
@@ -0,0 +1,155 @@
+#include "Aerodynamics.h"
+#include "Profiler.h"
+#include <cmath>
+#include <random>
+
+static const unsigned int MODE_SIZE = 7; // wave vector, amplitude, phase
+
+// W I N D  F I E L D ///////////////////////////////////////////////////////////////////////////////
+WindField::WindField() : mean(Vector3f::Zero()) {}
+
+void WindField::setMean(const Vector3f& mean) { this->mean = mean; }
+
+void WindField::setTurbulence(float intensity, float scale, unsigned int n_modes, unsigned int seed) {
+	const float PI = 3.14159265358979f;
+	std::mt19937 rng(seed);
+	std::normal_distribution<float> normal;
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+	// wave lengths between scale and scale / 2, energy split evenly between the modes
+	modes.resize(MODE_SIZE * n_modes);
+	for (unsigned int m = 0; m < n_modes; m++) {
+		Vector3f k(normal(rng), normal(rng), normal(rng));
+		k = k.normalized() * (2.0f * PI / scale) * (1.0f + uniform(rng));
+		Vector3f d = k.cross(Vector3f(normal(rng), normal(rng), normal(rng))).normalized();
+		d *= intensity * std::sqrt(2.0f / n_modes); // rms intensity per component of the sum
+		float* mode = &modes[MODE_SIZE * m];
+		for (int j = 0; j < 3; j++) {
+			mode[j] = k[j];
+			mode[3 + j] = d[j];
+		}
+		mode[6] = 2.0f * PI * uniform(rng);
+	}
+}
+
+void WindField::evaluate(const float* points, unsigned int n, float time, float* velocities) const {
+	const unsigned int n_modes = (unsigned int)modes.size() / MODE_SIZE;
+	const float mx = mean[0], my = mean[1], mz = mean[2];
+
+	#pragma omp parallel for schedule(static)
+	for (int i = 0; i < (int)n; i++) {
+		// frozen turbulence, sampled upwind by the mean wind
+		float x = points[3 * i + 0] - mx * time;
+		float y = points[3 * i + 1] - my * time;
+		float z = points[3 * i + 2] - mz * time;
+		float u = mx, v = my, w = mz;
+		for (unsigned int m = 0; m < n_modes; m++) {
+			const float* mode = &modes[MODE_SIZE * m];
+			float s = std::sin(mode[0] * x + mode[1] * y + mode[2] * z + mode[6]);
+			u += mode[3] * s;
+			v += mode[4] * s;
+			w += mode[5] * s;
+		}
+		velocities[3 * i + 0] = u;
+		velocities[3 * i + 1] = v;
+		velocities[3 * i + 2] = w;
+	}
+}
+
+// A E R O D Y N A M I C  F O R C E /////////////////////////////////////////////////////////////////
+AerodynamicForce::AerodynamicForce(mass_spring_system* system, const unsigned int* ibuff,
+	unsigned int ibuffLen)
+	: system(system), base_fext(system->fext), ibuff(ibuff, ibuff + ibuffLen),
+	density(1.2f), drag(1.0f), lift(0.5f),
+	relative(3 * system->n_points), triangle_forces(ibuffLen) {
+	const unsigned int n_points = system->n_points;
+	const unsigned int n_tris = ibuffLen / 3;
+
+	// incident triangles per point, counting sort by point
+	incident_offsets.assign(n_points + 1, 0);
+	for (unsigned int f = 0; f < 3 * n_tris; f++) incident_offsets[ibuff[f] + 1]++;
+	for (unsigned int i = 0; i < n_points; i++) incident_offsets[i + 1] += incident_offsets[i];
+	incident_triangles.resize(3 * n_tris);
+	IndexList fill(incident_offsets.begin(), incident_offsets.end() - 1);
+	for (unsigned int f = 0; f < 3 * n_tris; f++) incident_triangles[fill[ibuff[f]]++] = f / 3;
+}
+
+WindField& AerodynamicForce::windField() { return wind; }
+
+void AerodynamicForce::setCoefficients(float density, float drag, float lift) {
+	this->density = density;
+	this->drag = drag;
+	this->lift = lift;
+}
+
+void AerodynamicForce::apply(const float* current, const float* previous, float time) {
+	PROFILE_SCOPE("aerodynamics");
+	const int n_points = (int)system->n_points;
+	const int n_tris = (int)ibuff.size() / 3;
+	const float inv_h = 1.0f / system->time_step;
+
+	// relative wind per point, wind - (q(n) - q(n - 1)) / h
+	float* rel = relative.data();
+	wind.evaluate(current, n_points, time, rel);
+	#pragma omp parallel for schedule(static)
+	for (int i = 0; i < 3 * n_points; i++) rel[i] -= (current[i] - previous[i]) * inv_h;
+
+	// With c = e1 x e2 = 2 A n (nx, ny, nz below) and v the mean relative wind of the triangle:
+	// drag 1/2 rho Cd A |n.v| v = rho Cd / 4 |c.v| v, lift 1/2 rho Cl A |v|^2 cos(t) (n - cos(t) u)
+	// = rho Cl / 4 (c.v) / |c| (|v| c - (c.v) v / |v|), both independent of the winding.
+	const float cd = 0.25f * density * drag / 3.0f, cl = 0.25f * density * lift / 3.0f;
+	const unsigned int* tris = ibuff.data();
+	float* out = triangle_forces.data();
+	#pragma omp parallel for schedule(static)
+	for (int t = 0; t < n_tris; t++) {
+		const unsigned int a = 3 * tris[3 * t + 0], b = 3 * tris[3 * t + 1], c = 3 * tris[3 * t + 2];
+		float e1x = current[b + 0] - current[a + 0], e2x = current[c + 0] - current[a + 0];
+		float e1y = current[b + 1] - current[a + 1], e2y = current[c + 1] - current[a + 1];
+		float e1z = current[b + 2] - current[a + 2], e2z = current[c + 2] - current[a + 2];
+		float nx = e1y * e2z - e1z * e2y;
+		float ny = e1z * e2x - e1x * e2z;
+		float nz = e1x * e2y - e1y * e2x;
+		float vx = (rel[a + 0] + rel[b + 0] + rel[c + 0]) * (1.0f / 3.0f);
+		float vy = (rel[a + 1] + rel[b + 1] + rel[c + 1]) * (1.0f / 3.0f);
+		float vz = (rel[a + 2] + rel[b + 2] + rel[c + 2]) * (1.0f / 3.0f);
+
+		float nv = nx * vx + ny * vy + nz * vz;
+		float nn = nx * nx + ny * ny + nz * nz;
+		float speed = std::sqrt(vx * vx + vy * vy + vz * vz);
+		float inv_speed = speed > 0.0f ? 1.0f / speed : 0.0f;
+		float inv_len = nn > 0.0f ? 1.0f / std::sqrt(nn) : 0.0f;
+
+		float fd = cd * std::abs(nv);
+		float fl = cl * nv * inv_len;
+		float fv = fd - fl * nv * inv_speed;
+		float fn = fl * speed;
+		out[3 * t + 0] = fv * vx + fn * nx;
+		out[3 * t + 1] = fv * vy + fn * ny;
+		out[3 * t + 2] = fv * vz + fn * nz;
+	}
+
+	// gather per point, fixed order over the incident triangles
+	const unsigned int* offsets = incident_offsets.data();
+	const unsigned int* incident = incident_triangles.data();
+	const float* base = base_fext.data();
+	float* fext = system->fext.data();
+	#pragma omp parallel for schedule(static)
+	for (int i = 0; i < n_points; i++) {
+		float fx = base[3 * i + 0], fy = base[3 * i + 1], fz = base[3 * i + 2];
+		for (unsigned int k = offsets[i]; k < offsets[i + 1]; k++) {
+			const float* f = &out[3 * incident[k]];
+			fx += f[0];
+			fy += f[1];
+			fz += f[2];
+		}
+		fext[3 * i + 0] = fx;
+		fext[3 * i + 1] = fy;
+		fext[3 * i + 2] = fz;
+	}
+}
+
+size_t AerodynamicForce::memoryUsage() const {
+	size_t floats = base_fext.size() + relative.size() + triangle_forces.size();
+	size_t indices = ibuff.size() + incident_offsets.size() + incident_triangles.size();
+	return sizeof(*this) + (floats + indices) * 4;
+}
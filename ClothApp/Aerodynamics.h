@@ -0,0 +1,60 @@
+#pragma once
+#include <Eigen/Dense>
+#include <vector>
+
+#include "MassSpringSolver.h"
+
+// Wind Field class
+// Mean wind plus frozen turbulence: a sum of divergence-free sine modes, each with a random
+// wave vector and an amplitude perpendicular to it, advected with the mean wind.
+class WindField {
+private:
+	typedef Eigen::Vector3f Vector3f;
+
+	Vector3f mean; // mean wind velocity
+	std::vector<float> modes; // per mode: wave vector (3), amplitude (3), phase
+
+public:
+	WindField();
+
+	void setMean(const Vector3f& mean);
+	void setTurbulence(float intensity, float scale, unsigned int n_modes = 4, unsigned int seed = 1);
+
+	// wind velocities at n points, 3 floats each
+	void evaluate(const float* points, unsigned int n, float time, float* velocities) const;
+};
+
+// Aerodynamic Force class
+// Per-step force stage, computes drag and lift on every triangle from the wind relative to
+// the triangle velocity and writes fext = constant forces + aerodynamic forces. Triangles are
+// evaluated independently, then gathered per point so no two threads write the same point.
+class AerodynamicForce {
+private:
+	typedef Eigen::VectorXf VectorXf;
+	typedef std::vector<unsigned int> IndexList;
+
+	mass_spring_system* system;
+	VectorXf base_fext; // fext as built, gravity
+	IndexList ibuff; // triangle indices
+	IndexList incident_offsets; // point i owns incident_triangles[offsets[i], offsets[i + 1])
+	IndexList incident_triangles;
+	WindField wind;
+
+	float density; // air density
+	float drag; // drag coefficient
+	float lift; // lift coefficient
+
+	VectorXf relative; // wind - point velocity, per point
+	VectorXf triangle_forces; // a third of each triangle force
+
+public:
+	AerodynamicForce(mass_spring_system* system, const unsigned int* ibuff, unsigned int ibuffLen);
+
+	WindField& windField();
+	void setCoefficients(float density, float drag, float lift);
+
+	// fext from q(n) and q(n - 1), call before solve()
+	void apply(const float* current, const float* previous, float time);
+
+	size_t memoryUsage() const;
+};
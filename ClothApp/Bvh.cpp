@@ -0,0 +1,155 @@
+#include "Bvh.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// B V H ////////////////////////////////////////////////////////////////////////////////////////////
+TriangleBvh::TriangleBvh(const float* vbuff, const unsigned int* ibuff, unsigned int ibuffLen)
+	: ibuff(ibuff, ibuff + ibuffLen) {
+	typedef Eigen::Map<const Vector3f> ConstMap;
+	const unsigned int n_tris = ibuffLen / 3;
+
+	// split on triangle centroids of the build pose
+	std::vector<Vector3f> centroids(n_tris);
+	for (unsigned int t = 0; t < n_tris; t++) {
+		centroids[t] = (ConstMap(&vbuff[3 * ibuff[3 * t + 0]]) + ConstMap(&vbuff[3 * ibuff[3 * t + 1]])
+			+ ConstMap(&vbuff[3 * ibuff[3 * t + 2]])) / 3.0f;
+	}
+	order.resize(n_tris);
+	for (unsigned int t = 0; t < n_tris; t++) order[t] = t;
+	nodes.reserve(2 * (n_tris / LEAF_SIZE + 1));
+	if (n_tris > 0) build(0, n_tris, centroids);
+	refit(vbuff);
+}
+
+unsigned int TriangleBvh::build(unsigned int first, unsigned int count,
+	const std::vector<Vector3f>& centroids) {
+	unsigned int index = (unsigned int)nodes.size();
+	nodes.push_back(Node());
+	if (count <= LEAF_SIZE) {
+		nodes[index].first = first;
+		nodes[index].count = count;
+		return index;
+	}
+
+	// median split along the longest axis of the centroid bounds
+	Vector3f lo = centroids[order[first]], hi = lo;
+	for (unsigned int k = first; k < first + count; k++) {
+		lo = lo.cwiseMin(centroids[order[k]]);
+		hi = hi.cwiseMax(centroids[order[k]]);
+	}
+	int axis;
+	(hi - lo).maxCoeff(&axis);
+	unsigned int half = count / 2;
+	std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count,
+		[&](unsigned int a, unsigned int b) { return centroids[a][axis] < centroids[b][axis]; });
+
+	build(first, half, centroids); // left child is the next node
+	unsigned int right = build(first + half, count - half, centroids);
+	nodes[index].first = right;
+	nodes[index].count = 0;
+	return index;
+}
+
+void TriangleBvh::refit(const float* vbuff) {
+	PROFILE_SCOPE("bvhRefit");
+	typedef Eigen::Map<const Vector3f> ConstMap;
+
+	// children come after their parents
+	for (size_t k = nodes.size(); k-- > 0;) {
+		Node& node = nodes[k];
+		if (node.count == 0) {
+			const Node& left = nodes[k + 1];
+			const Node& right = nodes[node.first];
+			node.lo = left.lo.cwiseMin(right.lo);
+			node.hi = left.hi.cwiseMax(right.hi);
+			continue;
+		}
+		node.lo = Vector3f::Constant(std::numeric_limits<float>::max());
+		node.hi = Vector3f::Constant(-std::numeric_limits<float>::max());
+		for (unsigned int i = node.first; i < node.first + node.count; i++) {
+			for (int j = 0; j < 3; j++) {
+				ConstMap p(&vbuff[3 * ibuff[3 * order[i] + j]]);
+				node.lo = node.lo.cwiseMin(p);
+				node.hi = node.hi.cwiseMax(p);
+			}
+		}
+	}
+}
+
+bool TriangleBvh::intersect(const float* vbuff, const Vector3f& origin, const Vector3f& direction,
+	Hit& hit) const {
+	typedef Eigen::Map<const Vector3f> ConstMap;
+	if (nodes.empty()) return false;
+	const Vector3f inv = direction.cwiseInverse();
+
+	// ray parameter where the ray enters the box, infinity on a miss
+	auto enter = [&](const Node& node) {
+		const float miss = std::numeric_limits<float>::infinity();
+		float tmin = 0.0f, tmax = miss;
+		for (int a = 0; a < 3; a++) {
+			// parallel to the slab, 0 * inf would be NaN on its planes
+			if (!std::isfinite(inv[a])) {
+				if (origin[a] < node.lo[a] || origin[a] > node.hi[a]) return miss;
+				continue;
+			}
+			float t0 = (node.lo[a] - origin[a]) * inv[a], t1 = (node.hi[a] - origin[a]) * inv[a];
+			if (t0 > t1) std::swap(t0, t1);
+			tmin = std::max(tmin, t0);
+			tmax = std::min(tmax, t1);
+		}
+		return tmax >= tmin ? tmin : miss;
+	};
+
+	hit.t = std::numeric_limits<float>::infinity();
+	std::vector<std::pair<float, unsigned int> > stack;
+	stack.push_back(std::make_pair(enter(nodes[0]), 0u));
+	while (!stack.empty()) {
+		std::pair<float, unsigned int> top = stack.back();
+		stack.pop_back();
+		if (top.first >= hit.t) continue;
+		const Node& node = nodes[top.second];
+
+		if (node.count == 0) {
+			// visit the nearer child first
+			unsigned int a = top.second + 1, b = node.first;
+			float ta = enter(nodes[a]), tb = enter(nodes[b]);
+			if (ta < tb) { std::swap(a, b); std::swap(ta, tb); }
+			if (ta < hit.t) stack.push_back(std::make_pair(ta, a));
+			if (tb < hit.t) stack.push_back(std::make_pair(tb, b));
+			continue;
+		}
+
+		// Moller-Trumbore
+		for (unsigned int i = node.first; i < node.first + node.count; i++) {
+			const unsigned int* v = &ibuff[3 * order[i]];
+			ConstMap p0(&vbuff[3 * v[0]]), p1(&vbuff[3 * v[1]]), p2(&vbuff[3 * v[2]]);
+			Vector3f e1 = p1 - p0, e2 = p2 - p0;
+			Vector3f pv = direction.cross(e2);
+			float det = e1.dot(pv);
+			if (std::abs(det) < 1e-12f) continue;
+			float invDet = 1.0f / det;
+			Vector3f tv = origin - p0;
+			float u = tv.dot(pv) * invDet;
+			if (u < 0.0f || u > 1.0f) continue;
+			Vector3f qv = tv.cross(e1);
+			float w = direction.dot(qv) * invDet;
+			if (w < 0.0f || u + w > 1.0f) continue;
+			float t = e2.dot(qv) * invDet;
+			if (t < 0.0f || t >= hit.t) continue;
+			hit.triangle = order[i];
+			hit.t = t;
+			hit.u = u;
+			hit.v = w;
+		}
+	}
+	return hit.t < std::numeric_limits<float>::infinity();
+}
+
+unsigned int TriangleBvh::nearestVertex(const Hit& hit) const {
+	const unsigned int* v = &ibuff[3 * hit.triangle];
+	float w0 = 1.0f - hit.u - hit.v;
+	if (w0 >= hit.u && w0 >= hit.v) return v[0];
+	return hit.u >= hit.v ? v[1] : v[2];
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <Eigen/Dense>
+#include <vector>
+
+// Triangle Bounding Volume Hierarchy class
+// Built once over a fixed triangle topology, then refit bottom-up whenever the vertices move.
+// Refitting keeps the tree valid for any deformation, the split quality of the build pose
+// only affects traversal speed.
+class TriangleBvh {
+private:
+	typedef Eigen::Vector3f Vector3f;
+	typedef std::vector<unsigned int> IndexList;
+
+	static const unsigned int LEAF_SIZE = 4; // triangles per leaf
+
+	struct Node {
+		Vector3f lo, hi; // bounding box
+		unsigned int first; // first triangle in order (leaf) or right child (inner)
+		unsigned int count; // number of triangles, 0 for inner nodes, left child is next
+	};
+
+	std::vector<Node> nodes; // parents before children
+	IndexList order; // triangle indices in leaf order
+	IndexList ibuff; // triangle indices
+
+	unsigned int build(unsigned int first, unsigned int count, const std::vector<Vector3f>& centroids);
+
+public:
+	// closest ray hit
+	struct Hit {
+		unsigned int triangle;
+		float t; // ray parameter
+		float u, v; // barycentric weights of the second and third vertex
+	};
+
+	TriangleBvh(const float* vbuff, const unsigned int* ibuff, unsigned int ibuffLen);
+
+	void refit(const float* vbuff);
+	bool intersect(const float* vbuff, const Vector3f& origin, const Vector3f& direction, Hit& hit) const;
+	unsigned int nearestVertex(const Hit& hit) const; // triangle vertex closest to the hit point
+};
@@ -0,0 +1,211 @@
+#include "Embedding.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+// closest point on triangle abc to p as barycentric weights (Ericson, Real-Time Collision Detection)
+static void closestPoint(const Eigen::Vector3f& p, const Eigen::Vector3f& a,
+	const Eigen::Vector3f& b, const Eigen::Vector3f& c, float w[3]) {
+	Eigen::Vector3f ab = b - a, ac = c - a, ap = p - a;
+	float d1 = ab.dot(ap), d2 = ac.dot(ap);
+	if (d1 <= 0 && d2 <= 0) { w[0] = 1; w[1] = 0; w[2] = 0; return; }
+
+	Eigen::Vector3f bp = p - b;
+	float d3 = ab.dot(bp), d4 = ac.dot(bp);
+	if (d3 >= 0 && d4 <= d3) { w[0] = 0; w[1] = 1; w[2] = 0; return; }
+
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+		float v = d1 / (d1 - d3);
+		w[0] = 1 - v; w[1] = v; w[2] = 0; return;
+	}
+
+	Eigen::Vector3f cp = p - c;
+	float d5 = ab.dot(cp), d6 = ac.dot(cp);
+	if (d6 >= 0 && d5 <= d6) { w[0] = 0; w[1] = 0; w[2] = 1; return; }
+
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+		float v = d2 / (d2 - d6);
+		w[0] = 1 - v; w[1] = 0; w[2] = v; return;
+	}
+
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {
+		float v = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+		w[0] = 0; w[1] = 1 - v; w[2] = v; return;
+	}
+
+	float denom = 1 / (va + vb + vc);
+	w[1] = vb * denom;
+	w[2] = vc * denom;
+	w[0] = 1 - w[1] - w[2];
+}
+
+// E M B E D D I N G ////////////////////////////////////////////////////////////////////////////////
+MeshEmbedding::MeshEmbedding(
+	const float* coarse,
+	unsigned int n_coarse,
+	const unsigned int* coarseIBuff,
+	unsigned int coarseIBuffLen,
+	const float* fine,
+	unsigned int n_fine,
+	const unsigned int* fineIBuff,
+	unsigned int fineIBuffLen
+)
+	: weights(n_fine), ibuff(fineIBuff, fineIBuff + fineIBuffLen), tau(0.0f), n_iter(0) {
+	typedef Eigen::Map<const Vector3f> ConstMap;
+	const unsigned int n_tris = coarseIBuffLen / 3;
+	assert(n_tris > 0);
+
+	// bucket coarse triangles into a uniform grid, cells about one triangle wide
+	Vector3f lo = ConstMap(coarse), hi = lo;
+	float size = 0.0f;
+	for (unsigned int i = 0; i < n_coarse; i++) {
+		lo = lo.cwiseMin(ConstMap(&coarse[3 * i]));
+		hi = hi.cwiseMax(ConstMap(&coarse[3 * i]));
+	}
+	for (unsigned int t = 0; t < n_tris; t++) {
+		const unsigned int* v = &coarseIBuff[3 * t];
+		size += (ConstMap(&coarse[3 * v[0]]) - ConstMap(&coarse[3 * v[1]])).norm();
+	}
+	size = std::max(size / n_tris, 1e-6f);
+	int dims[3];
+	while (true) { // grow cells until there are not many more cells than triangles
+		for (int j = 0; j < 3; j++) dims[j] = (int)((hi[j] - lo[j]) / size) + 1;
+		if ((double)dims[0] * dims[1] * dims[2] <= 8.0 * n_tris + 64) break;
+		size *= 1.5f;
+	}
+
+	auto cellOf = [&](const Vector3f& p, int c[3]) {
+		for (int j = 0; j < 3; j++)
+			c[j] = std::max(0, std::min(dims[j] - 1, (int)((p[j] - lo[j]) / size)));
+	};
+	auto cellIndex = [&](int x, int y, int z) { return (x * dims[1] + y) * dims[2] + z; };
+
+	std::vector<IndexList> cells(dims[0] * dims[1] * dims[2]);
+	for (unsigned int t = 0; t < n_tris; t++) {
+		const unsigned int* v = &coarseIBuff[3 * t];
+		Vector3f a = ConstMap(&coarse[3 * v[0]]), b = ConstMap(&coarse[3 * v[1]]);
+		Vector3f c = ConstMap(&coarse[3 * v[2]]);
+		int c0[3], c1[3];
+		cellOf(a.cwiseMin(b).cwiseMin(c), c0);
+		cellOf(a.cwiseMax(b).cwiseMax(c), c1);
+		for (int x = c0[0]; x <= c1[0]; x++)
+			for (int y = c0[1]; y <= c1[1]; y++)
+				for (int z = c0[2]; z <= c1[2]; z++)
+					cells[cellIndex(x, y, z)].push_back(t);
+	}
+
+	// closest coarse triangle per fine vertex, rings of cells around it until no closer one can exist
+	const int max_ring = std::max(dims[0], std::max(dims[1], dims[2]));
+	for (unsigned int i = 0; i < n_fine; i++) {
+		Vector3f p = ConstMap(&fine[3 * i]);
+		int c[3];
+		cellOf(p, c);
+		float best = std::numeric_limits<float>::max();
+		Weight& result = weights[i];
+		for (int r = 0; r <= max_ring; r++) {
+			for (int x = c[0] - r; x <= c[0] + r; x++) {
+				for (int y = c[1] - r; y <= c[1] + r; y++) {
+					for (int z = c[2] - r; z <= c[2] + r; z++) {
+						// shell of the ring only
+						if (std::max(std::abs(x - c[0]), std::max(std::abs(y - c[1]), std::abs(z - c[2]))) != r)
+							continue;
+						if (x < 0 || y < 0 || z < 0 || x >= dims[0] || y >= dims[1] || z >= dims[2])
+							continue;
+						for (unsigned int t : cells[cellIndex(x, y, z)]) {
+							const unsigned int* v = &coarseIBuff[3 * t];
+							Vector3f a = ConstMap(&coarse[3 * v[0]]), b = ConstMap(&coarse[3 * v[1]]);
+							Vector3f d = ConstMap(&coarse[3 * v[2]]);
+							float w[3];
+							closestPoint(p, a, b, d, w);
+							float dist = (w[0] * a + w[1] * b + w[2] * d - p).squaredNorm();
+							if (dist >= best) continue;
+							best = dist;
+							Vector3f normal = (b - a).cross(d - a);
+							float len = normal.norm();
+							for (int j = 0; j < 3; j++) {
+								result.v[j] = v[j];
+								result.w[j] = w[j];
+							}
+							result.offset = len > 0 ? (p - (w[0] * a + w[1] * b + w[2] * d)).dot(normal / len) : 0;
+						}
+					}
+				}
+			}
+			if (best < (r * size) * (r * size)) break;
+		}
+	}
+
+	// unique fine edges and their rest lengths
+	for (unsigned int f = 0; f + 2 < fineIBuffLen; f += 3) {
+		for (int j = 0; j < 3; j++) {
+			unsigned int a = fineIBuff[f + j], b = fineIBuff[f + (j + 1) % 3];
+			edges.push_back(a < b ? Edge(a, b) : Edge(b, a));
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+	edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+	rest_lengths.resize(edges.size());
+	for (unsigned int k = 0; k < edges.size(); k++)
+		rest_lengths[k] = (ConstMap(&fine[3 * edges[k].first]) - ConstMap(&fine[3 * edges[k].second])).norm();
+}
+
+void MeshEmbedding::setStrainLimit(float tau, unsigned int n_iter) {
+	this->tau = tau;
+	this->n_iter = n_iter;
+}
+
+void MeshEmbedding::apply(const float* coarse, float* fine) const {
+	typedef Eigen::Map<const Vector3f> ConstMap;
+	for (unsigned int i = 0; i < weights.size(); i++) {
+		const Weight& e = weights[i];
+		Vector3f a = ConstMap(&coarse[3 * e.v[0]]);
+		Vector3f b = ConstMap(&coarse[3 * e.v[1]]);
+		Vector3f c = ConstMap(&coarse[3 * e.v[2]]);
+		Vector3f p = e.w[0] * a + e.w[1] * b + e.w[2] * c;
+		if (e.offset != 0.0f) {
+			Vector3f normal = (b - a).cross(c - a);
+			float len = normal.norm();
+			if (len > 0) p += e.offset / len * normal;
+		}
+		Eigen::Map<Vector3f> target(&fine[3 * i]);
+		target = p;
+	}
+	if (n_iter > 0) limitStrain(fine);
+}
+
+void MeshEmbedding::limitStrain(float* fine) const {
+	typedef Eigen::Map<Vector3f> Map;
+	for (unsigned int iter = 0; iter < n_iter; iter++) {
+		for (unsigned int k = 0; k < edges.size(); k++) {
+			Map p1(&fine[3 * edges[k].first]), p2(&fine[3 * edges[k].second]);
+			Vector3f p12 = p1 - p2;
+			float len = p12.norm();
+			float lo = (1 - tau) * rest_lengths[k], hi = (1 + tau) * rest_lengths[k];
+			if (len == 0.0f || (len >= lo && len <= hi)) continue;
+
+			// move both ends halfway to the allowed length
+			float target = len > hi ? hi : lo;
+			Vector3f correction = 0.5f * (len - target) / len * p12;
+			p1 -= correction;
+			p2 += correction;
+		}
+	}
+}
+
+unsigned int MeshEmbedding::nPoints() const { return (unsigned int)weights.size(); }
+const MeshEmbedding::IndexList& MeshEmbedding::indices() const { return ibuff; }
+
+MeshEmbedding::IndexList MeshEmbedding::dominantVertices() const {
+	IndexList result(weights.size());
+	for (unsigned int i = 0; i < weights.size(); i++) {
+		const Weight& e = weights[i];
+		int j = e.w[0] >= e.w[1] ? 0 : 1;
+		if (e.w[2] > e.w[j]) j = 2;
+		result[i] = e.v[j];
+	}
+	return result;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <Eigen/Dense>
+#include <vector>
+
+// Mesh Embedding class
+// Drives a fine render mesh from a coarse simulated mesh. Every fine vertex follows a point
+// of the closest coarse triangle in the rest poses, given by barycentric weights and an
+// offset along the triangle normal. An optional strain limiting pass keeps fine edges
+// within [1 - tau, 1 + tau] of their rest length.
+class MeshEmbedding {
+private:
+	typedef Eigen::Vector3f Vector3f;
+	typedef std::pair<unsigned int, unsigned int> Edge;
+	typedef std::vector<Edge> EdgeList;
+	typedef std::vector<unsigned int> IndexList;
+
+	struct Weight {
+		unsigned int v[3]; // coarse triangle
+		float w[3]; // barycentric weights
+		float offset; // distance along the triangle normal
+	};
+
+	std::vector<Weight> weights; // one per fine vertex
+	IndexList ibuff; // fine triangles
+
+	// strain limiting
+	EdgeList edges; // unique fine edges
+	std::vector<float> rest_lengths;
+	float tau; // allowed relative deformation
+	unsigned int n_iter; // 0 disables the pass
+
+	void limitStrain(float* fine) const;
+
+public:
+	MeshEmbedding(
+		const float* coarse,              // coarse rest positions
+		unsigned int n_coarse,            // number of coarse vertices
+		const unsigned int* coarseIBuff,  // coarse triangle indices
+		unsigned int coarseIBuffLen,      // number of coarse triangle indices
+		const float* fine,                // fine rest positions
+		unsigned int n_fine,              // number of fine vertices
+		const unsigned int* fineIBuff,    // fine triangle indices
+		unsigned int fineIBuffLen         // number of fine triangle indices
+	);
+
+	void setStrainLimit(float tau, unsigned int n_iter);
+
+	// fine positions from coarse positions
+	void apply(const float* coarse, float* fine) const;
+
+	unsigned int nPoints() const; // fine vertices
+	IndexList dominantVertices() const; // coarse vertex with the largest weight, per fine vertex
+	const IndexList& indices() const; // fine triangles
+};
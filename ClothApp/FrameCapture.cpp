@@ -0,0 +1,104 @@
+#include "FrameCapture.h"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+// F R A M E  C A P T U R E /////////////////////////////////////////////////////////////////////////
+FrameCapture::FrameCapture(unsigned int width, unsigned int height, FrameEncoder* encoder, unsigned int n_slots)
+	: width(width), height(height), next(0), encoder(encoder), captured(0), readback_ms(0.0) {
+	glGenRenderbuffers(1, &color);
+	glBindRenderbuffer(GL_RENDERBUFFER, color);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_SRGB8_ALPHA8, width, height);
+	glGenRenderbuffers(1, &depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+	glDrawBuffer(GL_COLOR_ATTACHMENT0);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		glDeleteFramebuffers(1, &framebuffer);
+		glDeleteRenderbuffers(1, &color);
+		glDeleteRenderbuffers(1, &depth);
+		throw std::runtime_error("Capture framebuffer is incomplete.");
+	}
+
+	// stream read, the driver keeps the buffers where the CPU maps them fastest
+	pixel_buffers.resize(std::max(n_slots, 1u));
+	fences.resize(pixel_buffers.size(), nullptr);
+	glGenBuffers((GLsizei)pixel_buffers.size(), pixel_buffers.data());
+	for (GLuint buffer : pixel_buffers) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, 4 * width * height, nullptr, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+FrameCapture::~FrameCapture() {
+	for (GLsync fence : fences) if (fence != nullptr) glDeleteSync(fence);
+	glDeleteBuffers((GLsizei)pixel_buffers.size(), pixel_buffers.data());
+	glDeleteFramebuffers(1, &framebuffer);
+	glDeleteRenderbuffers(1, &color);
+	glDeleteRenderbuffers(1, &depth);
+}
+
+void FrameCapture::bind() {
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, width, height);
+}
+
+void FrameCapture::unbind() {
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+void FrameCapture::capture() {
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point start = Clock::now();
+
+	// the ring is full, the oldest frame has to go first
+	if (fences[next] != nullptr) collect(next);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pixel_buffers[next]);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	fences[next] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	next = (next + 1) % pixel_buffers.size();
+
+	captured++;
+	readback_ms += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+void FrameCapture::collect(unsigned int slot) {
+	glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+	glDeleteSync(fences[slot]);
+	fences[slot] = nullptr;
+
+	// the encoder copies the frame into its queue, or counts it as dropped when the queue is full
+	// and it does not block
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pixel_buffers[slot]);
+	const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, 4 * width * height, GL_MAP_READ_BIT);
+	if (pixels != nullptr) {
+		encoder->push(static_cast<const unsigned char*>(pixels));
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void FrameCapture::finish() {
+	// oldest first, frames reach the encoder in capture order
+	for (unsigned int i = 0; i < pixel_buffers.size(); i++) {
+		unsigned int slot = (next + i) % pixel_buffers.size();
+		if (fences[slot] != nullptr) collect(slot);
+	}
+}
+
+unsigned long long FrameCapture::capturedFrames() const { return captured; }
+double FrameCapture::readbackMs() const { return captured > 0 ? readback_ms / captured : 0.0; }
@@ -0,0 +1,47 @@
+#pragma once
+#include <vector>
+
+#include "Shader.h"
+#include "FrameEncoder.h"
+
+// Offscreen frame capture class
+// Renders into its own framebuffer, sRGB color and depth renderbuffers, and reads frames back
+// through a ring of pixel buffer objects. glReadPixels into a pack buffer only queues the copy
+// and a fence marks when it is done. A slot is mapped and handed to the encoder when the ring
+// comes around to it, n_slots - 1 frames later, so the render thread does not wait for the
+// readback of the frame it just drew and the encoder thread works on older frames meanwhile.
+class FrameCapture : public NonCopyable {
+private:
+	unsigned int width, height;
+	GLuint framebuffer;
+	GLuint color, depth; // renderbuffers
+	GLint viewport[4]; // restored by unbind()
+
+	// readback ring
+	std::vector<GLuint> pixel_buffers;
+	std::vector<GLsync> fences; // null while the slot is free
+	unsigned int next; // slot of the next capture
+
+	FrameEncoder* encoder;
+	unsigned long long captured;
+	double readback_ms; // render thread time spent in capture()
+
+	void collect(unsigned int slot); // wait for the slot and hand its pixels to the encoder
+
+public:
+	FrameCapture(
+		unsigned int width,           // frame width in pixels
+		unsigned int height,          // frame height in pixels
+		FrameEncoder* encoder,        // receives every frame, not owned
+		unsigned int n_slots = 3      // frames in flight
+	); // needs a current context, throws if the framebuffer is incomplete
+	~FrameCapture();
+
+	void bind(); // render into the capture framebuffer
+	void unbind(); // back to the default framebuffer and viewport
+	void capture(); // read back the frame drawn since bind(), call before unbind()
+	void finish(); // hand frames still in flight to the encoder
+
+	unsigned long long capturedFrames() const;
+	double readbackMs() const; // mean per frame
+};
@@ -0,0 +1,207 @@
+#include "FrameEncoder.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#ifdef FMS_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+// P N G  H E L P E R S /////////////////////////////////////////////////////////////////////////////
+static std::vector<uint32_t> crcTable() {
+	std::vector<uint32_t> table(256);
+	for (uint32_t i = 0; i < 256; i++) {
+		uint32_t c = i;
+		for (int k = 0; k < 8; k++) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+		table[i] = c;
+	}
+	return table;
+}
+
+static uint32_t chunkCrc(const unsigned char* data, size_t n) {
+	static const std::vector<uint32_t> table = crcTable();
+	uint32_t crc = 0xffffffffu;
+	for (size_t i = 0; i < n; i++) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+static void putBigEndian(std::vector<unsigned char>& out, uint32_t v) {
+	out.push_back((unsigned char)(v >> 24));
+	out.push_back((unsigned char)(v >> 16));
+	out.push_back((unsigned char)(v >> 8));
+	out.push_back((unsigned char)v);
+}
+
+static void putChunk(std::vector<unsigned char>& out, const char* tag, const unsigned char* data, size_t n) {
+	putBigEndian(out, (uint32_t)n);
+	size_t start = out.size();
+	out.insert(out.end(), tag, tag + 4);
+	out.insert(out.end(), data, data + n);
+	putBigEndian(out, chunkCrc(&out[start], n + 4));
+}
+
+// zlib stream of the scanlines, false on failure
+static bool compressScanlines(const std::vector<unsigned char>& in, std::vector<unsigned char>& out) {
+#ifdef FMS_WITH_ZLIB
+	uLongf size = compressBound((uLong)in.size());
+	out.resize(size);
+	if (compress2(out.data(), &size, in.data(), (uLong)in.size(), Z_BEST_SPEED) != Z_OK) return false;
+	out.resize(size);
+#else
+	// stored blocks of at most 64 KB, no compression
+	const size_t BLOCK = 65535;
+	out.assign({ 0x78, 0x01 });
+	size_t p = 0;
+	do {
+		size_t n = std::min(BLOCK, in.size() - p);
+		out.push_back(p + n == in.size() ? 1 : 0); // last block
+		out.push_back((unsigned char)n);
+		out.push_back((unsigned char)(n >> 8));
+		out.push_back((unsigned char)~n);
+		out.push_back((unsigned char)(~n >> 8));
+		out.insert(out.end(), in.begin() + p, in.begin() + p + n);
+		p += n;
+	} while (p < in.size());
+
+	// Adler-32 of the uncompressed data
+	uint32_t a = 1, b = 0;
+	for (unsigned char c : in) {
+		a = (a + c) % 65521;
+		b = (b + a) % 65521;
+	}
+	putBigEndian(out, (b << 16) | a);
+#endif
+	return true;
+}
+
+// E N C O D E R ////////////////////////////////////////////////////////////////////////////////////
+FrameEncoder::FrameEncoder(
+	const std::string& path,
+	Format format,
+	unsigned int width,
+	unsigned int height,
+	unsigned int queue_size
+)
+	: path(path), format(format), width(width), height(height), running(true), blocking(false), encoded(0),
+	dropped(0), encode_ms(0.0) {
+	if (format == RAW) {
+		raw.open(path + "/frames.rgba", std::ios::binary);
+		if (!raw) throw std::runtime_error("Failed to open frame export file " + path + "/frames.rgba");
+	}
+
+	// frame buffers
+	if (queue_size > MAX_QUEUE) queue_size = MAX_QUEUE;
+	if (queue_size == 0) queue_size = 1;
+	buffers.resize(queue_size, Bytes(4 * width * height));
+	for (Bytes& b : buffers) spare.push(&b);
+
+	worker = std::thread(&FrameEncoder::run, this);
+}
+
+FrameEncoder::~FrameEncoder() { close(); }
+
+void FrameEncoder::setBlocking(bool blocking) { this->blocking = blocking; }
+
+bool FrameEncoder::push(const unsigned char* pixels) {
+	Bytes* b;
+	bool queued = running && spare.pop(b);
+	while (!queued && blocking && running) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		queued = spare.pop(b);
+	}
+	if (!queued) {
+		dropped++;
+		return false;
+	}
+	std::memcpy(b->data(), pixels, b->size());
+	pending.push(b);
+	return true;
+}
+
+void FrameEncoder::run() {
+	Bytes* b;
+	while (true) {
+		if (pending.pop(b)) write(b);
+		else if (!running) break;
+		else std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	// a frame pushed between the empty pop and close() is still queued
+	while (pending.pop(b)) write(b);
+}
+
+void FrameEncoder::write(Bytes* frame) {
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point start = Clock::now();
+	bool written = encode(*frame);
+	encode_ms += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	spare.push(frame);
+	if (written) encoded++;
+	else dropped++;
+}
+
+bool FrameEncoder::encode(const Bytes& frame) {
+	const size_t row = 4 * width;
+
+	// flip to top row first
+	if (format == RAW) {
+		for (unsigned int y = 0; y < height; y++)
+			raw.write((const char*)&frame[(height - 1 - y) * row], row);
+		return (bool)raw;
+	}
+
+	// filter type 0 (none) in front of every row
+	scanlines.resize(height * (row + 1));
+	for (unsigned int y = 0; y < height; y++) {
+		unsigned char* line = &scanlines[y * (row + 1)];
+		line[0] = 0;
+		std::memcpy(line + 1, &frame[(height - 1 - y) * row], row);
+	}
+
+	char name[32];
+	std::snprintf(name, sizeof(name), "/frame_%06llu.png", (unsigned long long)encoded);
+	return writePng(path + name);
+}
+
+bool FrameEncoder::writePng(const std::string& name) {
+	static const unsigned char SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+	// 8 bit RGBA, no interlacing
+	std::vector<unsigned char> ihdr;
+	putBigEndian(ihdr, width);
+	putBigEndian(ihdr, height);
+	const unsigned char format[5] = { 8, 6, 0, 0, 0 };
+	ihdr.insert(ihdr.end(), format, format + 5);
+
+	if (!compressScanlines(scanlines, deflated)) return false;
+	file.assign(SIGNATURE, SIGNATURE + 8);
+	putChunk(file, "IHDR", ihdr.data(), ihdr.size());
+	putChunk(file, "IDAT", deflated.data(), deflated.size());
+	putChunk(file, "IEND", nullptr, 0);
+
+	std::ofstream out(name, std::ios::binary);
+	out.write((const char*)file.data(), file.size());
+	if (!out) std::cerr << "Failed to write frame " << name << std::endl;
+	return (bool)out;
+}
+
+void FrameEncoder::close() {
+	if (!worker.joinable()) return;
+	running = false;
+	worker.join();
+	if (raw.is_open()) raw.close();
+}
+
+unsigned long long FrameEncoder::encodedFrames() const { return encoded; }
+unsigned long long FrameEncoder::droppedFrames() const { return dropped; }
+double FrameEncoder::encodeMs() const { return encoded > 0 ? encode_ms / encoded : 0.0; }
+
+FrameEncoder::Format FrameEncoder::parseFormat(const std::string& name) {
+	if (name == "png") return PNG;
+	if (name == "raw") return RAW;
+	throw std::runtime_error("Unknown frame export format " + name);
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "LockFree.h"
+
+// Frame encoder class, writes RGBA8 frames on a background thread
+// PNG writes one file per frame, <path>/frame_000000.png, deflated with zlib when the build has
+// it and stored uncompressed otherwise. RAW appends the frames to <path>/frames.rgba, top row
+// first, for e.g. ffmpeg -f rawvideo -pixel_format rgba -video_size <width>x<height>. Frames are
+// pushed bottom row first, as glReadPixels returns them, the worker flips them.
+class FrameEncoder {
+public:
+	enum Format { PNG, RAW };
+
+private:
+	typedef std::vector<unsigned char> Bytes;
+	static const unsigned int MAX_QUEUE = 64;
+
+	std::string path;
+	Format format;
+	unsigned int width, height;
+	std::ofstream raw; // RAW output stream
+
+	// bounded frame queue, buffers cycle between pending and spare
+	std::vector<Bytes> buffers;
+	SpscQueue<Bytes*, MAX_QUEUE> pending;
+	SpscQueue<Bytes*, MAX_QUEUE> spare;
+	std::atomic<bool> running;
+	bool blocking; // push() waits for a spare buffer instead of dropping
+	std::atomic<unsigned long long> encoded;
+	std::atomic<unsigned long long> dropped; // queue full or write failed
+	double encode_ms; // worker time spent encoding and writing
+	std::thread worker;
+
+	// encoder state
+	Bytes scanlines; // top row first, PNG rows start with their filter byte
+	Bytes deflated;
+	Bytes file;
+
+	void run(); // thread entry
+	void write(Bytes* frame); // encode a queued frame and return its buffer
+	bool encode(const Bytes& frame); // false if the frame could not be written
+	bool writePng(const std::string& name);
+
+public:
+	FrameEncoder(
+		const std::string& path,      // output directory, must exist
+		Format format,                // PNG or RAW
+		unsigned int width,           // frame width in pixels
+		unsigned int height,          // frame height in pixels
+		unsigned int queue_size = 8   // frames buffered before dropping, at most 64
+	);
+	~FrameEncoder();
+
+	void setBlocking(bool blocking); // wait for the worker when the queue is full, call before pushing
+	bool push(const unsigned char* pixels); // queue a frame, returns false if dropped
+	void close(); // flush queued frames
+
+	unsigned long long encodedFrames() const;
+	unsigned long long droppedFrames() const;
+	double encodeMs() const; // mean per frame, valid after close()
+
+	static Format parseFormat(const std::string& name); // png or raw, throws otherwise
+};
@@ -0,0 +1,175 @@
+#include "FrameServer.h"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static uint64_t slotSize(unsigned int n_points) {
+	uint64_t size = sizeof(FrameSlotHeader) + 2 * 3 * sizeof(float) * (uint64_t)n_points;
+	return (size + FrameRing::ALIGNMENT - 1) / FrameRing::ALIGNMENT * FrameRing::ALIGNMENT;
+}
+
+// S E R V E R //////////////////////////////////////////////////////////////////////////////////////
+FrameServer::FrameServer(const std::string& name, unsigned int n_points, unsigned int n_slots)
+	: name(name), data(nullptr), size(0), header(nullptr), frame(0) {
+	if (n_slots < 2) n_slots = 2;
+	const uint64_t slot_size = slotSize(n_points);
+	size = sizeof(FrameRingHeader) + n_slots * slot_size;
+
+#ifdef _WIN32
+	throw std::runtime_error("The frame server needs POSIX shared memory.");
+#else
+	// never take over an existing ring, it may belong to a live server
+	int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0 && errno == EEXIST)
+		throw std::runtime_error("Shared memory name in use: " + name + ", remove it if no server is running");
+	if (fd < 0) throw std::runtime_error("Failed to create shared memory " + name);
+	void* p = ftruncate(fd, (off_t)size) == 0
+		? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (p == MAP_FAILED) {
+		shm_unlink(name.c_str());
+		throw std::runtime_error("Failed to map shared memory " + name);
+	}
+	data = (unsigned char*)p;
+#endif
+
+	// the mapping starts zeroed, magic goes last so readers never see a partial header
+	header = new (data) FrameRingHeader;
+	header->version = FrameRing::VERSION;
+	header->n_points = n_points;
+	header->n_slots = n_slots;
+	header->slot_size = slot_size;
+	header->latest.store(0, std::memory_order_relaxed);
+	header->closed.store(0, std::memory_order_relaxed);
+	for (unsigned int s = 0; s < n_slots; s++) {
+		FrameSlotHeader* slot = new (data + sizeof(FrameRingHeader) + s * slot_size) FrameSlotHeader;
+		slot->sequence.store(0, std::memory_order_relaxed);
+	}
+	std::atomic_thread_fence(std::memory_order_release);
+	std::memcpy(header->magic, FrameRing::MAGIC, sizeof(header->magic));
+}
+
+FrameServer::~FrameServer() {
+#ifndef _WIN32
+	header->closed.store(1, std::memory_order_release);
+	munmap(data, size);
+	shm_unlink(name.c_str());
+#endif
+}
+
+void FrameServer::publish(const float* vbuff, const float* nbuff, double sim_time) {
+	frame++;
+	unsigned char* base = data + sizeof(FrameRingHeader) + (frame % header->n_slots) * header->slot_size;
+	FrameSlotHeader* slot = (FrameSlotHeader*)base;
+	const size_t bytes = 3 * sizeof(float) * header->n_points;
+
+	// odd sequence before any payload store, even again after the last one
+	uint64_t sequence = slot->sequence.load(std::memory_order_relaxed);
+	slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot->frame = frame;
+	slot->sim_time = sim_time;
+	slot->publish_ns = FrameReader::now();
+	std::memcpy(base + sizeof(FrameSlotHeader), vbuff, bytes);
+	std::memcpy(base + sizeof(FrameSlotHeader) + bytes, nbuff, bytes);
+	slot->sequence.store(sequence + 2, std::memory_order_release);
+	header->latest.store(frame, std::memory_order_release);
+}
+
+unsigned long long FrameServer::frames() const { return header->latest.load(std::memory_order_acquire); }
+
+// R E A D E R //////////////////////////////////////////////////////////////////////////////////////
+FrameReader::FrameReader(const std::string& name) : data(nullptr), size(0), header(nullptr) {
+#ifdef _WIN32
+	throw std::runtime_error("The frame reader needs POSIX shared memory.");
+#else
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if (fd < 0) throw std::runtime_error("Failed to open shared memory " + name);
+	struct stat st;
+	size = fstat(fd, &st) == 0 ? (uint64_t)st.st_size : 0;
+	void* p = size >= sizeof(FrameRingHeader) ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (p == MAP_FAILED) throw std::runtime_error("Failed to map shared memory " + name);
+	data = (const unsigned char*)p;
+#endif
+
+	header = (const FrameRingHeader*)data;
+	bool valid = std::memcmp(header->magic, FrameRing::MAGIC, sizeof(header->magic)) == 0;
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (!valid || header->version != FrameRing::VERSION
+		|| header->slot_size != slotSize(header->n_points)
+		|| size < sizeof(FrameRingHeader) + header->n_slots * header->slot_size) {
+#ifndef _WIN32
+		munmap((void*)data, size);
+#endif
+		throw std::runtime_error("Not a frame ring: " + name);
+	}
+}
+
+FrameReader::~FrameReader() {
+#ifndef _WIN32
+	munmap((void*)data, size);
+#endif
+}
+
+unsigned int FrameReader::nPoints() const { return header->n_points; }
+unsigned int FrameReader::nSlots() const { return header->n_slots; }
+unsigned long long FrameReader::latestFrame() const { return header->latest.load(std::memory_order_acquire); }
+bool FrameReader::closed() const { return header->closed.load(std::memory_order_acquire) != 0; }
+
+const FrameSlotHeader* FrameReader::slot(unsigned long long frame) const {
+	return (const FrameSlotHeader*)(data + sizeof(FrameRingHeader) + (frame % header->n_slots) * header->slot_size);
+}
+
+bool FrameReader::view(unsigned long long frame, View& view) const {
+	if (frame == 0) return false;
+	const FrameSlotHeader* s = slot(frame);
+	view.sequence = s->sequence.load(std::memory_order_acquire);
+	if (view.sequence & 1) return false; // being written
+	view.info.frame = s->frame;
+	view.info.sim_time = s->sim_time;
+	view.info.publish_ns = s->publish_ns;
+	view.vbuff = (const float*)((const unsigned char*)s + sizeof(FrameSlotHeader));
+	view.nbuff = view.vbuff + 3 * header->n_points;
+	return view.info.frame == frame && valid(view);
+}
+
+bool FrameReader::valid(const View& view) const {
+	// loads of the payload must not move past the second sequence load
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return slot(view.info.frame)->sequence.load(std::memory_order_relaxed) == view.sequence;
+}
+
+bool FrameReader::readFrame(unsigned long long frame, float* vbuff, float* nbuff, Info* info) const {
+	View v;
+	if (!view(frame, v)) return false;
+	const size_t bytes = 3 * sizeof(float) * header->n_points;
+	if (vbuff != nullptr) std::memcpy(vbuff, v.vbuff, bytes);
+	if (nbuff != nullptr) std::memcpy(nbuff, v.nbuff, bytes);
+	if (!valid(v)) return false;
+	if (info != nullptr) *info = v.info;
+	return true;
+}
+
+bool FrameReader::readLatest(float* vbuff, float* nbuff, Info* info) const {
+	// a failed read means the writer lapped the slot, a newer frame is complete by then
+	for (;;) {
+		unsigned long long frame = latestFrame();
+		if (frame == 0) return false;
+		if (readFrame(frame, vbuff, nbuff, info)) return true;
+	}
+}
+
+uint64_t FrameReader::now() {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Shared-memory frame ring layout
+//
+//   FrameRingHeader
+//   n_slots x (FrameSlotHeader | n_points x 3 x float positions | n_points x 3 x float normals)
+//
+// Frame k (counting from 1) goes to slot k % n_slots. Every slot is a seqlock, the writer makes
+// its sequence odd, copies the frame and makes it even again, readers retry or give up when the
+// sequence changed under them. Readers never write to the mapping, so any number of processes
+// can map it read-only. Slots are padded to cache lines so readers of one slot do not contend
+// with the writer of the next.
+namespace FrameRing {
+	const char MAGIC[8] = { 'F', 'M', 'S', 'R', 'I', 'N', 'G', '\0' };
+	const uint32_t VERSION = 1;
+	const uint64_t ALIGNMENT = 64;
+}
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "frame ring needs lock-free 64 bit atomics");
+
+struct FrameRingHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t n_points; // points per frame
+	uint32_t n_slots; // frames held
+	uint32_t reserved;
+	uint64_t slot_size; // bytes per slot including its header
+	std::atomic<uint64_t> latest; // newest complete frame, 0 before the first one
+	std::atomic<uint32_t> closed; // set when the server shuts down
+	char padding[20];
+};
+
+struct FrameSlotHeader {
+	std::atomic<uint64_t> sequence; // odd while the slot is written
+	uint64_t frame; // frame number held by the slot
+	double sim_time; // simulated time in seconds
+	uint64_t publish_ns; // steady clock time of publishing, for latency measurements
+	char padding[32];
+};
+
+static_assert(sizeof(FrameRingHeader) == 64 && sizeof(FrameSlotHeader) == 64, "frame ring headers must fill a cache line");
+
+// Frame server class, publishes frames into a named POSIX shared-memory ring
+class FrameServer {
+private:
+	std::string name; // shared memory object
+	unsigned char* data; // mapping
+	uint64_t size; // mapped size
+	FrameRingHeader* header;
+	uint64_t frame; // last published frame
+
+public:
+	FrameServer(
+		const std::string& name,  // shared memory object, e.g. "/fms-cloth"
+		unsigned int n_points,    // points per frame
+		unsigned int n_slots = 4  // frames held, readers have n_slots - 1 frames of slack
+	); // throws if the name is in use
+	~FrameServer(); // marks the ring closed and unlinks it, mapped readers keep their view
+
+	void publish(const float* vbuff, const float* nbuff, double sim_time); // never blocks
+	unsigned long long frames() const; // frames published so far, safe while the publisher runs
+};
+
+// Frame reader class, maps a ring read-only and copies or views frames without locking
+class FrameReader {
+private:
+	const unsigned char* data; // mapping
+	uint64_t size; // mapped size
+	const FrameRingHeader* header;
+
+	const FrameSlotHeader* slot(unsigned long long frame) const;
+
+public:
+	// frame metadata
+	struct Info {
+		unsigned long long frame;
+		double sim_time;
+		uint64_t publish_ns;
+	};
+
+	// zero-copy access to a slot, only meaningful while valid() holds
+	struct View {
+		const float* vbuff;
+		const float* nbuff;
+		Info info;
+		uint64_t sequence;
+	};
+
+	FrameReader(const std::string& name);
+	~FrameReader();
+
+	unsigned int nPoints() const;
+	unsigned int nSlots() const;
+	unsigned long long latestFrame() const; // 0 before the first frame
+	bool closed() const;
+
+	// copy a frame, false if it was overwritten or is not published yet, buffers may be null
+	bool readFrame(unsigned long long frame, float* vbuff, float* nbuff, Info* info = nullptr) const;
+	bool readLatest(float* vbuff, float* nbuff, Info* info = nullptr) const; // retries until consistent
+
+	// read in place, check valid() after consuming the data and discard it if that fails
+	bool view(unsigned long long frame, View& view) const;
+	bool valid(const View& view) const;
+
+	static uint64_t now(); // steady clock in nanoseconds, comparable to Info::publish_ns
+};
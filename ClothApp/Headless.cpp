@@ -0,0 +1,86 @@
+#include "Headless.h"
+#include <cstring>
+#include <stdexcept>
+
+#ifdef FMS_WITH_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static bool hasExtension(const char* extensions, const char* name) {
+	if (extensions == nullptr) return false;
+	const size_t n = std::strlen(name);
+	for (const char* p = std::strstr(extensions, name); p != nullptr; p = std::strstr(p + n, name))
+		if ((p == extensions || p[-1] == ' ') && (p[n] == ' ' || p[n] == '\0')) return true;
+	return false;
+}
+
+// H E A D L E S S  C O N T E X T ///////////////////////////////////////////////////////////////////
+HeadlessContext::HeadlessContext() : display(EGL_NO_DISPLAY), surface(EGL_NO_SURFACE), context(EGL_NO_CONTEXT) {
+	// surfaceless Mesa needs neither a window system nor a render node, other drivers get the default
+	const char* client = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	EGLDisplay d = EGL_NO_DISPLAY;
+	if (getPlatformDisplay != nullptr && hasExtension(client, "EGL_MESA_platform_surfaceless"))
+		d = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	if (d == EGL_NO_DISPLAY) d = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if (d == EGL_NO_DISPLAY || !eglInitialize(d, nullptr, nullptr))
+		throw std::runtime_error("Failed to initialize EGL.");
+	display = d;
+
+	const EGLint config_attributes[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint n_configs = 0;
+	if (!eglChooseConfig(d, config_attributes, &config, 1, &n_configs) || n_configs == 0 || !eglBindAPI(EGL_OPENGL_API)) {
+		eglTerminate(d);
+		throw std::runtime_error("EGL has no desktop OpenGL configuration.");
+	}
+
+	// compatibility profile, like the context GLUT creates for the window
+	const EGLint context_attributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+		EGL_NONE
+	};
+	context = eglCreateContext(d, config, EGL_NO_CONTEXT, context_attributes);
+	if (context == EGL_NO_CONTEXT) {
+		eglTerminate(d);
+		throw std::runtime_error("Failed to create an OpenGL 4.3 context.");
+	}
+
+	if (!hasExtension(eglQueryString(d, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context")) {
+		const EGLint pbuffer_attributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+		surface = eglCreatePbufferSurface(d, config, pbuffer_attributes);
+	}
+	if (!eglMakeCurrent(d, surface, surface, context)) {
+		eglDestroyContext(d, context);
+		eglTerminate(d);
+		throw std::runtime_error("Failed to make the headless context current.");
+	}
+}
+
+HeadlessContext::~HeadlessContext() {
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (surface != EGL_NO_SURFACE) eglDestroySurface(display, surface);
+	eglDestroyContext(display, context);
+	eglTerminate(display);
+}
+
+#else
+
+HeadlessContext::HeadlessContext() : display(nullptr), surface(nullptr), context(nullptr) {
+	throw std::runtime_error("Headless rendering needs EGL, run the window under xvfb-run instead.");
+}
+
+HeadlessContext::~HeadlessContext() {}
+
+#endif
+
+std::string HeadlessContext::renderer() const {
+	return std::string((const char*)glGetString(GL_RENDERER)) + " | " + (const char*)glGetString(GL_VERSION);
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <string>
+
+#include "Shader.h"
+
+// Headless GL context class
+// An OpenGL 4.3 compatibility context without a window, current on the creating thread. Uses
+// EGL, preferring Mesa's surfaceless platform, so it also runs on software GL (llvmpipe, e.g.
+// with LIBGL_ALWAYS_SOFTWARE=1) without an X server. There is no usable default framebuffer,
+// everything renders into framebuffer objects. Builds without EGL throw on construction.
+class HeadlessContext : public NonCopyable {
+private:
+	void* display; // EGLDisplay
+	void* surface; // EGLSurface, 1x1 pbuffer where surfaceless contexts are not supported
+	void* context; // EGLContext
+
+public:
+	HeadlessContext(); // throws if no context can be created
+	~HeadlessContext();
+
+	std::string renderer() const; // GL renderer and version
+};
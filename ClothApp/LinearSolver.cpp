@@ -0,0 +1,443 @@
+#include "LinearSolver.h"
+#include "Memory.h"
+#include <Eigen/SparseCholesky>
+#include <Eigen/OrderingMethods>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+// B A C K E N D ////////////////////////////////////////////////////////////////////////////////////
+void LinearSolver::compute(const SparseMatrix& A) {
+	analyzePattern(A);
+	factorize(A);
+}
+
+LinearSolver* LinearSolver::create(const std::string& name) {
+	typedef Eigen::SparseMatrix<float> SparseMatrix;
+	typedef Eigen::AMDOrdering<int> AMD;
+	typedef Eigen::COLAMDOrdering<int> COLAMD;
+	typedef Eigen::NaturalOrdering<int> Natural;
+
+	if (name == "llt-amd")
+		return new SimplicialSolver<Eigen::SimplicialLLT<SparseMatrix, Eigen::Lower, AMD> >(name);
+	if (name == "llt-colamd")
+		return new SimplicialSolver<Eigen::SimplicialLLT<SparseMatrix, Eigen::Lower, COLAMD> >(name);
+	if (name == "llt-natural")
+		return new SimplicialSolver<Eigen::SimplicialLLT<SparseMatrix, Eigen::Lower, Natural> >(name);
+	if (name == "ldlt-amd")
+		return new SimplicialSolver<Eigen::SimplicialLDLT<SparseMatrix, Eigen::Lower, AMD> >(name);
+	if (name == "ldlt-colamd")
+		return new SimplicialSolver<Eigen::SimplicialLDLT<SparseMatrix, Eigen::Lower, COLAMD> >(name);
+	if (name == "ldlt-natural")
+		return new SimplicialSolver<Eigen::SimplicialLDLT<SparseMatrix, Eigen::Lower, Natural> >(name);
+	if (name == "schur-nd")
+		return new SchurComplementSolver;
+#ifdef FMS_WITH_CHOLMOD
+	if (name == "cholmod-supernodal")
+		return new CholmodSupernodalSolver;
+#endif
+	throw std::runtime_error("Unknown linear solver " + name);
+}
+
+std::vector<std::string> LinearSolver::available() {
+	std::vector<std::string> names = {
+		"llt-amd", "llt-colamd", "llt-natural", "ldlt-amd", "ldlt-colamd", "ldlt-natural", "schur-nd"
+	};
+#ifdef FMS_WITH_CHOLMOD
+	names.push_back("cholmod-supernodal");
+#endif
+	return names;
+}
+
+// the factor member, matrixL() asserts a finished factorization
+template <typename Decomposition>
+struct FactorAccess : Decomposition {
+	static auto factor() { return &FactorAccess::m_matrix; }
+};
+
+// the pattern analysis allocates the factor and the factorization writes it first, the state
+// allocator gets to place it in between
+template <typename Decomposition>
+static void prepareFactor(const Decomposition& decomposition) {
+	typedef typename Decomposition::Scalar Scalar;
+	typedef typename Decomposition::StorageIndex StorageIndex;
+	const auto& L = decomposition.*FactorAccess<Decomposition>::factor();
+	Allocator::get().prepare(L.valuePtr(), L.nonZeros() * sizeof(Scalar));
+	Allocator::get().prepare(L.innerIndexPtr(), L.nonZeros() * sizeof(StorageIndex));
+}
+
+// S I M P L I C I A L //////////////////////////////////////////////////////////////////////////////
+template <typename Decomposition>
+void SimplicialSolver<Decomposition>::analyzePattern(const SparseMatrix& A) {
+	decomposition.analyzePattern(A);
+	prepareFactor(decomposition);
+}
+
+template <typename Decomposition>
+void SimplicialSolver<Decomposition>::factorize(const SparseMatrix& A) {
+	decomposition.factorize(A);
+	if (decomposition.info() != Eigen::Success)
+		throw std::runtime_error("Factorization failed: " + label);
+}
+
+template <typename Decomposition>
+void SimplicialSolver<Decomposition>::solve(const VectorRef& b, ResultRef x) const {
+	x = decomposition.solve(b); // evaluates straight into x
+}
+
+template <typename Decomposition>
+long SimplicialSolver<Decomposition>::factorNonZeros() const {
+	return (long)decomposition.matrixL().nestedExpression().nonZeros();
+}
+
+template <typename Decomposition>
+size_t SimplicialSolver<Decomposition>::memoryUsage() const {
+	typedef typename Decomposition::Scalar Scalar;
+	typedef typename Decomposition::StorageIndex StorageIndex;
+	// compressed factor, column pointers, elimination tree, column counts, permutations, D
+	const size_t n = decomposition.rows(), nnz = factorNonZeros();
+	return nnz * (sizeof(Scalar) + sizeof(StorageIndex)) + n * (5 * sizeof(StorageIndex) + sizeof(Scalar));
+}
+
+template <typename Decomposition>
+std::string SimplicialSolver<Decomposition>::name() const { return label; }
+
+// S C H U R  C O M P L E M E N T //////////////////////////////////////////////////////////////////
+SchurComplementSolver::SchurComplementSolver(unsigned int n_domains) : n_domains(n_domains) {}
+
+SchurComplementSolver::~SchurComplementSolver() { clear(); }
+
+void SchurComplementSolver::clear() {
+	for (Domain* d : domains) delete d;
+	domains.clear();
+	interface.clear();
+	block_offsets.clear();
+	schur.clear();
+}
+
+void SchurComplementSolver::partition(const SparseMatrix& A) {
+	const int n = (int)A.rows();
+	const size_t leaf_size = (n + n_domains - 1) / n_domains;
+
+	// part id per unknown, -1 once it lies on a separator
+	IndexList part(n, 0), level(n, -1), queue;
+	queue.reserve(n);
+	int next_id = 1;
+
+	// breadth first levels inside one part, returns the last node reached
+	auto bfs = [&](int start, int id) {
+		queue.clear();
+		queue.push_back(start);
+		level[start] = 0;
+		for (size_t k = 0; k < queue.size(); k++) {
+			int v = queue[k];
+			for (SparseMatrix::InnerIterator it(A, v); it; ++it) {
+				int u = (int)it.row();
+				if (part[u] != id || level[u] >= 0) continue;
+				level[u] = level[v] + 1;
+				queue.push_back(u);
+			}
+		}
+		return queue.back();
+	};
+	auto resetLevels = [&](const IndexList& nodes) { for (int v : nodes) level[v] = -1; };
+
+	IndexList all(n);
+	for (int i = 0; i < n; i++) all[i] = i;
+	std::vector<IndexList> stack(1, all), leaves;
+	while (!stack.empty()) {
+		IndexList nodes;
+		nodes.swap(stack.back());
+		stack.pop_back();
+		if (nodes.size() <= leaf_size) {
+			leaves.push_back(std::move(nodes));
+			continue;
+		}
+		int id = part[nodes[0]];
+
+		// pseudo-peripheral start, the far end of a sweep from any node
+		int start = bfs(nodes[0], id);
+		resetLevels(queue);
+		bfs(start, id);
+
+		// a part that falls apart needs no separator
+		IndexList left, right, separator;
+		if (queue.size() < nodes.size()) {
+			for (int v : nodes) (level[v] >= 0 ? left : right).push_back(v);
+		}
+		else {
+			// cut at the level that halves the part, the level itself separates both sides
+			int cut = level[queue[nodes.size() / 2]];
+			if (cut == 0 || cut == level[queue.back()]) {
+				resetLevels(nodes);
+				leaves.push_back(std::move(nodes));
+				continue;
+			}
+			for (int v : nodes) {
+				if (level[v] < cut) left.push_back(v);
+				else if (level[v] > cut) right.push_back(v);
+				else separator.push_back(v);
+			}
+		}
+		resetLevels(nodes);
+
+		for (int v : separator) part[v] = -1;
+		interface.insert(interface.end(), separator.begin(), separator.end());
+		for (int v : right) part[v] = next_id;
+		next_id++;
+		stack.push_back(std::move(left));
+		stack.push_back(std::move(right));
+	}
+
+	// interiors in order
+	domain_of.assign(n, -1);
+	local.assign(n, 0);
+	for (IndexList& nodes : leaves) {
+		Domain* d = new Domain;
+		std::sort(nodes.begin(), nodes.end());
+		d->interior = std::move(nodes);
+		for (size_t k = 0; k < d->interior.size(); k++) {
+			domain_of[d->interior[k]] = (int)domains.size();
+			local[d->interior[k]] = (int)k;
+		}
+		domains.push_back(d);
+	}
+
+	// connected blocks of S, every domain couples its whole adjacent interface
+	IndexList root(n);
+	for (int i = 0; i < n; i++) root[i] = i;
+	auto find = [&](int v) {
+		while (root[v] != v) v = root[v] = root[root[v]];
+		return v;
+	};
+	for (Domain* d : domains) {
+		int first = -1;
+		for (int j : d->interior)
+			for (SparseMatrix::InnerIterator it(A, j); it; ++it) {
+				if (domain_of[it.row()] >= 0) continue;
+				if (first < 0) first = find((int)it.row());
+				else root[find((int)it.row())] = first;
+			}
+	}
+	for (int j : interface)
+		for (SparseMatrix::InnerIterator it(A, j); it; ++it)
+			if (domain_of[it.row()] < 0) root[find((int)it.row())] = find(j);
+
+	// interface grouped by block, blocks in order of their smallest unknown
+	std::sort(interface.begin(), interface.end());
+	IndexList block(n, -1);
+	int n_blocks = 0;
+	for (int v : interface)
+		if (block[find(v)] < 0) block[find(v)] = n_blocks++;
+	std::stable_sort(interface.begin(), interface.end(),
+		[&](int u, int v) { return block[find(u)] < block[find(v)]; });
+	block_offsets.assign(1, 0);
+	for (size_t k = 0; k < interface.size(); k++) {
+		local[interface[k]] = (int)k;
+		if (k > 0 && block[find(interface[k])] != block[find(interface[k - 1])]) block_offsets.push_back((int)k);
+	}
+	block_offsets.push_back((int)interface.size());
+
+	// adjacent interface unknowns per domain
+	std::vector<char> seen(interface.size(), 0);
+	for (Domain* d : domains) {
+		for (int j : d->interior)
+			for (SparseMatrix::InnerIterator it(A, j); it; ++it)
+				if (domain_of[it.row()] < 0 && !seen[local[it.row()]]) {
+					seen[local[it.row()]] = 1;
+					d->interface.push_back(local[it.row()]);
+				}
+		std::sort(d->interface.begin(), d->interface.end());
+		for (int g : d->interface) seen[g] = 0;
+		d->block = d->interface.empty() ? 0 : (unsigned int)(std::upper_bound(block_offsets.begin(),
+			block_offsets.end(), d->interface[0]) - block_offsets.begin() - 1);
+	}
+}
+
+void SchurComplementSolver::extract(const SparseMatrix& A) {
+	typedef Eigen::Triplet<float> Triplet;
+
+	// interior and coupling blocks, every domain reads only its own columns
+	#pragma omp parallel for schedule(dynamic, 1)
+	for (int k = 0; k < (int)domains.size(); k++) {
+		Domain& d = *domains[k];
+		IndexList slot(interface.size(), -1);
+		for (size_t c = 0; c < d.interface.size(); c++) slot[d.interface[c]] = (int)c;
+		std::vector<Triplet> dd, dg;
+		for (size_t c = 0; c < d.interior.size(); c++) {
+			for (SparseMatrix::InnerIterator it(A, d.interior[c]); it; ++it) {
+				int i = (int)it.row();
+				if (domain_of[i] == k) dd.push_back(Triplet(local[i], (int)c, it.value()));
+				else dg.push_back(Triplet((int)c, slot[local[i]], it.value())); // symmetric A
+			}
+		}
+		d.A_dd.resize(d.interior.size(), d.interior.size());
+		d.A_dd.setFromTriplets(dd.begin(), dd.end());
+		d.A_dg.resize(d.interior.size(), d.interface.size());
+		d.A_dg.setFromTriplets(dg.begin(), dg.end());
+	}
+}
+
+void SchurComplementSolver::analyzePattern(const SparseMatrix& A) {
+	clear();
+	partition(A);
+	extract(A);
+	#pragma omp parallel for schedule(dynamic, 1)
+	for (int k = 0; k < (int)domains.size(); k++) {
+		domains[k]->llt.analyzePattern(domains[k]->A_dd);
+		prepareFactor(domains[k]->llt);
+	}
+	schur.resize(block_offsets.size() - 1);
+}
+
+void SchurComplementSolver::factorize(const SparseMatrix& A) {
+	const int CHUNK = 64; // interface columns solved at once
+
+	// factor interiors and their Schur contributions A_gd A_dd^-1 A_dg concurrently
+	extract(A);
+	std::vector<Eigen::MatrixXf> contributions(domains.size());
+	std::vector<std::exception_ptr> errors(domains.size());
+	#pragma omp parallel for schedule(dynamic, 1)
+	for (int k = 0; k < (int)domains.size(); k++) {
+		Domain& d = *domains[k];
+		try {
+			d.llt.factorize(d.A_dd);
+			if (d.llt.info() != Eigen::Success) throw std::runtime_error("Factorization failed: schur-nd");
+			SparseMatrix().swap(d.A_dd);
+
+			const int m = (int)d.interface.size();
+			contributions[k].resize(m, m);
+			for (int c0 = 0; c0 < m; c0 += CHUNK) {
+				int cols = std::min(CHUNK, m - c0);
+				Eigen::MatrixXf X = d.llt.solve(Eigen::MatrixXf(d.A_dg.middleCols(c0, cols)));
+				contributions[k].middleCols(c0, cols) = d.A_dg.transpose() * X;
+			}
+		}
+		catch (...) {
+			errors[k] = std::current_exception();
+		}
+	}
+	for (std::exception_ptr& e : errors)
+		if (e) std::rethrow_exception(e);
+
+	// S = A_gg - sum of the contributions per block, domains added in a fixed order
+	errors.assign(schur.size(), nullptr);
+	#pragma omp parallel for schedule(dynamic, 1)
+	for (int b = 0; b < (int)schur.size(); b++) {
+		const int first = block_offsets[b], m = block_offsets[b + 1] - first;
+		Eigen::MatrixXf S = Eigen::MatrixXf::Zero(m, m);
+		for (int c = 0; c < m; c++)
+			for (SparseMatrix::InnerIterator it(A, interface[first + c]); it; ++it)
+				if (domain_of[it.row()] < 0) S(local[it.row()] - first, c) = it.value();
+		for (size_t k = 0; k < domains.size(); k++) {
+			const Domain& d = *domains[k];
+			if (d.block != (unsigned int)b) continue;
+			for (size_t c = 0; c < d.interface.size(); c++)
+				for (size_t r = 0; r < d.interface.size(); r++)
+					S(d.interface[r] - first, d.interface[c] - first) -= contributions[k](r, c);
+		}
+		schur[b].compute(S);
+		if (schur[b].info() != Eigen::Success)
+			errors[b] = std::make_exception_ptr(std::runtime_error("Factorization failed: schur-nd interface"));
+	}
+	for (std::exception_ptr& e : errors)
+		if (e) std::rethrow_exception(e);
+}
+
+void SchurComplementSolver::solve(const VectorRef& b, ResultRef x) const {
+	std::vector<VectorXf> y(domains.size());
+
+	// interior solves with the interface at zero
+	#pragma omp parallel for schedule(dynamic, 1)
+	for (int k = 0; k < (int)domains.size(); k++) {
+		const Domain& d = *domains[k];
+		VectorXf bd(d.interior.size());
+		for (size_t c = 0; c < d.interior.size(); c++) bd[c] = b[d.interior[c]];
+		y[k] = d.llt.solve(bd);
+	}
+
+	// interface, S x_g = b_g - sum A_gd y_d, fixed domain order
+	VectorXf xg(interface.size());
+	for (size_t c = 0; c < interface.size(); c++) xg[c] = b[interface[c]];
+	for (size_t k = 0; k < domains.size(); k++) {
+		const Domain& d = *domains[k];
+		VectorXf r = d.A_dg.transpose() * y[k];
+		for (size_t c = 0; c < d.interface.size(); c++) xg[d.interface[c]] -= r[c];
+	}
+	#pragma omp parallel for schedule(dynamic, 1)
+	for (int s = 0; s < (int)schur.size(); s++) {
+		const int first = block_offsets[s], m = block_offsets[s + 1] - first;
+		xg.segment(first, m) = schur[s].solve(xg.segment(first, m));
+	}
+	for (size_t c = 0; c < interface.size(); c++) x[interface[c]] = xg[c];
+
+	// interiors again with the interface values moved to the right hand side
+	#pragma omp parallel for schedule(dynamic, 1)
+	for (int k = 0; k < (int)domains.size(); k++) {
+		const Domain& d = *domains[k];
+		VectorXf xd = y[k];
+		if (!d.interface.empty()) {
+			VectorXf xi(d.interface.size());
+			for (size_t c = 0; c < d.interface.size(); c++) xi[c] = xg[d.interface[c]];
+			xd -= d.llt.solve(d.A_dg * xi);
+		}
+		for (size_t c = 0; c < d.interior.size(); c++) x[d.interior[c]] = xd[c];
+	}
+}
+
+long SchurComplementSolver::factorNonZeros() const {
+	long nnz = 0;
+	for (size_t b = 0; b + 1 < block_offsets.size(); b++) {
+		long m = block_offsets[b + 1] - block_offsets[b];
+		nnz += m * (m + 1) / 2;
+	}
+	for (const Domain* d : domains) nnz += (long)d->llt.matrixL().nestedExpression().nonZeros();
+	return nnz;
+}
+
+size_t SchurComplementSolver::memoryUsage() const {
+	// interior factors as in SimplicialSolver, dense interface blocks, coupling blocks, index maps
+	const size_t entry = sizeof(float) + sizeof(int);
+	size_t bytes = (domain_of.size() + local.size() + interface.size() + block_offsets.size()) * sizeof(int);
+	for (size_t b = 0; b + 1 < block_offsets.size(); b++) {
+		size_t m = block_offsets[b + 1] - block_offsets[b];
+		bytes += m * m * sizeof(float);
+	}
+	for (const Domain* d : domains) {
+		bytes += d->llt.matrixL().nestedExpression().nonZeros() * entry;
+		bytes += d->interior.size() * (6 * sizeof(int) + sizeof(float)) + d->interface.size() * sizeof(int);
+		bytes += d->A_dg.nonZeros() * entry + d->A_dg.cols() * sizeof(int);
+	}
+	return bytes;
+}
+
+std::string SchurComplementSolver::name() const { return "schur-nd"; }
+
+// C H O L M O D ////////////////////////////////////////////////////////////////////////////////////
+#ifdef FMS_WITH_CHOLMOD
+void CholmodSupernodalSolver::analyzePattern(const SparseMatrix& A) {
+	decomposition.analyzePattern(A.cast<double>());
+}
+
+void CholmodSupernodalSolver::factorize(const SparseMatrix& A) {
+	decomposition.factorize(A.cast<double>());
+	if (decomposition.info() != Eigen::Success)
+		throw std::runtime_error("Factorization failed: cholmod-supernodal");
+}
+
+void CholmodSupernodalSolver::solve(const VectorRef& b, ResultRef x) const {
+	x = decomposition.solve(b.cast<double>()).cast<float>();
+}
+
+long CholmodSupernodalSolver::factorNonZeros() const {
+	// set by cholmod_analyze
+	return (long)const_cast<Eigen::CholmodSupernodalLLT<SparseMatrixd>&>(decomposition).cholmod().lnz;
+}
+
+size_t CholmodSupernodalSolver::memoryUsage() const {
+	// everything CHOLMOD has allocated, the factor dominates
+	return const_cast<Eigen::CholmodSupernodalLLT<SparseMatrixd>&>(decomposition).cholmod().memory_inuse;
+}
+
+std::string CholmodSupernodalSolver::name() const { return "cholmod-supernodal"; }
+#endif
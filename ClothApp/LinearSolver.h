@@ -0,0 +1,114 @@
+#pragma once
+#include <Eigen/Sparse>
+#include <Eigen/Dense>
+#include <string>
+#include <vector>
+
+// Sparse linear solver backend for the global step
+// Factors the symmetric positive definite system matrix once and solves it every
+// iteration. Pattern analysis (ordering, symbolic factorization) and the numeric
+// factorization are separate so a backend can refactor values on a fixed pattern.
+class LinearSolver {
+public:
+	typedef Eigen::SparseMatrix<float> SparseMatrix;
+	typedef Eigen::VectorXf VectorXf;
+	typedef Eigen::Ref<const VectorXf> VectorRef; // right hand sides from any contiguous storage
+	typedef Eigen::Ref<VectorXf> ResultRef; // solutions into any contiguous storage
+
+	virtual ~LinearSolver() {}
+
+	virtual void analyzePattern(const SparseMatrix& A) = 0; // ordering and symbolic factorization
+	virtual void factorize(const SparseMatrix& A) = 0; // numeric factorization
+	void compute(const SparseMatrix& A); // both
+
+	virtual void solve(const VectorRef& b, ResultRef x) const = 0; // x = A^-1 b, x must not overlap b
+
+	virtual long factorNonZeros() const = 0; // nnz(L)
+	virtual size_t memoryUsage() const = 0; // bytes held by the factor
+	virtual std::string name() const = 0;
+
+	// backend factory, throws for unknown or unavailable backends
+	static LinearSolver* create(const std::string& name);
+	static std::vector<std::string> available();
+};
+
+// Eigen simplicial Cholesky backends (LLT/LDLT with AMD, COLAMD or natural ordering)
+template <typename Decomposition>
+class SimplicialSolver : public LinearSolver {
+private:
+	Decomposition decomposition;
+	std::string label;
+
+public:
+	SimplicialSolver(const std::string& label) : label(label) {}
+
+	virtual void analyzePattern(const SparseMatrix& A);
+	virtual void factorize(const SparseMatrix& A);
+	virtual void solve(const VectorRef& b, ResultRef x) const;
+	virtual long factorNonZeros() const;
+	virtual size_t memoryUsage() const;
+	virtual std::string name() const;
+};
+
+// Domain decomposition backend. Nested dissection splits the unknowns into subdomain interiors
+// that are not coupled to each other and an interface made of the separators. Interiors are
+// factored and solved concurrently, the interface goes through its Schur complement
+// S = A_gg - sum_d A_gd A_dd^-1 A_dg. S is nearly dense, every connected block of it is
+// factored dense, so the domain count should keep the interface in the low thousands.
+class SchurComplementSolver : public LinearSolver {
+private:
+	typedef Eigen::SimplicialLLT<SparseMatrix, Eigen::Lower, Eigen::AMDOrdering<int> > Decomposition;
+	typedef std::vector<int> IndexList;
+
+	struct Domain {
+		IndexList interior; // unknowns
+		IndexList interface; // adjacent interface unknowns, in interface numbering
+		unsigned int block; // Schur block holding the adjacent interface
+		SparseMatrix A_dd; // interior block, released after factoring
+		SparseMatrix A_dg; // coupling to the adjacent interface unknowns
+		Decomposition llt;
+	};
+
+	unsigned int n_domains; // target number of subdomains
+	std::vector<Domain*> domains;
+	IndexList interface; // separator unknowns, grouped by Schur block
+	IndexList block_offsets; // first interface unknown of each connected block of S
+	IndexList domain_of; // per unknown, -1 on the interface
+	IndexList local; // per unknown, index in its domain interior or in the interface
+	std::vector<Eigen::LLT<Eigen::MatrixXf> > schur; // factored blocks of S
+
+	void partition(const SparseMatrix& A);
+	void extract(const SparseMatrix& A);
+	void clear();
+
+public:
+	SchurComplementSolver(unsigned int n_domains = 16);
+	~SchurComplementSolver();
+
+	virtual void analyzePattern(const SparseMatrix& A);
+	virtual void factorize(const SparseMatrix& A);
+	virtual void solve(const VectorRef& b, ResultRef x) const;
+	virtual long factorNonZeros() const;
+	virtual size_t memoryUsage() const;
+	virtual std::string name() const;
+};
+
+#ifdef FMS_WITH_CHOLMOD
+#include <Eigen/CholmodSupport>
+
+// CHOLMOD supernodal Cholesky, factors dense supernode blocks with BLAS-3 kernels.
+// CHOLMOD works in double precision, values are converted on the way in and out.
+class CholmodSupernodalSolver : public LinearSolver {
+private:
+	typedef Eigen::SparseMatrix<double> SparseMatrixd;
+	Eigen::CholmodSupernodalLLT<SparseMatrixd> decomposition;
+
+public:
+	virtual void analyzePattern(const SparseMatrix& A);
+	virtual void factorize(const SparseMatrix& A);
+	virtual void solve(const VectorRef& b, ResultRef x) const;
+	virtual long factorNonZeros() const;
+	virtual size_t memoryUsage() const;
+	virtual std::string name() const;
+};
+#endif
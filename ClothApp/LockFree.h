@@ -0,0 +1,62 @@
+#pragma once
+#include <atomic>
+
+// Lock-free triple buffer (single writer, single reader)
+template <typename T>
+class TripleBuffer {
+private:
+	static const unsigned int DIRTY = 4; // set when the middle slot holds an unread value
+
+	T slots[3];
+	std::atomic<unsigned int> middle; // index of the shared slot | dirty bit
+	unsigned int back; // slot owned by the writer
+	unsigned int front; // slot owned by the reader
+
+public:
+	TripleBuffer() : middle(1), back(0), front(2) {}
+
+	// writer side
+	T& backBuffer() { return slots[back]; }
+	void publish() { back = middle.exchange(back | DIRTY, std::memory_order_acq_rel) & 3; }
+
+	// reader side
+	bool update() { // swap in the newest published slot, returns false if nothing new
+		if (!(middle.load(std::memory_order_relaxed) & DIRTY)) return false;
+		front = middle.exchange(front, std::memory_order_acq_rel) & 3;
+		return true;
+	}
+	const T& frontBuffer() const { return slots[front]; }
+
+	// initialize all slots, must not be called while either side is active
+	void fill(const T& value) { for (T& slot : slots) slot = value; }
+};
+
+// Lock-free bounded queue (single producer, single consumer)
+template <typename T, unsigned int N>
+class SpscQueue {
+private:
+	static_assert((N & (N - 1)) == 0, "capacity must be a power of two");
+
+	T items[N];
+	std::atomic<unsigned int> head; // next item to pop, written by the consumer
+	std::atomic<unsigned int> tail; // next free slot, written by the producer
+
+public:
+	SpscQueue() : head(0), tail(0) {}
+
+	bool push(const T& item) {
+		unsigned int t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == N) return false; // full
+		items[t & (N - 1)] = item;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T& item) {
+		unsigned int h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) return false; // empty
+		item = items[h & (N - 1)];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+};
@@ -1,5 +1,25 @@
 #include "MassSpringSolver.h"
+#include "Bvh.h"
+#include "Parallel.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+// binary stream helpers
+template <typename T>
+static void writeRaw(std::ostream& out, const T* data, size_t n) {
+	out.write((const char*)data, n * sizeof(T));
+}
+
+template <typename T>
+static void readRaw(std::istream& in, T* data, size_t n) {
+	in.read((char*)data, n * sizeof(T));
+	if (!in) throw std::runtime_error("Unexpected end of checkpoint.");
+}
 
 // S Y S T E M //////////////////////////////////////////////////////////////////////////////////////
 mass_spring_system::mass_spring_system(
@@ -7,115 +27,252 @@ mass_spring_system::mass_spring_system(
 	unsigned int n_springs,
 	float time_step,
 	EdgeList spring_list,
-	VectorXf rest_lengths,
-	VectorXf stiffnesses,
-	VectorXf masses,
-	VectorXf fext,
+	StateVector rest_lengths,
+	StateVector stiffnesses,
+	StateVector masses,
+	StateVector fext,
 	float damping_factor
 )
 	: n_points(n_points), n_springs(n_springs),
-	time_step(time_step), spring_list(spring_list),
-	rest_lengths(rest_lengths), stiffnesses(stiffnesses), masses(masses),
-	fext(fext), damping_factor(damping_factor) {}
+	time_step(time_step), spring_list(std::move(spring_list)),
+	rest_lengths(std::move(rest_lengths)), stiffnesses(std::move(stiffnesses)),
+	masses(std::move(masses)), fext(std::move(fext)), damping_factor(damping_factor) {}
+
+size_t mass_spring_system::memoryUsage() const {
+	size_t vectors = rest_lengths.size() + stiffnesses.size() + masses.size() + fext.size();
+	return sizeof(*this) + spring_list.capacity() * sizeof(Edge) + vectors * sizeof(float);
+}
 
 // S O L V E R //////////////////////////////////////////////////////////////////////////////////////
-MassSpringSolver::MassSpringSolver(mass_spring_system* system, float* vbuff) 
-	: system(system), current_state(vbuff, system->n_points * 3), 
-	prev_state(current_state), spring_directions(system->n_springs * 3) {
-	
-	float h2 = system->time_step * system->time_step; // shorthand
+MassSpringSolver::MassSpringSolver(mass_spring_system* system, float* vbuff,
+	LinearSolver* linear_solver)
+	: system(system), system_matrix(linear_solver), current_state(vbuff, system->n_points * 3),
+	prev_state(current_state), spring_directions(system->n_springs * 3),
+	inertial_term(system->n_points * 3), rhs(system->n_points * 3), telemetry(false), tolerance(0.0f),
+	spring_potential(0.0f), stats(), strain_limit(0.0f) {
+	if (system_matrix == nullptr) system_matrix = LinearSolver::create("llt-amd");
+
+	// incident springs per point, counting sort by point
+	incident_offsets.assign(system->n_points + 1, 0);
+	for (const Edge& e : system->spring_list) {
+		incident_offsets[e.first + 1]++;
+		incident_offsets[e.second + 1]++;
+	}
+	for (unsigned int i = 0; i < system->n_points; i++) incident_offsets[i + 1] += incident_offsets[i];
+	incident_springs.resize(2 * system->n_springs);
+	IndexList fill(incident_offsets.begin(), incident_offsets.end() - 1);
+	for (unsigned int k = 0; k < system->n_springs; k++) {
+		incident_springs[fill[system->spring_list[k].first]++] = k;
+		incident_springs[fill[system->spring_list[k].second]++] = k;
+	}
 
-	// compute M, L, J
-	TripletList LTriplets, JTriplets;
-	// L
-	L.resize(3 * system->n_points, 3 * system->n_points);
-	unsigned int k = 0; // spring counter
-	for (Edge& i : system->spring_list) {
-		for (int j = 0; j < 3; j++) {
-			LTriplets.push_back(
-				Triplet(3 * i.first + j, 3 * i.first  + j,  1 * system->stiffnesses[k]));
-			LTriplets.push_back(
-				Triplet(3 * i.first + j, 3 * i.second + j, -1 * system->stiffnesses[k]));
-			LTriplets.push_back(
-				Triplet(3 * i.second + j, 3 * i.first + j, -1 * system->stiffnesses[k]));
-			LTriplets.push_back(
-				Triplet(3 * i.second + j, 3 * i.second + j, 1 * system->stiffnesses[k]));
+	// pre-factor system matrix
+	system_matrix->compute(assemble());
+}
+
+MassSpringSolver::~MassSpringSolver() { delete system_matrix; }
+
+MassSpringSolver::SparseMatrix MassSpringSolver::assemble() const {
+	float h2 = system->time_step * system->time_step; // shorthand
+	const int n_points = (int)system->n_points;
+
+	// A = M + h^2 * L straight into compressed columns, M is diagonal and L is the spring
+	// Laplacian. Column 3 i + j holds one entry per distinct neighbor of point i and the
+	// diagonal, rows sorted, the three columns of a point share their pattern.
+	auto neighbors = [&](int i, std::vector<Edge>& list) {
+		list.clear();
+		for (unsigned int s = incident_offsets[i]; s < incident_offsets[i + 1]; s++) {
+			unsigned int k = incident_springs[s];
+			const Edge& e = system->spring_list[k];
+			list.push_back(Edge(e.first == (unsigned int)i ? e.second : e.first, k));
 		}
-		k++;
-	}
-	L.setFromTriplets(LTriplets.begin(), LTriplets.end());
-
-	// J
-	J.resize(3 * system->n_points, 3 * system->n_springs);
-	k = 0; // spring counter
-	for (Edge& i : system->spring_list) {
-		for (unsigned int j = 0; j < 3; j++) {
-			JTriplets.push_back(
-				Triplet(3 * i.first  + j, 3 * k + j,  1 * system->stiffnesses[k]));
-			JTriplets.push_back(
-				Triplet(3 * i.second + j, 3 * k + j, -1 * system->stiffnesses[k]));
+		std::sort(list.begin(), list.end()); // by neighbor, then spring
+	};
+
+	// distinct neighbors per point, then column offsets
+	IndexList sizes(n_points);
+	#pragma omp parallel
+	{
+		std::vector<Edge> list;
+		#pragma omp for schedule(static)
+		for (int i = 0; i < n_points; i++) {
+			neighbors(i, list);
+			unsigned int distinct = 1; // diagonal
+			for (size_t c = 0; c < list.size(); c++)
+				if (c == 0 || list[c].first != list[c - 1].first) distinct++;
+			sizes[i] = distinct;
 		}
-		k++;
 	}
-	J.setFromTriplets(JTriplets.begin(), JTriplets.end());
+	SparseMatrix A(3 * n_points, 3 * n_points);
+	int* outer = A.outerIndexPtr();
+	for (int i = 0; i < n_points; i++)
+		for (int j = 0; j < 3; j++) outer[3 * i + j + 1] = outer[3 * i + j] + sizes[i];
+	A.resizeNonZeros(outer[3 * n_points]);
+	int* inner = A.innerIndexPtr();
+	float* values = A.valuePtr();
+
+	// fill, the diagonal and repeated springs add up in spring order as with triplets
+	#pragma omp parallel
+	{
+		std::vector<Edge> list;
+		#pragma omp for schedule(static)
+		for (int i = 0; i < n_points; i++) {
+			neighbors(i, list);
+			float diagonal = system->masses[i];
+			for (unsigned int s = incident_offsets[i]; s < incident_offsets[i + 1]; s++)
+				diagonal += h2 * stiffness(incident_springs[s]);
 
-	// M
-	TripletList MTriplets;
-	M.resize(3 * system->n_points, 3 * system->n_points);
-	for (unsigned int i = 0; i < system->n_points; i++) {
-		for (int j = 0; j < 3; j++) {
-			MTriplets.push_back(Triplet(3 * i + j, 3 * i + j, system->masses[i]));
+			for (int j = 0; j < 3; j++) {
+				int p = outer[3 * i + j];
+				bool placed = false;
+				for (size_t c = 0; c < list.size(); c++) {
+					unsigned int other = list[c].first;
+					float hk = h2 * stiffness(list[c].second);
+					if (c > 0 && other == list[c - 1].first) {
+						values[p - 1] -= hk;
+						continue;
+					}
+					if (!placed && other > (unsigned int)i) {
+						inner[p] = 3 * i + j;
+						values[p++] = diagonal;
+						placed = true;
+					}
+					inner[p] = 3 * other + j;
+					values[p++] = -hk;
+				}
+				if (!placed) {
+					inner[p] = 3 * i + j;
+					values[p] = diagonal;
+				}
+			}
 		}
 	}
-	M.setFromTriplets(MTriplets.begin(), MTriplets.end());
-	
-	// pre-factor system matrix
-	SparseMatrix A = M + h2 * L;
-	system_matrix.compute(A);
+	return A;
+}
+
+float MassSpringSolver::stiffness(unsigned int k) const {
+	return limit_ratios.size() > 0 ? system->stiffnesses[k] * (1.0f + limit_ratios[k]) : system->stiffnesses[k];
 }
 
-void MassSpringSolver::globalStep() {
+bool MassSpringSolver::globalStep() {
+	PROFILE_SCOPE("globalStep");
 	float h2 = system->time_step * system->time_step; // shorthand
 
-	// compute right hand side
-	VectorXf b = inertial_term
-		+ h2 * J * spring_directions
-		+ h2 * system->fext;
+	// compute right hand side, b = M * y + h^2 * (J * d + fext), J * d gathered per point
+	StateVector& b = rhs;
+	#pragma omp parallel for schedule(static)
+	for (int i = 0; i < (int)system->n_points; i++) {
+		Vector3f bi = inertial_term.segment<3>(3 * i) + h2 * system->fext.segment<3>(3 * i);
+		for (unsigned int s = incident_offsets[i]; s < incident_offsets[i + 1]; s++) {
+			unsigned int k = incident_springs[s];
+			Vector3f jd = h2 * stiffness(k) * spring_directions.segment<3>(3 * k);
+			if (system->spring_list[k].first == (unsigned int)i) bi += jd;
+			else bi -= jd;
+		}
+		b.segment<3>(3 * i) = bi;
+	}
+	if (telemetry && !evaluate(b)) return false;
 
 	// solve system and update state
-	current_state = system_matrix.solve(b);
+	system_matrix->solve(b, current_state);
+	return true;
+}
+
+bool MassSpringSolver::evaluate(const StateVector& b) {
+	float h2 = system->time_step * system->time_step; // shorthand
+
+	// gradient M * q + h^2 * L * q - b per point, L * q gathered over the incident springs
+	#pragma omp parallel for schedule(static)
+	for (int i = 0; i < (int)system->n_points; i++) {
+		Vector3f q = current_state.segment<3>(3 * i);
+		Vector3f lq = Vector3f::Zero();
+		for (unsigned int s = incident_offsets[i]; s < incident_offsets[i + 1]; s++) {
+			unsigned int k = incident_springs[s];
+			const Edge& e = system->spring_list[k];
+			unsigned int other = e.first == (unsigned int)i ? e.second : e.first;
+			lq += stiffness(k) * (q - current_state.segment<3>(3 * other));
+		}
+		gradient.segment<3>(3 * i) = h2 * lq + system->masses[i] * q - b.segment<3>(3 * i);
+	}
+
+	// inertial and external energy and both norms, reduced in fixed blocks if deterministic
+	double inertia = Parallel::sum((int)system->n_points, 0.0, [&](int i) {
+		float m = system->masses[i];
+		Vector3f mqy = m * current_state.segment<3>(3 * i) - inertial_term.segment<3>(3 * i); // M * (q - y)
+		return 0.5 * mqy.squaredNorm() / m;
+	});
+	double external = Parallel::sum((int)system->n_points, 0.0, [&](int i) {
+		return (double)current_state.segment<3>(3 * i).dot(system->fext.segment<3>(3 * i));
+	});
+	float norm = std::sqrt(Parallel::sum((int)b.size(), 0.0f, [&](int i) { return b[i] * b[i]; }));
+	float gradient_norm = std::sqrt(Parallel::sum((int)gradient.size(), 0.0f, [&](int i) { return gradient[i] * gradient[i]; }));
+
+	stats.objective = (float)(inertia + h2 * (spring_potential - external));
+	stats.residual = norm > 0.0f ? gradient_norm / norm : gradient_norm;
+	if (callback) callback(stats.iterations, stats.objective, stats.residual);
+
+	stats.converged = stats.residual <= tolerance;
+	return !stats.converged;
 }
 
 void MassSpringSolver::localStep() {
-	unsigned int j = 0;
-	for (Edge& i : system->spring_list) {
+	PROFILE_SCOPE("localStep");
+	const bool limited = limit_ratios.size() > 0;
+
+	// springs are independent, only the potential is reduced
+	spring_potential = Parallel::sum((int)system->n_springs, 0.0f, [&](int j) {
+		const Edge& i = system->spring_list[j];
+		float potential = 0.0f;
 		Vector3f p12(
 			current_state[3 * i.first + 0] - current_state[3 * i.second + 0],
 			current_state[3 * i.first + 1] - current_state[3 * i.second + 1],
 			current_state[3 * i.first + 2] - current_state[3 * i.second + 2]
 		);
 
-		p12.normalize();
-		spring_directions[3 * j + 0] = 	system->rest_lengths[j] * p12[0];
-		spring_directions[3 * j + 1] =	system->rest_lengths[j] * p12[1];
-		spring_directions[3 * j + 2] =	system->rest_lengths[j] * p12[2];
-		j++;
-	}
+		float length = p12.norm();
+		float rest = system->rest_lengths[j];
+		float stiffness = system->stiffnesses[j];
+		float stretch = length - rest;
+		potential += 0.5f * stiffness * stretch * stretch;
+
+		// both springs of a limited spring act as one of the summed stiffness, its target
+		// length is the stiffness weighted mean of the rest length and the clamped length
+		float target = rest;
+		if (limited && limit_ratios[j] > 0.0f) {
+			float w = limit_ratios[j] * stiffness;
+			float clamped = std::min(std::max(length, (1.0f - strain_limit) * rest), (1.0f + strain_limit) * rest);
+			potential += 0.5f * w * (length - clamped) * (length - clamped);
+			target = (stiffness * rest + w * clamped) / (stiffness + w);
+		}
+
+		if (length > 0.0f) p12 /= length;
+		spring_directions[3 * j + 0] = target * p12[0];
+		spring_directions[3 * j + 1] = target * p12[1];
+		spring_directions[3 * j + 2] = target * p12[2];
+		return potential;
+	});
 }
 
 void MassSpringSolver::solve(unsigned int n) {
 	float a = system->damping_factor; // shorthand
 
 	// update inertial term
-	inertial_term = M * ((a + 1) * (current_state) - a * prev_state);
+	#pragma omp parallel for schedule(static)
+	for (int i = 0; i < (int)system->n_points; i++) {
+		inertial_term.segment<3>(3 * i) = system->masses[i]
+			* ((a + 1) * current_state.segment<3>(3 * i) - a * prev_state.segment<3>(3 * i));
+	}
 
 	// save current state in previous state
 	prev_state = current_state;
 
 	// perform steps
+	stats.iterations = 0;
+	stats.converged = false;
 	for (unsigned int i = 0; i < n; i++) {
 		localStep();
-		globalStep();
+		if (!globalStep()) break;
+		stats.iterations++;
 	}
 }
 
@@ -123,6 +280,79 @@ void MassSpringSolver::timedSolve(unsigned int ms) {
 	// TODO
 }
 
+void MassSpringSolver::setTelemetry(bool enabled) {
+	telemetry = enabled;
+	if (enabled) gradient.resize(3 * system->n_points);
+	else gradient.resize(0);
+}
+
+void MassSpringSolver::setTolerance(float tolerance) {
+	this->tolerance = tolerance;
+	if (tolerance > 0.0f) setTelemetry(true);
+}
+
+void MassSpringSolver::setIterationCallback(IterationCallback callback) { this->callback = callback; }
+const SolverStats& MassSpringSolver::getStats() const { return stats; }
+
+const mass_spring_system& MassSpringSolver::getSystem() const { return *system; }
+
+float MassSpringSolver::kineticEnergy() const {
+	float h2 = system->time_step * system->time_step; // shorthand
+	double energy = Parallel::sum((int)system->n_points, 0.0, [&](int i) {
+		return 0.5 * system->masses[i] * (current_state.segment<3>(3 * i) - prev_state.segment<3>(3 * i)).squaredNorm();
+	});
+	return (float)(energy / h2);
+}
+
+void MassSpringSolver::setStrainLimit(float tau, float weight, const std::vector<unsigned int>& springs) {
+	for (unsigned int k : springs)
+		if (k >= system->n_springs) throw std::runtime_error("Strain limited spring is not in the mass-spring system.");
+
+	strain_limit = tau;
+	limit_ratios.setZero(system->n_springs);
+	for (unsigned int k : springs) limit_ratios[k] = weight;
+	if (springs.empty()) limit_ratios.resize(0);
+
+	// same sparsity pattern, only the values of L change
+	system_matrix->factorize(assemble());
+}
+
+void MassSpringSolver::setParameters(const VectorXf& stiffnesses, const VectorXf& masses, float time_step) {
+	if (stiffnesses.size() != system->n_springs || masses.size() != system->n_points)
+		throw std::runtime_error("Parameters do not match the mass-spring system.");
+
+	// limit stiffnesses are relative, they follow the spring stiffnesses
+	system->stiffnesses = stiffnesses;
+	system->masses = masses;
+	system->time_step = time_step;
+
+	// same sparsity pattern, only the values of M and L change
+	system_matrix->factorize(assemble());
+}
+
+size_t MassSpringSolver::memoryUsage() const {
+	// current state is the caller's vertex buffer
+	size_t vectors = prev_state.size() + spring_directions.size() + inertial_term.size() + rhs.size()
+		+ gradient.size() + limit_ratios.size();
+	return sizeof(*this) + vectors * sizeof(float) + system_matrix->memoryUsage();
+}
+
+void MassSpringSolver::saveState(std::ostream& out) const {
+	unsigned int size[2] = { system->n_points, system->n_springs };
+	writeRaw(out, size, 2);
+	writeRaw(out, current_state.data(), current_state.size());
+	writeRaw(out, prev_state.data(), prev_state.size());
+}
+
+void MassSpringSolver::loadState(std::istream& in) {
+	unsigned int size[2];
+	readRaw(in, size, 2);
+	if (size[0] != system->n_points || size[1] != system->n_springs)
+		throw std::runtime_error("Checkpoint does not match the mass-spring system.");
+	readRaw(in, current_state.data(), current_state.size());
+	readRaw(in, prev_state.data(), prev_state.size());
+}
+
 
 // B U I L D E R ////////////////////////////////////////////////////////////////////////////////////
 void MassSpringBuilder::uniformGrid(
@@ -145,102 +375,175 @@ void MassSpringBuilder::uniformGrid(
 	unsigned int n_springs = (n - 1) * (5 * n - 2);
 
 	// build mass list
-	VectorXf masses(mass * VectorXf::Ones(n_springs));
+	StateVector masses(VectorXf::Constant(n_points, mass));
+
+	// springs per grid row, rows are then filled independently in build order: a structural
+	// spring right and down, two shearing springs, bending springs right on even columns and
+	// down on even rows, the last column and row only have what stays inside the grid
+	IndexList springOffsets(n + 1, 0), structOffsets(n + 1, 0), shearOffsets(n + 1, 0), bendOffsets(n + 1, 0);
+	for (unsigned int i = 0; i < n; i++) {
+		const bool last = i == n - 1;
+		unsigned int structs = last ? n - 1 : 2 * n - 1;
+		unsigned int shears = last ? 0 : 2 * (n - 1);
+		unsigned int bends = (n - 1) / 2 + (!last && i % 2 == 0 ? n : 0);
+		springOffsets[i + 1] = springOffsets[i] + structs + shears + bends;
+		structOffsets[i + 1] = structOffsets[i] + structs;
+		shearOffsets[i + 1] = shearOffsets[i] + shears;
+		bendOffsets[i + 1] = bendOffsets[i] + bends;
+	}
+	assert(springOffsets[n] == n_springs);
 
 	// build spring list and spring parameters
 	EdgeList spring_list(n_springs);
-	structI.reserve(2 * (n - 1) * n);
-	shearI.reserve(2 * (n - 1) * (n - 1));
-	bendI.reserve(n * (n - 1));
-
-	VectorXf rest_lengths(n_springs);
-	VectorXf stiffnesses(n_springs);
-	unsigned int k = 0; // spring counter
-	for(unsigned int i = 0; i < n; i++) {
-		for(unsigned int j = 0; j < n; j++) {
-			// bottom right corner
-			if(i == n - 1 && j == n - 1) {
-				continue;
-			}
-
-			if (i == n - 1) {
-				// structural spring
-				spring_list[k] = Edge(n * i + j, n * i + j + 1);
-				rest_lengths[k] = rest_length;
-				stiffnesses[k] = stiffness;
-				structI.push_back(k++);
-
-				// bending spring
-				if (j % 2 == 0) {
-					spring_list[k] = Edge(n * i + j, n * i + j + 2);
-					rest_lengths[k] = 2 * rest_length;
-					stiffnesses[k] = stiffness;
-					bendI.push_back(k++);
-				}
-				continue;
-			}
-
-			// right edge
-			if (j == n - 1) {
-				// structural spring
-				spring_list[k] = Edge(n * i + j, n * (i + 1) + j);
-				rest_lengths[k] = rest_length;
-				stiffnesses[k] = stiffness;
-				structI.push_back(k++);
-
-				// bending spring
-				if (i % 2 == 0){
-					spring_list[k] = Edge(n * i + j, n * (i + 2) + j);
-					rest_lengths[k] = 2 * rest_length;
-					stiffnesses[k] = stiffness;
-					bendI.push_back(k++);
-				}
+	structI.assign(structOffsets[n], 0);
+	shearI.assign(shearOffsets[n], 0);
+	bendI.assign(bendOffsets[n], 0);
+	StateVector rest_lengths(n_springs);
+	StateVector stiffnesses(n_springs);
+	const float struct_length = rest_length, shear_length = (float)(root2 * rest_length), bend_length = 2 * rest_length;
+
+	#pragma omp parallel for schedule(static)
+	for (int row = 0; row < (int)n; row++) {
+		const unsigned int i = row;
+		unsigned int k = springOffsets[i]; // spring counter
+		unsigned int s = structOffsets[i], d = shearOffsets[i], b = bendOffsets[i];
+		auto add = [&](unsigned int p, unsigned int q, float length, IndexList& index, unsigned int& slot) {
+			spring_list[k] = Edge(p, q);
+			rest_lengths[k] = length;
+			stiffnesses[k] = stiffness;
+			index[slot++] = k++;
+		};
+
+		for (unsigned int j = 0; j < n; j++) {
+			const unsigned int p = n * i + j;
+			if (j < n - 1) add(p, p + 1, struct_length, structI, s);
+			if (i < n - 1 && j == n - 1) add(p, p + n, struct_length, structI, s);
+			if (i == n - 1 || j == n - 1) {
+				if (j < n - 1 && j % 2 == 0) add(p, p + 2, bend_length, bendI, b);
+				if (i < n - 1 && i % 2 == 0) add(p, p + 2 * n, bend_length, bendI, b);
 				continue;
 			}
+			add(p, p + n, struct_length, structI, s);
+			add(p, p + n + 1, shear_length, shearI, d);
+			add(p + n, p + 1, shear_length, shearI, d);
+			if (j % 2 == 0) add(p, p + 2, bend_length, bendI, b);
+			if (i % 2 == 0) add(p, p + 2 * n, bend_length, bendI, b);
+		}
+	}
 
-			// structural springs
-			spring_list[k] = Edge(n * i + j, n * i + j + 1);
-			rest_lengths[k] = rest_length;
-			stiffnesses[k] = stiffness;
-			structI.push_back(k++);
+	// compute external forces
+	StateVector fext(Vector3f(0, 0, -gravity).replicate(n_points, 1));
 
-			spring_list[k] = Edge(n * i + j, n * (i + 1) + j);
-			rest_lengths[k] = rest_length;
-			stiffnesses[k] = stiffness;
-			structI.push_back(k++);
+	result = new mass_spring_system(n_points, n_springs, time_step, std::move(spring_list),
+		std::move(rest_lengths), std::move(stiffnesses), std::move(masses), std::move(fext),
+		damping_factor);
+}
 
-			// shearing springs
-			spring_list[k] = Edge(n * i + j, n * (i + 1) + j + 1);
-			rest_lengths[k] = root2 * rest_length;
-			stiffnesses[k] = stiffness;
-			shearI.push_back(k++);
+void MassSpringBuilder::triangleMesh(
+	const float* vbuff,
+	unsigned int n_points,
+	const unsigned int* ibuff,
+	unsigned int ibuffLen,
+	float time_step,
+	float stiffness,
+	float density,
+	float damping_factor,
+	float gravity
+) {
+	typedef Eigen::Map<const Vector3f> ConstMap;
+	typedef unsigned long long Key;
+	const unsigned int NONE = ~0u;
+	const Key EMPTY = ~0ull;
+	const unsigned int n_faces = ibuffLen / 3;
+
+	structI.clear();
+	shearI.clear();
+	bendI.clear();
+
+	// deduplicate edges with an open-addressing hash table keyed by the sorted vertex pair,
+	// every edge remembers the vertices opposite to it in its (at most two) triangles
+	unsigned int bits = 1;
+	while ((1ull << bits) < 6ull * n_faces) bits++; // load factor <= 0.5
+	const Key mask = (1ull << bits) - 1;
+	std::vector<Key> keys(mask + 1, EMPTY);
+	std::vector<unsigned int> slots(mask + 1);
+
+	EdgeList edges;
+	IndexList opposite1, opposite2;
+	edges.reserve(3 * n_faces / 2 + n_faces / 8);
+	opposite1.reserve(edges.capacity());
+	opposite2.reserve(edges.capacity());
+
+	// point masses from a third of each incident triangle area
+	StateVector masses(VectorXf::Zero(n_points));
+
+	for (unsigned int f = 0; f < n_faces; f++) {
+		const unsigned int* v = &ibuff[3 * f];
+		ConstMap p0(&vbuff[3 * v[0]]), p1(&vbuff[3 * v[1]]), p2(&vbuff[3 * v[2]]);
+		float area = 0.5f * (p1 - p0).cross(p2 - p0).norm();
+		for (int j = 0; j < 3; j++) masses[v[j]] += density * area / 3.0f;
 
-			spring_list[k] = Edge(n * (i + 1) + j, n * i + j + 1);
-			rest_lengths[k] = root2 * rest_length;
-			stiffnesses[k] = stiffness;
-			shearI.push_back(k++);
-
-			// bending springs
-			if (j % 2 == 0) {
-				spring_list[k] = Edge(n * i + j, n * i + j + 2);
-				rest_lengths[k] = 2 * rest_length;
-				stiffnesses[k] = stiffness;
-				bendI.push_back(k++);
+		for (int j = 0; j < 3; j++) {
+			unsigned int a = v[j], b = v[(j + 1) % 3], c = v[(j + 2) % 3];
+			if (a > b) std::swap(a, b);
+			Key key = ((Key)a << 32) | b;
+
+			Key slot = (key * 0x9E3779B97F4A7C15ull) >> (64 - bits);
+			while (keys[slot] != EMPTY && keys[slot] != key) slot = (slot + 1) & mask;
+
+			if (keys[slot] == EMPTY) {
+				keys[slot] = key;
+				slots[slot] = (unsigned int)edges.size();
+				edges.push_back(Edge(a, b));
+				opposite1.push_back(c);
+				opposite2.push_back(NONE);
 			}
-			if (i % 2 == 0) {
-				spring_list[k] = Edge(n * i + j, n * (i + 2) + j);
-				rest_lengths[k] = 2 * rest_length;
-				stiffnesses[k] = stiffness;
-				bendI.push_back(k++);
+			else if (opposite2[slots[slot]] == NONE) {
+				opposite2[slots[slot]] = c;
 			}
 		}
 	}
 
+	// vertices without triangles still need mass for a solvable system
+	float mean_mass = n_points > 0 ? masses.sum() / n_points : 0.0f;
+	for (unsigned int i = 0; i < n_points; i++)
+		if (masses[i] <= 0.0f) masses[i] = mean_mass > 0.0f ? mean_mass : 1.0f;
+
+	// structural springs first, then bending springs
+	unsigned int n_bend = 0;
+	for (unsigned int e = 0; e < edges.size(); e++)
+		if (opposite2[e] != NONE) n_bend++;
+	unsigned int n_springs = (unsigned int)edges.size() + n_bend;
+
+	EdgeList spring_list(n_springs);
+	StateVector rest_lengths(n_springs);
+	StateVector stiffnesses(VectorXf::Constant(n_springs, stiffness));
+	structI.reserve(edges.size());
+	bendI.reserve(n_bend);
+
+	unsigned int k = 0; // spring counter
+	for (unsigned int e = 0; e < edges.size(); e++) {
+		spring_list[k] = edges[e];
+		rest_lengths[k] = (ConstMap(&vbuff[3 * edges[e].first])
+			- ConstMap(&vbuff[3 * edges[e].second])).norm();
+		structI.push_back(k++);
+	}
+	for (unsigned int e = 0; e < edges.size(); e++) {
+		if (opposite2[e] == NONE) continue;
+		spring_list[k] = Edge(opposite1[e], opposite2[e]);
+		rest_lengths[k] = (ConstMap(&vbuff[3 * opposite1[e]])
+			- ConstMap(&vbuff[3 * opposite2[e]])).norm();
+		bendI.push_back(k++);
+	}
+
 	// compute external forces
-	VectorXf fext = Vector3f(0, 0, -gravity).replicate(n_points, 1);
+	StateVector fext(3 * n_points);
+	for (unsigned int i = 0; i < n_points; i++)
+		fext.segment<3>(3 * i) = Vector3f(0, 0, -gravity * masses[i]);
 
-	result = new mass_spring_system(n_points, n_springs, time_step, spring_list, rest_lengths,
-		stiffnesses, masses, fext, damping_factor);
+	result = new mass_spring_system(n_points, n_springs, time_step, std::move(spring_list),
+		std::move(rest_lengths), std::move(stiffnesses), std::move(masses), std::move(fext),
+		damping_factor);
 }
 MassSpringBuilder::IndexList MassSpringBuilder::getStructIndex() { return structI; }
 MassSpringBuilder::IndexList MassSpringBuilder::getShearIndex() { return shearI; }
@@ -249,6 +552,9 @@ mass_spring_system* MassSpringBuilder::getResult() { return result; }
 
 // C O N S T R A I N T //////////////////////////////////////////////////////////////////////////////
 CgNode::CgNode(mass_spring_system* system, float* vbuff) : system(system), vbuff(vbuff) {}
+void CgNode::saveState(std::ostream& out) const {}
+void CgNode::loadState(std::istream& in) {}
+bool CgNode::bounds(Eigen::Vector3f& lo, Eigen::Vector3f& hi) const { return false; }
 
 // point node
 CgPointNode::CgPointNode(mass_spring_system* system, float* vbuff) : CgNode(system, vbuff) {}
@@ -291,52 +597,95 @@ void CgPointFixNode::fixPoint(unsigned int i) {
 	fix_map[3 * i] = Vector3f(vbuff[3 * i], vbuff[3 * i + 1], vbuff[3 * i + 2]);
 }
 void CgPointFixNode::releasePoint(unsigned int i) { fix_map.erase(3 * i); }
+void CgPointFixNode::saveState(std::ostream& out) const {
+	unsigned int n = (unsigned int)fix_map.size();
+	writeRaw(out, &n, 1);
+	for (auto fix : fix_map) {
+		writeRaw(out, &fix.first, 1);
+		writeRaw(out, fix.second.data(), 3);
+	}
+}
+void CgPointFixNode::loadState(std::istream& in) {
+	unsigned int n;
+	readRaw(in, &n, 1);
+	fix_map.clear();
+	for (unsigned int k = 0; k < n; k++) {
+		unsigned int i;
+		Vector3f p;
+		readRaw(in, &i, 1);
+		readRaw(in, p.data(), 3);
+		if (i >= 3 * system->n_points)
+			throw std::runtime_error("Checkpoint fixes a point outside the system.");
+		fix_map[i] = p;
+	}
+}
 
 // spring deformation node
 CgSpringDeformationNode::CgSpringDeformationNode(mass_spring_system* system, float* vbuff,
 	float tauc, unsigned int n_iter) : CgSpringNode(system, vbuff), tauc(tauc), n_iter(n_iter) {}
 void CgSpringDeformationNode::satisfy() {
 	for (int k = 0; k < n_iter; k++) {
-		for (unsigned int i : items) {
-			Edge spring = system->spring_list[i];
-			CgQueryFixedPointVisitor visitor;
-
-			Vector3f p12(
-				vbuff[3 * spring.first + 0] - vbuff[3 * spring.second + 0],
-				vbuff[3 * spring.first + 1] - vbuff[3 * spring.second + 1],
-				vbuff[3 * spring.first + 2] - vbuff[3 * spring.second + 2]
-			);
-
-			float len = p12.norm();
-			float rlen = system->rest_lengths[i];
-			float diff = (len - (1 + tauc) * rlen) / len;
-			float rate = (len - rlen) / rlen;
-
-			// check deformation
-			if (rate <= tauc) continue;
-
-			// check if points are fixed
-			float f1, f2;
-			f1 = f2 = 0.5f;
-
-			// if first point is fixed
-			if (visitor.queryPoint(*this, spring.first)) { f1 = 0.0f; f2 = 1.0f; }
-
-			// if second point is fixed
-			if (visitor.queryPoint(*this, spring.second)) {
-				f1 = (f1 != 0.0f ? 1.0f : 0.0f);
-				f2 = 0.0f;
-			}
+		for (const IndexList& color : colors) {
+			#pragma omp parallel for schedule(static)
+			for (int c = 0; c < (int)color.size(); c++) {
+				unsigned int i = color[c];
+				Edge spring = system->spring_list[i];
+				CgQueryFixedPointVisitor visitor;
+
+				Vector3f p12(
+					vbuff[3 * spring.first + 0] - vbuff[3 * spring.second + 0],
+					vbuff[3 * spring.first + 1] - vbuff[3 * spring.second + 1],
+					vbuff[3 * spring.first + 2] - vbuff[3 * spring.second + 2]
+				);
+
+				float len = p12.norm();
+				float rlen = system->rest_lengths[i];
+				float diff = (len - (1 + tauc) * rlen) / len;
+				float rate = (len - rlen) / rlen;
+
+				// check deformation
+				if (rate <= tauc) continue;
+
+				// check if points are fixed
+				float f1, f2;
+				f1 = f2 = 0.5f;
+
+				// if first point is fixed
+				if (visitor.queryPoint(*this, spring.first)) { f1 = 0.0f; f2 = 1.0f; }
+
+				// if second point is fixed
+				if (visitor.queryPoint(*this, spring.second)) {
+					f1 = (f1 != 0.0f ? 1.0f : 0.0f);
+					f2 = 0.0f;
+				}
 
-			for (int j = 0; j < 3; j++) {
-				vbuff[3 * spring.first + j] -= p12[j] * f1 * diff;
-				vbuff[3 * spring.second + j] += p12[j] * f2 * diff;
+				for (int j = 0; j < 3; j++) {
+					vbuff[3 * spring.first + j] -= p12[j] * f1 * diff;
+					vbuff[3 * spring.second + j] += p12[j] * f2 * diff;
+				}
 			}
 		}
 	}
 }
 void CgSpringDeformationNode::addSprings(std::vector<unsigned int> springs) {
 	items.insert(springs.begin(), springs.end());
+
+	// greedy coloring in spring order, the first color whose springs touch neither point
+	IndexList sorted(items.begin(), items.end());
+	std::sort(sorted.begin(), sorted.end());
+	std::vector<std::vector<bool>> taken; // per color and point
+	colors.clear();
+	for (unsigned int i : sorted) {
+		const Edge& spring = system->spring_list[i];
+		size_t c = 0;
+		while (c < colors.size() && (taken[c][spring.first] || taken[c][spring.second])) c++;
+		if (c == colors.size()) {
+			colors.push_back(IndexList());
+			taken.push_back(std::vector<bool>(system->n_points, false));
+		}
+		colors[c].push_back(i);
+		taken[c][spring.first] = taken[c][spring.second] = true;
+	}
 }
 
 // sphere collision node
@@ -344,7 +693,8 @@ CgSphereCollisionNode::CgSphereCollisionNode(mass_spring_system* system, float*
 	float radius, Vector3f center) : CgPointNode(system, vbuff), radius(radius), center(center) {}
 bool CgSphereCollisionNode::query(unsigned int i) const { return false; }
 void CgSphereCollisionNode::satisfy() {
-	for (int i = 0; i < system->n_points; i++) {
+	#pragma omp parallel for schedule(static)
+	for (int i = 0; i < (int)system->n_points; i++) {
 		Vector3f p(
 			vbuff[3 * i + 0] - center[0],
 			vbuff[3 * i + 1] - center[1],
@@ -362,6 +712,135 @@ void CgSphereCollisionNode::satisfy() {
 		}
 	}
 }
+bool CgSphereCollisionNode::bounds(Vector3f& lo, Vector3f& hi) const {
+	lo = center - Vector3f::Constant(radius);
+	hi = center + Vector3f::Constant(radius);
+	return true;
+}
+void CgSphereCollisionNode::setCenter(const Vector3f& center) { this->center = center; }
+
+// continuous collision node
+CgContinuousCollisionNode::CgContinuousCollisionNode(mass_spring_system* system, float* vbuff,
+	const float* prev_vbuff, float thickness)
+	: CgPointNode(system, vbuff), prev_vbuff(prev_vbuff), thickness(thickness) {}
+CgContinuousCollisionNode::~CgContinuousCollisionNode() {
+	for (Obstacle& mesh : meshes) delete mesh.bvh;
+}
+bool CgContinuousCollisionNode::query(unsigned int i) const { return false; }
+bool CgContinuousCollisionNode::bounds(Vector3f& lo, Vector3f& hi) const {
+	if (spheres.empty() && meshes.empty()) return false;
+	lo = Vector3f::Constant(std::numeric_limits<float>::max());
+	hi = -lo;
+	for (const Sphere& s : spheres) {
+		lo = lo.cwiseMin(s.center - Vector3f::Constant(s.radius));
+		hi = hi.cwiseMax(s.center + Vector3f::Constant(s.radius));
+	}
+	for (const Obstacle& mesh : meshes) {
+		lo = lo.cwiseMin(mesh.lo);
+		hi = hi.cwiseMax(mesh.hi);
+	}
+	return true;
+}
+
+void CgContinuousCollisionNode::addSphere(const Vector3f& center, float radius) {
+	spheres.push_back({ center, radius });
+}
+void CgContinuousCollisionNode::addPlane(const Vector3f& point, const Vector3f& normal) {
+	planes.push_back({ point, normal.normalized() });
+}
+void CgContinuousCollisionNode::addMesh(const float* vbuff, unsigned int n_points,
+	const unsigned int* ibuff, unsigned int ibuffLen) {
+	Obstacle mesh;
+	mesh.vbuff.assign(vbuff, vbuff + 3 * n_points);
+	mesh.ibuff.assign(ibuff, ibuff + ibuffLen);
+	mesh.bvh = new TriangleBvh(mesh.vbuff.data(), ibuff, ibuffLen);
+	mesh.lo = mesh.hi = Vector3f(vbuff[0], vbuff[1], vbuff[2]);
+	for (unsigned int i = 1; i < n_points; i++) {
+		Vector3f p(vbuff[3 * i + 0], vbuff[3 * i + 1], vbuff[3 * i + 2]);
+		mesh.lo = mesh.lo.cwiseMin(p);
+		mesh.hi = mesh.hi.cwiseMax(p);
+	}
+	meshes.push_back(mesh);
+}
+
+bool CgContinuousCollisionNode::impact(const Vector3f& p0, const Vector3f& p1, float& t, Vector3f& normal) const {
+	Vector3f d = p1 - p0;
+	t = 2.0f;
+
+	// entering a sphere, |p0 + s d - c| = r for the smaller root, paths starting inside are skipped
+	for (const Sphere& sphere : spheres) {
+		Vector3f m = p0 - sphere.center;
+		float a = d.squaredNorm(), b = m.dot(d), c = m.squaredNorm() - sphere.radius * sphere.radius;
+		if (c < 0.0f || b >= 0.0f || a == 0.0f) continue;
+		float disc = b * b - a * c;
+		if (disc < 0.0f) continue;
+		float s = (-b - std::sqrt(disc)) / a;
+		if (s > 1.0f || s >= t) continue;
+		t = s;
+		normal = (m + s * d) / sphere.radius;
+	}
+
+	// crossing a plane from the front
+	for (const Plane& plane : planes) {
+		float s0 = (p0 - plane.point).dot(plane.normal), s1 = (p1 - plane.point).dot(plane.normal);
+		if (s0 < 0.0f || s1 >= 0.0f) continue;
+		float s = s0 / (s0 - s1);
+		if (s >= t) continue;
+		t = s;
+		normal = plane.normal;
+	}
+
+	// crossing a triangle, the face normal turned against the motion
+	Vector3f lo = p0.cwiseMin(p1), hi = p0.cwiseMax(p1);
+	for (const Obstacle& mesh : meshes) {
+		if ((lo.array() > mesh.hi.array()).any() || (hi.array() < mesh.lo.array()).any()) continue;
+		TriangleBvh::Hit hit;
+		if (!mesh.bvh->intersect(mesh.vbuff.data(), p0, d, hit) || hit.t > 1.0f || hit.t >= t) continue;
+		const float* v[3];
+		for (int j = 0; j < 3; j++) v[j] = &mesh.vbuff[3 * mesh.ibuff[3 * hit.triangle + j]];
+		Vector3f e1(v[1][0] - v[0][0], v[1][1] - v[0][1], v[1][2] - v[0][2]);
+		Vector3f e2(v[2][0] - v[0][0], v[2][1] - v[0][1], v[2][2] - v[0][2]);
+		Vector3f n = e1.cross(e2).normalized();
+		t = hit.t;
+		normal = n.dot(d) > 0.0f ? -n : n;
+	}
+	return t <= 1.0f;
+}
+
+void CgContinuousCollisionNode::satisfy() {
+	#pragma omp parallel for schedule(static)
+	for (int i = 0; i < (int)system->n_points; i++) {
+		Vector3f start(prev_vbuff[3 * i + 0], prev_vbuff[3 * i + 1], prev_vbuff[3 * i + 2]);
+		Vector3f p(vbuff[3 * i + 0], vbuff[3 * i + 1], vbuff[3 * i + 2]);
+
+		// stop at the earliest impact, slide the rest of the way, give up after a few impacts
+		float t;
+		Vector3f normal;
+		for (unsigned int k = 0; impact(start, p, t, normal); k++) {
+			Vector3f contact = start + t * (p - start) + thickness * normal;
+			if (k + 1 == MAX_SLIDES) {
+				p = contact;
+				break;
+			}
+			float into = (p - contact).dot(normal);
+			if (into < 0.0f) p -= into * normal;
+			start = contact;
+		}
+
+		// solid obstacles, points that start or end inside
+		for (const Sphere& sphere : spheres) {
+			Vector3f m = p - sphere.center;
+			float r = sphere.radius + thickness;
+			if (m.squaredNorm() < r * r && m.squaredNorm() > 0.0f) p = sphere.center + r * m.normalized();
+		}
+		for (const Plane& plane : planes) {
+			float s = (p - plane.point).dot(plane.normal) - thickness;
+			if (s < 0.0f) p -= s * plane.normal;
+		}
+
+		for (int j = 0; j < 3; j++) vbuff[3 * i + j] = p[j];
+	}
+}
 
 // node visitor
 bool CgNodeVisitor::visit(CgPointNode& node) { return true; }
@@ -381,4 +860,30 @@ bool CgQueryFixedPointVisitor::queryPoint(CgNode& root, unsigned int i) {
 // satisfy visitor
 bool CgSatisfyVisitor::visit(CgPointNode& node) { node.satisfy(); return true; }
 bool CgSatisfyVisitor::visit(CgSpringNode& node) { node.satisfy(); return true; }
-void CgSatisfyVisitor::satisfy(CgNode& root) { root.accept(*this); }
\ No newline at end of file
+void CgSatisfyVisitor::satisfy(CgNode& root) {
+	PROFILE_SCOPE("satisfy");
+	root.accept(*this);
+}
+
+// save state visitor
+bool CgSaveStateVisitor::visit(CgPointNode& node) { node.saveState(*out); return true; }
+bool CgSaveStateVisitor::visit(CgSpringNode& node) { node.saveState(*out); return true; }
+void CgSaveStateVisitor::save(CgNode& root, std::ostream& out) { this->out = &out; root.accept(*this); }
+
+// load state visitor
+bool CgLoadStateVisitor::visit(CgPointNode& node) { node.loadState(*in); return true; }
+bool CgLoadStateVisitor::visit(CgSpringNode& node) { node.loadState(*in); return true; }
+void CgLoadStateVisitor::load(CgNode& root, std::istream& in) { this->in = &in; root.accept(*this); }
+
+// bounds visitor
+void CgBoundsVisitor::add(const CgNode& node) {
+	Box box;
+	if (node.bounds(box.first, box.second)) boxes->push_back(box);
+}
+bool CgBoundsVisitor::visit(CgPointNode& node) { add(node); return true; }
+bool CgBoundsVisitor::visit(CgSpringNode& node) { add(node); return true; }
+void CgBoundsVisitor::collect(CgNode& root, std::vector<Box>& boxes) {
+	boxes.clear();
+	this->boxes = &boxes;
+	root.accept(*this);
+}
\ No newline at end of file
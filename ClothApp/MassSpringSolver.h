@@ -1,26 +1,33 @@
 #pragma once
 #include <Eigen/Dense>
 #include <Eigen/Sparse>
+#include <functional>
+#include <iosfwd>
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
 
+#include "LinearSolver.h"
+#include "Memory.h"
+
+class TriangleBvh;
+
 // Mass-Spring System struct
 struct mass_spring_system { 
 	typedef Eigen::SparseMatrix<float> SparseMatrix;
 	typedef Eigen::VectorXf VectorXf;
 	typedef std::pair<unsigned int, unsigned int> Edge;
-	typedef std::vector<Edge> EdgeList;
+	typedef std::vector<Edge, StateAllocator<Edge> > EdgeList;
 	
-	// parameters
+	// parameters, on memory from the default allocator
 	unsigned int n_points; // number of points
 	unsigned int n_springs; // number of springs
 	float time_step; // time step
 	EdgeList spring_list; // spring edge list
-	VectorXf rest_lengths; // spring rest lengths
-	VectorXf stiffnesses; // spring stiffnesses
-	VectorXf masses; // point masses
-	VectorXf fext; // external forces
+	StateVector rest_lengths; // spring rest lengths
+	StateVector stiffnesses; // spring stiffnesses
+	StateVector masses; // point masses
+	StateVector fext; // external forces
 	float damping_factor; // damping factor
 	
 	mass_spring_system(
@@ -28,51 +35,111 @@ struct mass_spring_system {
 		unsigned int n_springs,      // number of springs
 		float time_step,             // time step
 		EdgeList spring_list,        // spring edge list
-		VectorXf rest_lengths,       // spring rest lengths
-		VectorXf stiffnesses,        // spring stiffnesses
-		VectorXf masses,             // point masses
-		VectorXf fext,               // external forces
+		StateVector rest_lengths,    // spring rest lengths
+		StateVector stiffnesses,     // spring stiffnesses
+		StateVector masses,          // point masses
+		StateVector fext,            // external forces
 		float damping_factor         // damping factor
 	);
+
+	size_t memoryUsage() const; // bytes held by the parameter vectors
+};
+
+// Convergence of the last solve() call, filled when telemetry is enabled
+// Both values are evaluated at the iterate entering a global step, the objective is
+// 1/2 (q - y)^T M (q - y) + h^2 * (spring potential - q^T fext), the residual is the
+// norm of its gradient A * q - b relative to |b|.
+struct SolverStats {
+	unsigned int iterations; // global steps taken
+	float objective; // objective of the last evaluated iterate
+	float residual; // relative residual of the last evaluated iterate
+	bool converged; // stopped early on the residual tolerance
 };
 
 // Mass-Spring System Solver class
 class MassSpringSolver {
+public:
+	typedef std::function<void(unsigned int iteration, float objective, float residual)> IterationCallback;
+
+
 private:
 	typedef Eigen::Vector3f Vector3f;
 	typedef Eigen::VectorXf VectorXf;
 	typedef Eigen::SparseMatrix<float> SparseMatrix;
-	typedef Eigen::SimplicialLLT<Eigen::SparseMatrix<float> > Cholesky;
 	typedef Eigen::Map<Eigen::VectorXf> Map;
 	typedef std::pair<unsigned int, unsigned int> Edge;
-	typedef Eigen::Triplet<float> Triplet;
-	typedef std::vector<Triplet> TripletList;
+	typedef std::vector<unsigned int> IndexList;
+	typedef std::vector<unsigned int, StateAllocator<unsigned int> > StateIndexList;
 
-	// system
+	// system, M and J are applied from the masses and spring list, L only lives in A
 	mass_spring_system* system;
-	Cholesky system_matrix;
-
-	// M, L, J matrices
-	SparseMatrix M;
-	SparseMatrix L;
-	SparseMatrix J;
+	LinearSolver* system_matrix; // factored M + h^2 * L, owned
+	StateIndexList incident_offsets; // point i owns incident_springs[offsets[i], offsets[i + 1])
+	StateIndexList incident_springs; // in spring order per point
 
-	// state
+	// state, on memory from the default allocator
 	Map current_state; // q(n), current state
-	VectorXf prev_state; // q(n - 1), previous state
-	VectorXf spring_directions; // d, spring directions
-	VectorXf inertial_term; // M * y, y = (a + 1) * q(n) - a * q(n - 1)
+	StateVector prev_state; // q(n - 1), previous state
+	StateVector spring_directions; // d, spring directions
+	StateVector inertial_term; // M * y, y = (a + 1) * q(n) - a * q(n - 1)
+	StateVector rhs; // b, right hand side of the global step
+
+	// telemetry
+	bool telemetry; // evaluate objective and residual every iteration
+	float tolerance; // early exit residual, 0 runs all iterations
+	float spring_potential; // sum of 1/2 k (|p12| - r)^2, reduced by the local step
+	StateVector gradient; // A * q - b, allocated while telemetry is enabled
+	IterationCallback callback;
+	SolverStats stats;
+
+	// strain limiting, a second stiff spring per limited spring whose target length is the
+	// current length clamped to [1 - tau, 1 + tau] * rest length
+	float strain_limit; // tau
+	StateVector limit_ratios; // limit stiffness relative to the spring stiffness, 0 if free, empty without limits
+
+	SparseMatrix assemble() const; // A = M + h^2 * L, limit stiffnesses included in L
+	float stiffness(unsigned int k) const; // spring and limit stiffness
 
 	// steps
-	void globalStep();
+	bool globalStep(); // false if the iterate already meets the tolerance
 	void localStep();
+	bool evaluate(const StateVector& b); // objective and residual, false if converged
 
 public:
-	MassSpringSolver(mass_spring_system* system, float* vbuff);
+	MassSpringSolver(mass_spring_system* system, float* vbuff,
+		LinearSolver* linear_solver = nullptr); // takes ownership, default SimplicialLLT with AMD
+	~MassSpringSolver();
 
 	// solve iterations
 	void solve(unsigned int n);
 	void timedSolve(unsigned int ms);
+
+	// convergence telemetry, fused into the local and global steps
+	void setTelemetry(bool enabled);
+	void setTolerance(float tolerance); // also enables telemetry when positive
+	void setIterationCallback(IterationCallback callback);
+	const SolverStats& getStats() const;
+	const mass_spring_system& getSystem() const;
+
+	// kinetic energy of the last time step, 1/2 sum m |q(n) - q(n - 1)|^2 / h^2, includes what
+	// the constraints did to q(n) after solve()
+	float kineticEnergy() const;
+
+	// strain limiting inside the local/global iterations, replaces a CgSpringDeformationNode pass
+	// weight is the limit stiffness relative to the spring stiffness, refactors A, throws for
+	// springs outside the system
+	void setStrainLimit(float tau, float weight, const std::vector<unsigned int>& springs);
+
+	// new stiffnesses, masses and time step on the same springs, A keeps its pattern, so the
+	// ordering and symbolic factorization are reused and only the numeric factorization is
+	// redone. fext is left as it is, gravity is a force here and does not follow the masses.
+	void setParameters(const Eigen::VectorXf& stiffnesses, const Eigen::VectorXf& masses, float time_step);
+
+	size_t memoryUsage() const; // bytes held by the solver state and factor
+
+	// state checkpoint, spring directions and inertial term are derived in solve()
+	void saveState(std::ostream& out) const;
+	void loadState(std::istream& in);
 };
 
 // Mass-Spring System Builder Class
@@ -81,7 +148,7 @@ private:
 	typedef Eigen::Vector3f Vector3f;
 	typedef Eigen::VectorXf VectorXf;	
 	typedef std::pair<unsigned int, unsigned int> Edge;
-	typedef std::vector<Edge> EdgeList;
+	typedef mass_spring_system::EdgeList EdgeList;
 	typedef Eigen::Triplet<float> Triplet;
 	typedef std::vector<Triplet> TripletList;
 	typedef std::vector<unsigned int> IndexList;
@@ -100,10 +167,24 @@ public:
 		float gravity            // gravitationl force (-z axis)
 	);
 
+	// springs from an arbitrary triangle mesh: structural springs on edges, bending springs
+	// across the opposite vertices of interior edges, masses from incident triangle areas
+	void triangleMesh(
+		const float* vbuff,         // vertex positions
+		unsigned int n_points,      // number of vertices
+		const unsigned int* ibuff,  // triangle indices
+		unsigned int ibuffLen,      // number of triangle indices
+		float time_step,            // time step
+		float stiffness,            // spring stiffness
+		float density,              // mass per unit area
+		float damping_factor,       // damping factor
+		float gravity               // gravitational acceleration (-z axis)
+	);
+
 
 	// indices
 	IndexList getStructIndex(); // structural springs
-	IndexList getShearIndex(); // shearing springs
+	IndexList getShearIndex(); // shearing springs, grids only
 	IndexList getBendIndex(); // bending springs
 
 	mass_spring_system* getResult();
@@ -120,10 +201,17 @@ protected:
 
 public:
 	CgNode(mass_spring_system* system, float* vbuff);
+	virtual ~CgNode() {}
 
 	virtual void satisfy() = 0; // satisfy constraint
 	virtual bool accept(CgNodeVisitor& visitor) = 0; // accept visitor
 
+	// collider extent, false for nodes that do not collide or are unbounded
+	virtual bool bounds(Eigen::Vector3f& lo, Eigen::Vector3f& hi) const;
+
+	// constraint state checkpoint, nothing to save by default
+	virtual void saveState(std::ostream& out) const;
+	virtual void loadState(std::istream& in);
 };
 
 // point constraint node
@@ -169,6 +257,9 @@ public:
 	virtual bool query(unsigned int i) const;
 	virtual void fixPoint(unsigned int i); // add point at index i to list
 	virtual void releasePoint(unsigned int i); // remove point at index i from list
+
+	virtual void saveState(std::ostream& out) const;
+	virtual void loadState(std::istream& in);
 };
 
 // spring node
@@ -176,7 +267,9 @@ class CgSpringDeformationNode : public CgSpringNode {
 private:
 	typedef std::pair<unsigned int, unsigned int> Edge;
 	typedef Eigen::Vector3f Vector3f;
+	typedef std::vector<unsigned int> IndexList;
 	std::unordered_set<unsigned int> items;
+	std::vector<IndexList> colors; // items without a shared point, projected concurrently
 	float tauc; // critical deformation rate
 	unsigned int n_iter; // number of iterations
 
@@ -199,6 +292,59 @@ public:
 	CgSphereCollisionNode(mass_spring_system* system, float* vbuff, float radius, Vector3f center);
 	virtual bool query(unsigned int i) const;
 	virtual void satisfy();
+	virtual bool bounds(Vector3f& lo, Vector3f& hi) const;
+
+	void setCenter(const Vector3f& center); // moving collider, from the simulating thread
+};
+
+// continuous collision node
+// Follows every point along its path from the start of the time step and stops it at the
+// earliest impact with any obstacle, the rest of the motion slides along the surface. Spheres
+// and planes are solid, points ending up inside are pushed out as well. Meshes are static,
+// double sided and have no inside, only paths through their triangles are caught.
+class CgContinuousCollisionNode : public CgPointNode {
+private:
+	typedef Eigen::Vector3f Vector3f;
+	static const unsigned int MAX_SLIDES = 3; // impacts handled per point and time step
+
+	struct Sphere {
+		Vector3f center;
+		float radius;
+	};
+
+	struct Plane {
+		Vector3f point;
+		Vector3f normal; // unit, points out of the solid half-space
+	};
+
+	struct Obstacle {
+		std::vector<float> vbuff;
+		std::vector<unsigned int> ibuff;
+		TriangleBvh* bvh;
+		Vector3f lo, hi; // bounding box
+	};
+
+	const float* prev_vbuff; // positions at the start of the time step
+	float thickness; // distance kept from surfaces
+	std::vector<Sphere> spheres;
+	std::vector<Plane> planes;
+	std::vector<Obstacle> meshes;
+
+	// earliest impact on the segment p0 -> p1, t in [0, 1], normal faces p0
+	bool impact(const Vector3f& p0, const Vector3f& p1, float& t, Vector3f& normal) const;
+
+public:
+	CgContinuousCollisionNode(mass_spring_system* system, float* vbuff, const float* prev_vbuff,
+		float thickness = 1e-3f);
+	~CgContinuousCollisionNode();
+
+	void addSphere(const Vector3f& center, float radius);
+	void addPlane(const Vector3f& point, const Vector3f& normal);
+	void addMesh(const float* vbuff, unsigned int n_points, const unsigned int* ibuff, unsigned int ibuffLen);
+
+	virtual bool query(unsigned int i) const;
+	virtual void satisfy();
+	virtual bool bounds(Vector3f& lo, Vector3f& hi) const; // spheres and meshes, planes are unbounded
 };
 
 // node visitor
@@ -227,4 +373,41 @@ public:
 	virtual bool visit(CgSpringNode& node);
 
 	void satisfy(CgNode& root);
+};
+
+// state checkpoint visitors, nodes are saved and loaded in traversal order
+class CgSaveStateVisitor : public CgNodeVisitor {
+private:
+	std::ostream* out;
+public:
+	virtual bool visit(CgPointNode& node);
+	virtual bool visit(CgSpringNode& node);
+
+	void save(CgNode& root, std::ostream& out);
+};
+
+class CgLoadStateVisitor : public CgNodeVisitor {
+private:
+	std::istream* in;
+public:
+	virtual bool visit(CgPointNode& node);
+	virtual bool visit(CgSpringNode& node);
+
+	void load(CgNode& root, std::istream& in);
+};
+
+// collider bounds visitor, one box per bounded collider in traversal order
+class CgBoundsVisitor : public CgNodeVisitor {
+public:
+	typedef std::pair<Eigen::Vector3f, Eigen::Vector3f> Box; // lo, hi
+
+private:
+	std::vector<Box>* boxes;
+	void add(const CgNode& node);
+
+public:
+	virtual bool visit(CgPointNode& node);
+	virtual bool visit(CgSpringNode& node);
+
+	void collect(CgNode& root, std::vector<Box>& boxes);
 };
\ No newline at end of file
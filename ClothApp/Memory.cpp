@@ -0,0 +1,185 @@
+#include "Memory.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+static std::atomic<Allocator*> default_allocator(nullptr);
+
+static size_t roundUp(size_t bytes, size_t multiple) { return (bytes + multiple - 1) / multiple * multiple; }
+
+// A L L O C A T O R ////////////////////////////////////////////////////////////////////////////////
+const size_t Allocator::CACHE_LINE;
+const size_t Allocator::HUGE_PAGE;
+
+Allocator* Allocator::create(const std::string& name) {
+	if (name == "aligned") return new AlignedAllocator;
+	if (name == "aligned-numa") return new AlignedAllocator(CACHE_LINE, true);
+	if (name == "huge") return new HugePageAllocator;
+	if (name == "huge-numa") return new HugePageAllocator(true);
+	throw std::runtime_error("Unknown allocator " + name);
+}
+
+std::vector<std::string> Allocator::available() { return { "aligned", "aligned-numa", "huge", "huge-numa" }; }
+
+void Allocator::setDefault(Allocator* allocator) {
+	// never deleted, buffers of the previous default may still be around
+	default_allocator.store(allocator, std::memory_order_release);
+}
+
+Allocator& Allocator::get() {
+	// solvers of scene blocks are built concurrently, the fallback is a thread-safe local static
+	Allocator* allocator = default_allocator.load(std::memory_order_acquire);
+	if (allocator != nullptr) return *allocator;
+	static Allocator* aligned = new AlignedAllocator;
+	return *aligned;
+}
+
+// A L I G N E D ////////////////////////////////////////////////////////////////////////////////////
+AlignedAllocator::AlignedAllocator(size_t alignment, bool first_touch)
+	: alignment(std::max(alignment, (size_t)16)), first_touch(first_touch) {}
+
+void* AlignedAllocator::allocate(size_t bytes) {
+	if (bytes == 0) return nullptr;
+#ifdef _WIN32
+	void* p = _aligned_malloc(bytes, alignment);
+#else
+	void* p = nullptr;
+	if (posix_memalign(&p, alignment, bytes) != 0) p = nullptr;
+#endif
+	if (p == nullptr) throw std::bad_alloc();
+	if (first_touch) touch(p, bytes);
+	return p;
+}
+
+void AlignedAllocator::deallocate(void* p, size_t /*bytes*/) {
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	std::free(p);
+#endif
+}
+
+void AlignedAllocator::touch(void* p, size_t bytes) const {
+	// the loops split points and springs into equal contiguous shares, so do the lines
+	char* bytes_p = static_cast<char*>(p);
+	const int n_lines = (int)((bytes + CACHE_LINE - 1) / CACHE_LINE);
+	#pragma omp parallel for schedule(static)
+	for (int i = 0; i < n_lines; i++) {
+		size_t offset = (size_t)i * CACHE_LINE;
+		std::memset(bytes_p + offset, 0, std::min(CACHE_LINE, bytes - offset));
+	}
+}
+
+std::string AlignedAllocator::name() const { return first_touch ? "aligned-numa" : "aligned"; }
+
+// H U G E  P A G E S ///////////////////////////////////////////////////////////////////////////////
+HugePageAllocator::HugePageAllocator(bool first_touch) : AlignedAllocator(CACHE_LINE, first_touch) {}
+
+void* HugePageAllocator::allocate(size_t bytes) {
+#ifdef __linux__
+	if (bytes < HUGE_PAGE) return AlignedAllocator::allocate(bytes);
+	const size_t size = roundUp(bytes, HUGE_PAGE);
+
+	// reserved huge pages first, they are only there if the administrator set some aside
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#ifdef MAP_HUGE_2MB
+	flags |= MAP_HUGE_2MB;
+#endif
+	void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+
+	// transparent huge pages, over-map and trim to a 2 MB boundary
+	if (p == MAP_FAILED) {
+		char* q = (char*)mmap(nullptr, size + HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (q == MAP_FAILED) throw std::bad_alloc();
+		char* a = (char*)roundUp((uintptr_t)q, HUGE_PAGE);
+		if (a > q) munmap(q, a - q);
+		munmap(a + size, q + HUGE_PAGE - a);
+		madvise(a, size, MADV_HUGEPAGE);
+		p = a;
+	}
+	if (first_touch) touch(p, bytes);
+	return p;
+#else
+	return AlignedAllocator::allocate(bytes);
+#endif
+}
+
+void HugePageAllocator::deallocate(void* p, size_t bytes) {
+#ifdef __linux__
+	if (bytes >= HUGE_PAGE) {
+		munmap(p, roundUp(bytes, HUGE_PAGE));
+		return;
+	}
+#endif
+	AlignedAllocator::deallocate(p, bytes);
+}
+
+void HugePageAllocator::prepare(const void* p, size_t bytes) {
+#ifdef __linux__
+	// only whole 2 MB pages inside the range can be backed by huge pages
+	uintptr_t first = roundUp((uintptr_t)p, HUGE_PAGE), last = ((uintptr_t)p + bytes) / HUGE_PAGE * HUGE_PAGE;
+	if (last > first) madvise((void*)first, last - first, MADV_HUGEPAGE);
+#endif
+}
+
+std::string HugePageAllocator::name() const { return first_touch ? "huge-numa" : "huge"; }
+
+// S T A T E  V E C T O R ///////////////////////////////////////////////////////////////////////////
+StateVector::StateVector(Index n, Allocator* allocator) : Base(allocate(allocator, n), n), allocator(allocator) {}
+StateVector::StateVector() : StateVector(0, &Allocator::get()) {}
+StateVector::StateVector(Index n) : StateVector(n, &Allocator::get()) {}
+
+StateVector::StateVector(const StateVector& other) : StateVector(other.size(), &Allocator::get()) {
+	Base::operator=(other);
+}
+
+StateVector::StateVector(StateVector&& other) : Base(other.data(), other.size()), allocator(other.allocator) {
+	other.rebind(nullptr, 0);
+}
+
+StateVector::~StateVector() {
+	if (data() != nullptr) allocator->deallocate(data(), size() * sizeof(float));
+}
+
+float* StateVector::allocate(Allocator* allocator, Index n) {
+	return n > 0 ? static_cast<float*>(allocator->allocate(n * sizeof(float))) : nullptr;
+}
+
+void StateVector::rebind(float* p, Index n) { new (static_cast<Base*>(this)) Base(p, n); }
+
+void StateVector::swap(StateVector& other) {
+	float* p = data();
+	Index n = size();
+	rebind(other.data(), other.size());
+	other.rebind(p, n);
+	std::swap(allocator, other.allocator);
+}
+
+StateVector& StateVector::operator=(const StateVector& other) { return operator=(static_cast<const Base&>(other)); }
+
+StateVector& StateVector::operator=(StateVector&& other) {
+	swap(other);
+	return *this;
+}
+
+void StateVector::resize(Index n) {
+	if (n == size()) return;
+	StateVector result(n, allocator);
+	swap(result);
+}
+
+void StateVector::setZero(Index n) {
+	resize(n);
+	Base::setZero();
+}
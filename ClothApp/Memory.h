@@ -0,0 +1,137 @@
+#pragma once
+#include <Eigen/Dense>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Allocator class
+// Memory of the solver state: system parameters, spring list, solver workspaces and positions.
+// The default allocator is picked at startup, before any system or solver is built, and every
+// buffer keeps the allocator it came from. Allocators have to return memory aligned to at least
+// 16 bytes and must live as long as their buffers.
+class Allocator {
+public:
+	static const size_t CACHE_LINE = 64;
+	static const size_t HUGE_PAGE = 2 << 20;
+
+	virtual ~Allocator() {}
+
+	virtual void* allocate(size_t bytes) = 0; // throws std::bad_alloc
+	virtual void deallocate(void* p, size_t bytes) = 0; // bytes as allocated
+	virtual void prepare(const void* /*p*/, size_t /*bytes*/) {} // memory allocated elsewhere, before its first write
+	virtual std::string name() const = 0;
+
+	// allocator factory, throws for unknown names
+	static Allocator* create(const std::string& name);
+	static std::vector<std::string> available();
+
+	// allocator of new buffers, takes ownership, the previous one stays alive for its buffers
+	static void setDefault(Allocator* allocator);
+	static Allocator& get();
+};
+
+// Cache-line aligned buffers. With first touch every buffer is zeroed by the threads in the
+// static shares the parallel loops over points and springs use, so on a NUMA host the pages a
+// thread works on are placed on its own node. The thread count must not change afterwards.
+class AlignedAllocator : public Allocator {
+protected:
+	size_t alignment;
+	bool first_touch;
+
+	void touch(void* p, size_t bytes) const;
+
+public:
+	AlignedAllocator(size_t alignment = CACHE_LINE, bool first_touch = false);
+
+	virtual void* allocate(size_t bytes);
+	virtual void deallocate(void* p, size_t bytes);
+	virtual std::string name() const;
+};
+
+// Buffers of at least a huge page on 2 MB pages, reserved huge pages if the system has any,
+// transparent huge pages on a 2 MB aligned mapping otherwise. Smaller buffers are cache-line
+// aligned. Memory allocated elsewhere, the factor, is advised to use transparent huge pages.
+// Without mmap (not Linux) everything falls back to aligned buffers.
+class HugePageAllocator : public AlignedAllocator {
+public:
+	HugePageAllocator(bool first_touch = false);
+
+	virtual void* allocate(size_t bytes);
+	virtual void deallocate(void* p, size_t bytes);
+	virtual void prepare(const void* p, size_t bytes);
+	virtual std::string name() const;
+};
+
+// Standard library adapter, containers allocate from the default allocator at construction
+template <typename T>
+struct StateAllocator {
+	typedef T value_type;
+
+	Allocator* allocator;
+
+	StateAllocator() : allocator(&Allocator::get()) {}
+	template <typename U>
+	StateAllocator(const StateAllocator<U>& other) : allocator(other.allocator) {}
+
+	T* allocate(size_t n) { return static_cast<T*>(allocator->allocate(n * sizeof(T))); }
+	void deallocate(T* p, size_t n) { allocator->deallocate(p, n * sizeof(T)); }
+};
+
+template <typename T, typename U>
+bool operator==(const StateAllocator<T>& a, const StateAllocator<U>& b) { return a.allocator == b.allocator; }
+template <typename T, typename U>
+bool operator!=(const StateAllocator<T>& a, const StateAllocator<U>& b) { return a.allocator != b.allocator; }
+
+// Float vector on memory from the default allocator, an Eigen map that owns its buffer.
+// Assigning an expression of another size reallocates from the allocator the vector came from.
+// Moving hands the buffer over and leaves the source empty.
+class StateVector : public Eigen::Map<Eigen::VectorXf, Eigen::Aligned16> {
+public:
+	typedef Eigen::Map<Eigen::VectorXf, Eigen::Aligned16> Base;
+	typedef Eigen::Index Index;
+
+private:
+	Allocator* allocator;
+
+	StateVector(Index n, Allocator* allocator);
+	static float* allocate(Allocator* allocator, Index n);
+	void rebind(float* p, Index n); // points the map at another buffer
+	void swap(StateVector& other);
+
+public:
+	StateVector();
+	explicit StateVector(Index n);
+	StateVector(const StateVector& other);
+	StateVector(StateVector&& other);
+	template <typename Derived>
+	StateVector(const Eigen::DenseBase<Derived>& other);
+	~StateVector();
+
+	StateVector& operator=(const StateVector& other);
+	StateVector& operator=(StateVector&& other);
+	template <typename Derived>
+	StateVector& operator=(const Eigen::DenseBase<Derived>& other);
+
+	void resize(Index n); // contents are kept only if the size stays
+	void setZero(Index n);
+	using Base::setZero;
+};
+
+template <typename Derived>
+StateVector::StateVector(const Eigen::DenseBase<Derived>& other) : StateVector(other.size()) {
+	Base::operator=(other.derived());
+}
+
+template <typename Derived>
+StateVector& StateVector::operator=(const Eigen::DenseBase<Derived>& other) {
+	if (other.size() == size()) {
+		Base::operator=(other.derived());
+		return *this;
+	}
+
+	// the expression may read this vector, evaluate it before the old buffer goes
+	StateVector result(other.size(), allocator);
+	result.Base::operator=(other.derived());
+	swap(result);
+	return *this;
+}
@@ -1,4 +1,8 @@
 #include "Mesh.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <stdexcept>
 
 // M E S H /////////////////////////////////////////////////////////////////////////////////////
 float* Mesh::vbuff() { return VERTEX_DATA(this); }
@@ -12,6 +16,33 @@ unsigned int Mesh::nbuffLen() { return (unsigned int)n_vertices() * 3; }
 unsigned int Mesh::tbuffLen() { return (unsigned int)n_vertices() * 2; }
 unsigned int Mesh::ibuffLen() { return (unsigned int)_ibuff.size(); }
 
+void Mesh::computeNormals(const float* vbuff, unsigned int n_points,
+	const unsigned int* ibuff, unsigned int ibuffLen, float* nbuff) {
+	std::fill(nbuff, nbuff + 3 * n_points, 0.0f);
+	for (unsigned int f = 0; f + 2 < ibuffLen; f += 3) {
+		const float* p0 = &vbuff[3 * ibuff[f + 0]];
+		const float* p1 = &vbuff[3 * ibuff[f + 1]];
+		const float* p2 = &vbuff[3 * ibuff[f + 2]];
+		float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+		float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+		float n[3] = {
+			e1[1] * e2[2] - e1[2] * e2[1],
+			e1[2] * e2[0] - e1[0] * e2[2],
+			e1[0] * e2[1] - e1[1] * e2[0]
+		};
+		float len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (len == 0.0f) continue;
+		for (int v = 0; v < 3; v++)
+			for (int j = 0; j < 3; j++)
+				nbuff[3 * ibuff[f + v] + j] += n[j] / len;
+	}
+	for (unsigned int i = 0; i < 3 * n_points; i += 3) {
+		float len = std::sqrt(nbuff[i] * nbuff[i] + nbuff[i + 1] * nbuff[i + 1] + nbuff[i + 2] * nbuff[i + 2]);
+		if (len == 0.0f) continue;
+		for (int j = 0; j < 3; j++) nbuff[i + j] /= len;
+	}
+}
+
 
 // M E S H  B U I L D E R /////////////////////////////////////////////////////////////////////
 void MeshBuilder::uniformGrid(float w, int n) {
@@ -73,4 +104,124 @@ void MeshBuilder::uniformGrid(float w, int n) {
 	// set index buffer
 	result->useIBuff(ibuff);
 }
+void MeshBuilder::loadObj(const std::string& path) {
+	result = new Mesh;
+
+	// request mesh properties
+	result->request_vertex_normals();
+	result->request_vertex_texcoords2D();
+
+	// read mesh
+	OpenMesh::IO::Options options = OpenMesh::IO::Options::VertexTexCoord;
+	if (!OpenMesh::IO::read_mesh(*result, path, options) || result->n_faces() == 0)
+		throw std::runtime_error("Failed to load mesh " + path);
+
+	// planar texture coordinates if the file has none
+	if (!options.check(OpenMesh::IO::Options::VertexTexCoord)) {
+		OpenMesh::Vec3f lo = result->point(*result->vertices_begin()), hi = lo;
+		for (auto v : result->vertices()) {
+			lo.minimize(result->point(v));
+			hi.maximize(result->point(v));
+		}
+		OpenMesh::Vec3f size = hi - lo;
+		for (auto v : result->vertices()) {
+			OpenMesh::Vec3f p = result->point(v) - lo;
+			result->set_texcoord2D(v, OpenMesh::Vec2f(
+				size[0] > 0 ? p[0] / size[0] : 0.0f, size[1] > 0 ? p[1] / size[1] : 0.0f));
+		}
+	}
+
+	// index buffer
+	std::vector<unsigned int> ibuff;
+	ibuff.reserve(3 * result->n_faces());
+	for (auto f : result->faces())
+		for (auto v : result->fv_range(f))
+			ibuff.push_back(v.idx());
+
+	// calculate normals
+	result->request_face_normals();
+	result->update_normals();
+	result->release_face_normals();
+
+	// set index buffer
+	result->useIBuff(ibuff);
+}
+
+void MeshBuilder::reorder(Mesh* source, const std::vector<unsigned int>& order) {
+	result = new Mesh;
+	const unsigned int n = (unsigned int)source->n_vertices();
+	assert(order.size() == n);
+
+	// request mesh properties
+	result->request_vertex_normals();
+	result->request_vertex_texcoords2D();
+
+	// add vertices in the new order
+	std::vector<unsigned int> rank(n);
+	for (unsigned int i = 0; i < n; i++) {
+		OpenMesh::VertexHandle v = source->vertex_handle(order[i]);
+		OpenMesh::VertexHandle h = result->add_vertex(source->point(v));
+		result->set_texcoord2D(h, source->texcoord2D(v));
+		rank[order[i]] = i;
+	}
+
+	// remap faces
+	unsigned int* sbuff = source->ibuff();
+	std::vector<unsigned int> ibuff(source->ibuffLen());
+	for (unsigned int i = 0; i < ibuff.size(); i++) ibuff[i] = rank[sbuff[i]];
+	for (unsigned int f = 0; f + 2 < ibuff.size(); f += 3) {
+		result->add_face(
+			result->vertex_handle(ibuff[f]),
+			result->vertex_handle(ibuff[f + 1]),
+			result->vertex_handle(ibuff[f + 2])
+		);
+	}
+
+	// calculate normals
+	result->request_face_normals();
+	result->update_normals();
+	result->release_face_normals();
+
+	// set index buffer
+	result->useIBuff(ibuff);
+}
+
+void MeshBuilder::replicate(Mesh* source, unsigned int count, float dx, float dy, float dz) {
+	result = new Mesh;
+	const unsigned int n = (unsigned int)source->n_vertices();
+
+	// request mesh properties
+	result->request_vertex_normals();
+	result->request_vertex_texcoords2D();
+
+	// copy c occupies vertices [c * n, (c + 1) * n), moved by c * (dx, dy, dz)
+	unsigned int* sbuff = source->ibuff();
+	std::vector<unsigned int> ibuff(count * source->ibuffLen());
+	for (unsigned int c = 0; c < count; c++) {
+		const OpenMesh::Vec3f offset(c * dx, c * dy, c * dz);
+		for (unsigned int i = 0; i < n; i++) {
+			OpenMesh::VertexHandle v = source->vertex_handle(i);
+			OpenMesh::VertexHandle h = result->add_vertex(source->point(v) + offset);
+			result->set_texcoord2D(h, source->texcoord2D(v));
+		}
+		for (unsigned int i = 0; i < source->ibuffLen(); i++)
+			ibuff[c * source->ibuffLen() + i] = c * n + sbuff[i];
+	}
+	for (unsigned int f = 0; f + 2 < ibuff.size(); f += 3) {
+		result->add_face(
+			result->vertex_handle(ibuff[f]),
+			result->vertex_handle(ibuff[f + 1]),
+			result->vertex_handle(ibuff[f + 2])
+		);
+	}
+
+	// calculate normals
+	result->request_face_normals();
+	result->update_normals();
+	result->release_face_normals();
+
+	// set index buffer
+	result->useIBuff(ibuff);
+}
+
 Mesh* MeshBuilder::getResult() { return result; }
\ No newline at end of file
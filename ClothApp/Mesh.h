@@ -1,5 +1,7 @@
 #pragma once
+#include <OpenMesh/Core/IO/MeshIO.hh> // must precede the mesh kernel
 #include <OpenMesh/Core/Mesh/TriMesh_ArrayKernelT.hh>
+#include <string>
 #include <vector>
 
 // Mesh type
@@ -30,6 +32,10 @@ public:
 
 	// set index buffer
 	void useIBuff(std::vector<unsigned int>& _ibuff);
+
+	// vertex normals of raw buffers, same scheme as OpenMesh: sum of unit face normals, normalized
+	static void computeNormals(const float* vbuff, unsigned int n_points,
+		const unsigned int* ibuff, unsigned int ibuffLen, float* nbuff);
 };
 
 class MeshBuilder {
@@ -38,5 +44,8 @@ private:
 
 public:
 	void uniformGrid(float w, int n);
+	void loadObj(const std::string& path); // any polygon mesh, faces are triangulated
+	void reorder(Mesh* source, const std::vector<unsigned int>& order); // vertex i is source vertex order[i]
+	void replicate(Mesh* source, unsigned int count, float dx, float dy, float dz); // copies one after another
 	Mesh* getResult();
 };
\ No newline at end of file
@@ -0,0 +1,14 @@
+#include "Parallel.h"
+#include <Eigen/Core>
+
+static bool deterministic_mode = false;
+
+void Parallel::setDeterministic(bool enabled) {
+	deterministic_mode = enabled;
+
+	// the blocking of Eigen's threaded dense products depends on the thread count, 0 restores
+	// its default of all OpenMP threads
+	Eigen::setNbThreads(enabled ? 1 : 0);
+}
+
+bool Parallel::deterministic() { return deterministic_mode; }
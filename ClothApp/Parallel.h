@@ -0,0 +1,48 @@
+#pragma once
+#include <algorithm>
+#include <vector>
+
+// Parallel execution settings of the simulation core
+// Loops over points, springs and triangles write disjoint entries, scatters are gathers over
+// fixed incidence lists, so those results never depend on the thread count. Reductions are the
+// exception: by default every thread adds up its share and the shares are combined as threads
+// finish. In deterministic mode reductions go over fixed blocks of items instead, and the block
+// results are added in block order, so repeated runs are bit-identical at any thread count.
+class Parallel {
+public:
+	static const int BLOCK = 2048; // items per partial result of a deterministic reduction
+
+	static void setDeterministic(bool enabled); // also keeps Eigen's own kernels on one thread
+	static bool deterministic();
+
+	// sum of f(i) over [0, n), f may have side effects on entry i
+	template <typename T, typename F>
+	static T sum(int n, T zero, F f);
+};
+
+template <typename T, typename F>
+T Parallel::sum(int n, T zero, F f) {
+	T total = zero;
+	if (deterministic()) {
+		const int n_blocks = (n + BLOCK - 1) / BLOCK;
+		std::vector<T> partial(n_blocks, zero);
+		#pragma omp parallel for schedule(static)
+		for (int b = 0; b < n_blocks; b++) {
+			T s = zero;
+			for (int i = b * BLOCK; i < std::min(n, (b + 1) * BLOCK); i++) s += f(i);
+			partial[b] = s;
+		}
+		for (const T& s : partial) total += s;
+		return total;
+	}
+
+	#pragma omp parallel
+	{
+		T s = zero;
+		#pragma omp for schedule(static) nowait
+		for (int i = 0; i < n; i++) s += f(i);
+		#pragma omp critical
+		total += s;
+	}
+	return total;
+}
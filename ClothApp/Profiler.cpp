@@ -0,0 +1,130 @@
+#include "Profiler.h"
+#include "LockFree.h"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+// ring capacity per thread and cap on the collected history, in events
+static const unsigned int RING_SIZE = 1 << 14;
+static const size_t MAX_HISTORY = 1 << 20;
+
+struct ProfileRing {
+	SpscQueue<ProfileEvent, RING_SIZE> events;
+	uint32_t thread;
+};
+
+// rings are registered once per thread and never freed, collect() may run after the thread exits
+struct ProfileRegistry {
+	std::mutex lock;
+	std::vector<ProfileRing*> rings;
+	std::vector<ProfileEvent> history;
+	std::atomic<unsigned long long> dropped;
+
+	ProfileRegistry() : dropped(0) {}
+};
+
+static ProfileRegistry& registry() {
+	static ProfileRegistry r;
+	return r;
+}
+
+static ProfileRing* threadRing() {
+	thread_local ProfileRing* ring = nullptr;
+	if (ring == nullptr) {
+		ProfileRegistry& r = registry();
+		std::lock_guard<std::mutex> guard(r.lock);
+		ring = new ProfileRing;
+		ring->thread = (uint32_t)r.rings.size();
+		r.rings.push_back(ring);
+	}
+	return ring;
+}
+
+// P R O F I L E R //////////////////////////////////////////////////////////////////////////////////
+uint64_t Profiler::now() {
+	typedef std::chrono::steady_clock Clock;
+	static const Clock::time_point epoch = Clock::now();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - epoch).count();
+}
+
+void Profiler::record(const char* name, uint64_t start, uint64_t end) {
+	ProfileRing* ring = threadRing();
+	ProfileEvent e = { name, start, end, ring->thread };
+	if (!ring->events.push(e)) registry().dropped++;
+}
+
+void Profiler::collect() {
+	ProfileRegistry& r = registry();
+	std::lock_guard<std::mutex> guard(r.lock);
+	ProfileEvent e;
+	for (ProfileRing* ring : r.rings) {
+		while (ring->events.pop(e)) {
+			if (r.history.size() < MAX_HISTORY) r.history.push_back(e);
+			else r.dropped++;
+		}
+	}
+}
+
+std::vector<ProfileStats> Profiler::stats() {
+	collect();
+	ProfileRegistry& r = registry();
+	std::map<std::string, std::vector<double> > durations;
+	{
+		std::lock_guard<std::mutex> guard(r.lock);
+		for (const ProfileEvent& e : r.history)
+			durations[e.name].push_back((e.end - e.start) * 1e-6);
+	}
+
+	// nearest rank percentiles
+	std::vector<ProfileStats> result;
+	for (auto& d : durations) {
+		std::vector<double>& v = d.second;
+		std::sort(v.begin(), v.end());
+		auto rank = [&](double p) { return v[std::min(v.size() - 1, (size_t)(p * v.size()))]; };
+		ProfileStats s = { d.first, v.size(), v.front(), rank(0.5), rank(0.99), v.back() };
+		result.push_back(s);
+	}
+	return result;
+}
+
+std::vector<double> Profiler::durations(const std::string& name) {
+	collect();
+	ProfileRegistry& r = registry();
+	std::vector<double> result;
+	std::lock_guard<std::mutex> guard(r.lock);
+	for (const ProfileEvent& e : r.history)
+		if (name == e.name) result.push_back((e.end - e.start) * 1e-6);
+	return result;
+}
+
+void Profiler::writeChromeTrace(const std::string& path) {
+	collect();
+	std::ofstream out(path);
+	if (!out) throw std::runtime_error("Failed to open trace file " + path);
+
+	// complete events, timestamps in microseconds
+	ProfileRegistry& r = registry();
+	std::lock_guard<std::mutex> guard(r.lock);
+	out << "{\"traceEvents\":[";
+	for (size_t i = 0; i < r.history.size(); i++) {
+		const ProfileEvent& e = r.history[i];
+		out << (i ? ",\n" : "\n") << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":"
+			<< e.thread << ",\"ts\":" << e.start / 1000 << "." << e.start % 1000 / 100
+			<< ",\"dur\":" << (e.end - e.start) / 1000 << "." << (e.end - e.start) % 1000 / 100 << "}";
+	}
+	out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+	if (!out) throw std::runtime_error("Failed to write trace file " + path);
+}
+
+void Profiler::clear() {
+	collect();
+	ProfileRegistry& r = registry();
+	std::lock_guard<std::mutex> guard(r.lock);
+	r.history.clear();
+	r.dropped = 0;
+}
+
+unsigned long long Profiler::droppedEvents() { return registry().dropped; }
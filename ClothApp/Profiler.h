@@ -0,0 +1,66 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Scoped timing probes
+// PROFILE_SCOPE("name") times the enclosing scope. Probes compile to nothing unless
+// FMS_PROFILING is defined (cmake -DFMS_PROFILING=ON). Each thread records into its own
+// lock-free ring, the rings are drained by collect(), stats() and writeChromeTrace(). A full ring
+// drops new events, so long runs have to call collect() regularly, the app does once per frame.
+// The collected history is capped too, events past the cap are counted as dropped as well.
+#ifdef FMS_PROFILING
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#endif
+
+// one completed scope
+struct ProfileEvent {
+	const char* name; // string literal, compared by address
+	uint64_t start; // ns since the profiler epoch
+	uint64_t end;
+	uint32_t thread; // registration order of the recording thread
+};
+
+// per-phase duration statistics in milliseconds
+struct ProfileStats {
+	std::string name;
+	unsigned long long count;
+	double min, p50, p99, max;
+};
+
+class Profiler {
+public:
+#ifdef FMS_PROFILING
+	static const bool enabled = true;
+#else
+	static const bool enabled = false;
+#endif
+
+	// hot path, records into the calling thread's ring, drops the event when it is full
+	static void record(const char* name, uint64_t start, uint64_t end);
+	static uint64_t now();
+
+	// drain every thread's ring into the collected history
+	static void collect();
+	static std::vector<ProfileStats> stats(); // sorted by name
+	static std::vector<double> durations(const std::string& name); // ms per collected scope, in order
+	static void writeChromeTrace(const std::string& path); // throws if the file can't be written
+	static void clear();
+
+	static unsigned long long droppedEvents();
+};
+
+class ProfileScope {
+private:
+	const char* name;
+	uint64_t start;
+
+public:
+	ProfileScope(const char* name) : name(name), start(Profiler::now()) {}
+	~ProfileScope() { Profiler::record(name, start, Profiler::now()); }
+};
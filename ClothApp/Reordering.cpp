@@ -0,0 +1,178 @@
+#include "Reordering.h"
+#include <algorithm>
+#include <numeric>
+#include <utility>
+
+// R E O R D E R I N G //////////////////////////////////////////////////////////////////////////////
+void VertexReordering::setOrder(const IndexList& order) {
+	this->order = order;
+	rank.resize(order.size());
+	for (unsigned int i = 0; i < order.size(); i++) rank[order[i]] = i;
+	springOrder.clear();
+	springRank.clear();
+}
+
+void VertexReordering::identity(unsigned int n_points) {
+	IndexList o(n_points);
+	std::iota(o.begin(), o.end(), 0);
+	setOrder(o);
+}
+
+void VertexReordering::reverseCuthillMcKee(unsigned int n_points,
+	const unsigned int* ibuff, unsigned int ibuffLen) {
+	// adjacency from triangle edges in compressed rows, duplicates removed
+	IndexList start(n_points + 1, 0), adj;
+	{
+		EdgeList edges;
+		edges.reserve(2 * ibuffLen);
+		for (unsigned int f = 0; f + 2 < ibuffLen; f += 3) {
+			for (int j = 0; j < 3; j++) {
+				unsigned int a = ibuff[f + j], b = ibuff[f + (j + 1) % 3];
+				edges.push_back(Edge(a, b));
+				edges.push_back(Edge(b, a));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+		adj.reserve(edges.size());
+		for (Edge& e : edges) {
+			start[e.first + 1]++;
+			adj.push_back(e.second);
+		}
+		for (unsigned int i = 0; i < n_points; i++) start[i + 1] += start[i];
+	}
+	auto degree = [&](unsigned int i) { return start[i + 1] - start[i]; };
+
+	IndexList o;
+	o.reserve(n_points);
+	std::vector<bool> visited(n_points, false);
+
+	// breadth-first search from root, appends to o, returns the last point reached
+	auto bfs = [&](unsigned int root, IndexList& out) {
+		size_t head = out.size();
+		out.push_back(root);
+		visited[root] = true;
+		while (head < out.size()) {
+			unsigned int i = out[head++];
+			size_t first = out.size();
+			for (unsigned int k = start[i]; k < start[i + 1]; k++) {
+				if (visited[adj[k]]) continue;
+				visited[adj[k]] = true;
+				out.push_back(adj[k]);
+			}
+			std::sort(out.begin() + first, out.end(),
+				[&](unsigned int a, unsigned int b) { return degree(a) < degree(b); });
+		}
+		return out.back();
+	};
+
+	// every connected component, lowest degree point first
+	IndexList byDegree(n_points);
+	std::iota(byDegree.begin(), byDegree.end(), 0);
+	std::stable_sort(byDegree.begin(), byDegree.end(),
+		[&](unsigned int a, unsigned int b) { return degree(a) < degree(b); });
+
+	IndexList sweep;
+	for (unsigned int root : byDegree) {
+		if (visited[root]) continue;
+
+		// one extra sweep moves the root towards the periphery of the component
+		sweep.clear();
+		unsigned int periphery = bfs(root, sweep);
+		for (unsigned int i : sweep) visited[i] = false;
+		bfs(periphery, o);
+	}
+
+	std::reverse(o.begin(), o.end());
+	setOrder(o);
+}
+
+void VertexReordering::morton(const float* vbuff, unsigned int n_points) {
+	// bounding box
+	float lo[3] = { 0, 0, 0 }, hi[3] = { 0, 0, 0 };
+	for (unsigned int i = 0; i < n_points; i++) {
+		for (int j = 0; j < 3; j++) {
+			float p = vbuff[3 * i + j];
+			if (i == 0 || p < lo[j]) lo[j] = p;
+			if (i == 0 || p > hi[j]) hi[j] = p;
+		}
+	}
+
+	// 10 bits per axis, interleaved
+	auto spread = [](unsigned int x) {
+		x = (x | (x << 16)) & 0x030000FF;
+		x = (x | (x << 8)) & 0x0300F00F;
+		x = (x | (x << 4)) & 0x030C30C3;
+		x = (x | (x << 2)) & 0x09249249;
+		return x;
+	};
+	std::vector<std::pair<unsigned int, unsigned int> > codes(n_points);
+	for (unsigned int i = 0; i < n_points; i++) {
+		unsigned int code = 0;
+		for (int j = 0; j < 3; j++) {
+			float extent = hi[j] - lo[j];
+			float t = extent > 0 ? (vbuff[3 * i + j] - lo[j]) / extent : 0.0f;
+			code |= spread((unsigned int)(t * 1023.0f)) << j;
+		}
+		codes[i] = std::make_pair(code, i);
+	}
+	std::sort(codes.begin(), codes.end());
+
+	IndexList o(n_points);
+	for (unsigned int i = 0; i < n_points; i++) o[i] = codes[i].second;
+	setOrder(o);
+}
+
+mass_spring_system* VertexReordering::apply(const mass_spring_system* system) {
+	assert(order.size() == system->n_points);
+	const unsigned int n = system->n_points, m = system->n_springs;
+
+	// relabel endpoints, lower index first
+	EdgeList relabeled(m);
+	for (unsigned int k = 0; k < m; k++) {
+		unsigned int a = rank[system->spring_list[k].first];
+		unsigned int b = rank[system->spring_list[k].second];
+		relabeled[k] = a < b ? Edge(a, b) : Edge(b, a);
+	}
+
+	// sort springs by endpoints
+	springOrder.resize(m);
+	std::iota(springOrder.begin(), springOrder.end(), 0);
+	std::stable_sort(springOrder.begin(), springOrder.end(),
+		[&](unsigned int a, unsigned int b) { return relabeled[a] < relabeled[b]; });
+	springRank.resize(m);
+	for (unsigned int k = 0; k < m; k++) springRank[springOrder[k]] = k;
+
+	mass_spring_system::EdgeList spring_list(m);
+	StateVector rest_lengths(m), stiffnesses(m);
+	for (unsigned int k = 0; k < m; k++) {
+		spring_list[k] = relabeled[springOrder[k]];
+		rest_lengths[k] = system->rest_lengths[springOrder[k]];
+		stiffnesses[k] = system->stiffnesses[springOrder[k]];
+	}
+
+	// permute per-point data
+	StateVector masses(n), fext(3 * n);
+	for (unsigned int i = 0; i < n; i++) {
+		masses[i] = system->masses[order[i]];
+		fext.segment<3>(3 * i) = system->fext.segment<3>(3 * order[i]);
+	}
+
+	return new mass_spring_system(n, m, system->time_step, std::move(spring_list),
+		std::move(rest_lengths), std::move(stiffnesses), std::move(masses), std::move(fext),
+		system->damping_factor);
+}
+
+unsigned int VertexReordering::toNew(unsigned int i) const { return rank[i]; }
+unsigned int VertexReordering::toOld(unsigned int i) const { return order[i]; }
+
+VertexReordering::IndexList VertexReordering::springsToNew(const IndexList& springs) const {
+	// identity until apply() has sorted springs
+	if (springRank.empty()) return springs;
+	IndexList result(springs.size());
+	for (unsigned int k = 0; k < springs.size(); k++) result[k] = springRank[springs[k]];
+	return result;
+}
+
+const VertexReordering::IndexList& VertexReordering::getOrder() const { return order; }
+const VertexReordering::IndexList& VertexReordering::getRank() const { return rank; }
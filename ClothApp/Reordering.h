@@ -0,0 +1,38 @@
+#pragma once
+#include <vector>
+
+#include "MassSpringSolver.h"
+
+// Vertex Reordering class
+// Permutes points for memory locality and sorts springs by their endpoints. The old
+// (build order) index of every point and spring is kept so pins, picking and any other
+// index produced by the builders can be mapped onto the reordered system.
+class VertexReordering {
+private:
+	typedef std::vector<unsigned int> IndexList;
+	typedef std::pair<unsigned int, unsigned int> Edge;
+	typedef std::vector<Edge> EdgeList;
+
+	IndexList order; // new point index -> old point index
+	IndexList rank; // old point index -> new point index
+	IndexList springOrder; // new spring index -> old spring index
+	IndexList springRank; // old spring index -> new spring index
+
+	void setOrder(const IndexList& order);
+
+public:
+	// point orderings
+	void identity(unsigned int n_points);
+	void reverseCuthillMcKee(unsigned int n_points, const unsigned int* ibuff, unsigned int ibuffLen);
+	void morton(const float* vbuff, unsigned int n_points);
+
+	// reorder system points and sort springs, fills the spring permutation
+	mass_spring_system* apply(const mass_spring_system* system);
+
+	// index mapping
+	unsigned int toNew(unsigned int i) const; // old point index -> new
+	unsigned int toOld(unsigned int i) const; // new point index -> old
+	IndexList springsToNew(const IndexList& springs) const; // old spring indices -> new
+	const IndexList& getOrder() const;
+	const IndexList& getRank() const;
+};
@@ -0,0 +1,168 @@
+#include "Scene.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+// S C E N E ////////////////////////////////////////////////////////////////////////////////////////
+ClothScene::ClothScene() : scene_system(nullptr), stats() {}
+
+ClothScene::~ClothScene() {
+	for (Object& o : objects) {
+		delete o.solver;
+		delete o.system;
+	}
+	delete scene_system;
+}
+
+unsigned int ClothScene::addObject(mass_spring_system* system) {
+	if (scene_system != nullptr) throw std::runtime_error("Scene is already built.");
+	if (!objects.empty() && (system->time_step != objects[0].system->time_step
+		|| system->damping_factor != objects[0].system->damping_factor))
+		throw std::runtime_error("Scene objects need the same time step and damping.");
+
+	Object o = { system, nullptr, 0, 0, false };
+	if (!objects.empty()) {
+		const Object& last = objects.back();
+		o.point_offset = last.point_offset + last.system->n_points;
+		o.spring_offset = last.spring_offset + last.system->n_springs;
+	}
+	objects.push_back(o);
+	return (unsigned int)objects.size() - 1;
+}
+
+void ClothScene::build(float* vbuff, const std::string& backend) {
+	if (objects.empty()) throw std::runtime_error("Scene has no objects.");
+	const Object& last = objects.back();
+	unsigned int n_points = last.point_offset + last.system->n_points;
+	unsigned int n_springs = last.spring_offset + last.system->n_springs;
+
+	// concatenate the objects, spring endpoints move by the point offsets
+	mass_spring_system::EdgeList spring_list(n_springs);
+	StateVector rest_lengths(n_springs), stiffnesses(n_springs);
+	StateVector masses(n_points), fext(3 * n_points);
+	for (const Object& o : objects) {
+		const mass_spring_system* s = o.system;
+		for (unsigned int k = 0; k < s->n_springs; k++) {
+			spring_list[o.spring_offset + k] = mass_spring_system::Edge(
+				s->spring_list[k].first + o.point_offset, s->spring_list[k].second + o.point_offset);
+		}
+		rest_lengths.segment(o.spring_offset, s->n_springs) = s->rest_lengths;
+		stiffnesses.segment(o.spring_offset, s->n_springs) = s->stiffnesses;
+		masses.segment(o.point_offset, s->n_points) = s->masses;
+		fext.segment(3 * o.point_offset, 3 * s->n_points) = s->fext;
+	}
+	scene_system = new mass_spring_system(n_points, n_springs, objects[0].system->time_step,
+		std::move(spring_list), std::move(rest_lengths), std::move(stiffnesses), std::move(masses),
+		std::move(fext), objects[0].system->damping_factor);
+
+	// factor the blocks concurrently, exceptions cannot leave the parallel region
+	PROFILE_SCOPE("sceneFactor");
+	std::vector<std::exception_ptr> errors(objects.size());
+	#pragma omp parallel for schedule(dynamic, 1)
+	for (int i = 0; i < (int)objects.size(); i++) {
+		Object& o = objects[i];
+		try {
+			o.solver = new MassSpringSolver(o.system, vbuff + 3 * o.point_offset,
+				LinearSolver::create(backend));
+		}
+		catch (...) {
+			errors[i] = std::current_exception();
+		}
+	}
+	for (std::exception_ptr& e : errors)
+		if (e) std::rethrow_exception(e);
+}
+
+mass_spring_system* ClothScene::system() { return scene_system; }
+unsigned int ClothScene::nObjects() const { return (unsigned int)objects.size(); }
+unsigned int ClothScene::pointOffset(unsigned int object) const { return objects[object].point_offset; }
+unsigned int ClothScene::springOffset(unsigned int object) const { return objects[object].spring_offset; }
+unsigned int ClothScene::nPoints(unsigned int object) const { return objects[object].system->n_points; }
+
+void ClothScene::solve(unsigned int n) {
+	PROFILE_SCOPE("sceneSolve");
+
+	// every block picks up its external forces, then solves on its own
+	#pragma omp parallel for schedule(dynamic, 1)
+	for (int i = 0; i < (int)objects.size(); i++) {
+		Object& o = objects[i];
+		if (o.asleep) continue;
+		o.system->fext = scene_system->fext.segment(3 * o.point_offset, 3 * o.system->n_points);
+		o.solver->solve(n);
+	}
+
+	// worst awake block, the last stats stay if every block sleeps
+	bool first = true;
+	for (const Object& o : objects) {
+		if (o.asleep) continue;
+		const SolverStats& s = o.solver->getStats();
+		if (first) stats = s;
+		else {
+			stats.iterations = std::max(stats.iterations, s.iterations);
+			stats.objective += s.objective;
+			stats.residual = std::max(stats.residual, s.residual);
+			stats.converged = stats.converged && s.converged;
+		}
+		first = false;
+	}
+}
+
+void ClothScene::setAsleep(unsigned int object, bool asleep) { objects[object].asleep = asleep; }
+float ClothScene::kineticEnergy(unsigned int object) const { return objects[object].solver->kineticEnergy(); }
+
+void ClothScene::setTolerance(float tolerance) {
+	for (Object& o : objects) o.solver->setTolerance(tolerance);
+}
+
+void ClothScene::setStrainLimit(float tau, float weight, const std::vector<unsigned int>& springs) {
+	// every block refactors, concurrently as in build()
+	std::vector<std::exception_ptr> errors(objects.size());
+	#pragma omp parallel for schedule(dynamic, 1)
+	for (int i = 0; i < (int)objects.size(); i++) {
+		try {
+			objects[i].solver->setStrainLimit(tau, weight, springs);
+		}
+		catch (...) {
+			errors[i] = std::current_exception();
+		}
+	}
+	for (std::exception_ptr& e : errors)
+		if (e) std::rethrow_exception(e);
+}
+
+void ClothScene::scaleStiffness(float factor) {
+	std::vector<std::exception_ptr> errors(objects.size());
+	#pragma omp parallel for schedule(dynamic, 1)
+	for (int i = 0; i < (int)objects.size(); i++) {
+		try {
+			const mass_spring_system* s = objects[i].system;
+			objects[i].solver->setParameters(factor * s->stiffnesses, s->masses, s->time_step);
+		}
+		catch (...) {
+			errors[i] = std::current_exception();
+		}
+	}
+	for (std::exception_ptr& e : errors)
+		if (e) std::rethrow_exception(e);
+
+	// constraint nodes on the scene system see the new stiffnesses too
+	scene_system->stiffnesses *= factor;
+}
+
+const SolverStats& ClothScene::getStats() const { return stats; }
+
+size_t ClothScene::memoryUsage() const {
+	size_t bytes = sizeof(*this) + (scene_system ? scene_system->memoryUsage() : 0);
+	for (const Object& o : objects)
+		bytes += o.system->memoryUsage() + (o.solver ? o.solver->memoryUsage() : 0);
+	return bytes;
+}
+
+void ClothScene::saveState(std::ostream& out) const {
+	for (const Object& o : objects) o.solver->saveState(out);
+}
+
+void ClothScene::loadState(std::istream& in) {
+	for (Object& o : objects) o.solver->loadState(in);
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "MassSpringSolver.h"
+
+// Cloth Scene class
+// Several cloth objects simulated in one vertex buffer. Every object is an independent block
+// of the global step with its own factorization, blocks are factored and solved concurrently.
+// The scene system concatenates all objects, constraint graph nodes built on it see every
+// point and spring, so constraints and collisions can span objects.
+class ClothScene {
+private:
+	struct Object {
+		mass_spring_system* system; // block system, owned
+		MassSpringSolver* solver; // maps the block's points in the scene buffer, owned
+		unsigned int point_offset; // first point in the scene system
+		unsigned int spring_offset; // first spring in the scene system
+		bool asleep; // skipped by solve()
+	};
+
+	std::vector<Object> objects;
+	mass_spring_system* scene_system; // all objects, owned
+	SolverStats stats;
+
+public:
+	ClothScene();
+	~ClothScene();
+
+	// setup, objects are laid out in the order they are added
+	unsigned int addObject(mass_spring_system* system); // takes ownership, returns the object index
+	void build(float* vbuff, const std::string& backend); // factor every block, vbuff holds all objects
+
+	mass_spring_system* system(); // scene system, external forces written here reach every block
+	unsigned int nObjects() const;
+	unsigned int pointOffset(unsigned int object) const;
+	unsigned int springOffset(unsigned int object) const;
+	unsigned int nPoints(unsigned int object) const;
+
+	// solve iterations on every block that is awake
+	void solve(unsigned int n);
+
+	// rest detection, a sleeping block keeps its state until woken
+	void setAsleep(unsigned int object, bool asleep);
+	float kineticEnergy(unsigned int object) const;
+
+	void setTolerance(float tolerance);
+	void setStrainLimit(float tau, float weight, const std::vector<unsigned int>& springs); // object spring indices, every block
+	void scaleStiffness(float factor); // every spring of every block and the scene system, refactors
+	const SolverStats& getStats() const; // worst awake block, objectives summed
+
+	size_t memoryUsage() const;
+
+	void saveState(std::ostream& out) const;
+	void loadState(std::istream& in);
+};
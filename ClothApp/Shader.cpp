@@ -173,18 +173,3 @@ void PhongShader::setLight(const glm::vec3& light) {
 	glUniform3f(uLight, light[0], light[1], light[2]);
 	glUseProgram(0);
 }
-
-
-PickShader::PickShader() : GLProgram() {}
-
-void PickShader::postLink() {
-	// get uniforms
-	uTessFact = glGetUniformLocation(handle, "uTessFact");
-}
-
-void PickShader::setTessFact(unsigned int n) {
-	assert(uTessFact >= 0);
-	glUseProgram(*this);
-	glUniform1i(uTessFact, n);
-	glUseProgram(0);
-}
\ No newline at end of file
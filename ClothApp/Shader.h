@@ -73,15 +73,4 @@ public:
 	void setAlbedo(const glm::vec3& albedo);
 	void setAmbient(const glm::vec3& ambient);
 	void setLight(const glm::vec3& light);
-};
-
-
-class PickShader : public GLProgram {
-private:
-	GLuint uTessFact;
-
-public:
-	PickShader();
-	virtual void postLink();
-	void setTessFact(unsigned int n);
 };
\ No newline at end of file
@@ -0,0 +1,343 @@
+#include "SimulationThread.h"
+#include "Mesh.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+// checkpoint file header
+static const char CHECKPOINT_MAGIC[8] = { 'F', 'M', 'S', 'C', 'K', 'P', 'T', '\0' };
+static const unsigned int CHECKPOINT_VERSION = 1;
+
+// S I M U L A T I O N  T H R E A D /////////////////////////////////////////////////////////////////
+SimulationThread::SimulationThread(const float* vbuff, unsigned int vbuffLen,
+	const unsigned int* ibuff, unsigned int ibuffLen)
+	: positions(vbuff, vbuff + vbuffLen), prev_positions(positions),
+	render_positions(positions.begin(), positions.end()),
+	normals(vbuffLen, 0.0f), ibuff(ibuff, ibuff + ibuffLen), lod(0),
+	solver(nullptr), scene(nullptr), cgRoot(nullptr), userFixer(nullptr), aerodynamics(nullptr),
+	recorder(nullptr), server(nullptr), resting(false), n_iter(1), time_step(0.008f), max_substeps(4),
+	frame_ms(16), accumulator(0.0), stats(), running(false) {
+	SimulationFrame initial;
+	initial.vbuff = render_positions;
+	initial.lod = 0;
+	initial.index = 0;
+	initial.stats = stats;
+	updateNormals(render_positions, this->ibuff);
+	initial.nbuff = normals;
+	frames.fill(initial);
+}
+
+SimulationThread::~SimulationThread() { stop(); }
+
+float* SimulationThread::vbuff() { return &positions[0]; }
+const float* SimulationThread::prevVbuff() { return &prev_positions[0]; }
+
+void SimulationThread::setSolver(MassSpringSolver* solver, unsigned int n_iter) {
+	this->solver = solver;
+	this->n_iter = n_iter;
+}
+void SimulationThread::setScene(ClothScene* scene, unsigned int n_iter) {
+	this->scene = scene;
+	this->n_iter = n_iter;
+}
+void SimulationThread::setTimeStep(float time_step) { this->time_step = time_step; }
+void SimulationThread::setMaxSubsteps(unsigned int max_substeps) { this->max_substeps = max_substeps; }
+void SimulationThread::setConstraintGraph(CgNode* root) { cgRoot = root; }
+void SimulationThread::setUserFixer(CgPointFixNode* fixer) { userFixer = fixer; }
+void SimulationThread::setAerodynamics(AerodynamicForce* aerodynamics) { this->aerodynamics = aerodynamics; }
+void SimulationThread::setFramePeriod(unsigned int ms) { frame_ms = ms; }
+void SimulationThread::setRecorder(TrajectoryWriter* recorder) { this->recorder = recorder; }
+void SimulationThread::setFrameServer(FrameServer* server) { this->server = server; }
+void SimulationThread::setCheckpointPath(const std::string& path) { checkpoint_path = path; }
+void SimulationThread::setSleeping(float energy, unsigned int frames) { sleep.setThreshold(energy, frames); }
+
+unsigned int SimulationThread::addDetailLevel(MeshEmbedding* embedding) {
+	levels.push_back(embedding);
+	return (unsigned int)levels.size();
+}
+
+void SimulationThread::start() {
+	assert(solver != nullptr || scene != nullptr);
+	if (running) return;
+
+	// cloths of a scene are independent blocks, each sleeps on its own
+	if (sleep.nIslands() == 0) {
+		if (scene != nullptr) {
+			for (unsigned int i = 0; i < scene->nObjects(); i++)
+				sleep.addIsland(scene->pointOffset(i), scene->nPoints(i));
+		}
+		else sleep.addIsland(0, solver->getSystem().n_points);
+	}
+	running = true;
+	worker = std::thread(&SimulationThread::run, this);
+}
+
+void SimulationThread::stop() {
+	running = false;
+	if (worker.joinable()) worker.join();
+}
+
+void SimulationThread::run() {
+	typedef std::chrono::steady_clock Clock;
+	typedef std::chrono::duration<double> Seconds;
+	Clock::time_point last = Clock::now();
+	Clock::time_point next = last;
+	while (running) {
+		// feed the real time since the last frame to the scheduler
+		Clock::time_point now = Clock::now();
+		advance(Seconds(now - last).count());
+		last = now;
+
+		// keep the frame period, skip ahead if we fell behind
+		next += std::chrono::milliseconds(frame_ms);
+		now = Clock::now();
+		if (next < now) next = now;
+		std::this_thread::sleep_until(next);
+	}
+}
+
+void SimulationThread::advance(double elapsed) {
+	typedef std::chrono::steady_clock Clock;
+	typedef std::chrono::duration<float, std::milli> Milliseconds;
+	Clock::time_point start = Clock::now();
+	PROFILE_SCOPE("frame");
+
+	processCommands();
+	if (sleep.enabled()) wakeIslands();
+	const bool asleep = sleep.allAsleep();
+
+	// run as many time steps as fit into the accumulated time, up to the catch-up limit
+	accumulator += elapsed;
+	unsigned int n = 0;
+	while (accumulator >= time_step && n < max_substeps) {
+		substep();
+		accumulator -= time_step;
+		n++;
+	}
+	if (sleep.enabled() && n > 0) sleepIslands();
+	stats.asleep = sleep.nAsleep();
+
+	// drop what we could not catch up on, the simulation runs slower than real time
+	if (accumulator >= time_step) {
+		unsigned long long dropped = (unsigned long long)(accumulator / time_step);
+		accumulator -= dropped * (double)time_step;
+		stats.dropped += dropped;
+	}
+
+	// nothing moved since the last published frame, it stays on screen, the recording goes on
+	if (asleep && resting) {
+		stats.slept++;
+		if (recorder != nullptr) recorder->push(&render_positions[0]);
+		return;
+	}
+	resting = sleep.allAsleep();
+
+	// render positions between the last two states
+	float alpha = (float)(accumulator / time_step);
+	for (unsigned int i = 0; i < positions.size(); i++)
+		render_positions[i] = prev_positions[i] + alpha * (positions[i] - prev_positions[i]);
+
+	// embed the selected detail level
+	SimulationFrame& frame = frames.backBuffer();
+	frame.lod = lod;
+	if (lod == 0) {
+		frame.vbuff.assign(render_positions.begin(), render_positions.end());
+		updateNormals(frame.vbuff, ibuff);
+	}
+	else {
+		const MeshEmbedding* level = levels[lod - 1];
+		frame.vbuff.resize(3 * level->nPoints());
+		level->apply(&render_positions[0], &frame.vbuff[0]);
+		updateNormals(frame.vbuff, level->indices());
+	}
+
+	// statistics
+	float ms = Milliseconds(Clock::now() - start).count();
+	stats.frames++;
+	stats.substeps += n;
+	stats.frame_substeps = n;
+	stats.frame_ms = ms;
+	stats.substep_ms = n > 0 ? ms / n : 0.0f;
+	stats.mean_frame_ms = stats.frames == 1 ? ms : 0.95f * stats.mean_frame_ms + 0.05f * ms;
+	stats.max_frame_ms = std::max(stats.max_frame_ms, ms);
+	stats.alpha = alpha;
+
+	publishFrame();
+}
+
+void SimulationThread::substep() {
+	PROFILE_SCOPE("substep");
+
+	// external forces from q(n) and q(n - 1)
+	if (aerodynamics != nullptr)
+		aerodynamics->apply(&positions[0], &prev_positions[0], (float)stats.sim_time);
+	std::copy(positions.begin(), positions.end(), prev_positions.begin());
+
+	// the forces above can still wake a sleeping cloth in the next frame
+	if (sleep.allAsleep()) {
+		stats.sim_time += time_step;
+		return;
+	}
+
+	if (scene != nullptr) {
+		for (unsigned int i = 0; i < sleep.nIslands(); i++) scene->setAsleep(i, sleep.asleep(i));
+		scene->solve(n_iter);
+	}
+	else solver->solve(n_iter);
+	const SolverStats& solverStats = scene != nullptr ? scene->getStats() : solver->getStats();
+	stats.solver_iterations = solverStats.iterations;
+	stats.residual = solverStats.residual;
+
+	// satisfy constraints
+	if (cgRoot != nullptr) {
+		CgSatisfyVisitor visitor;
+		visitor.satisfy(*cgRoot);
+	}
+	stats.sim_time += time_step;
+}
+
+const float* SimulationThread::externalForces() {
+	return scene != nullptr ? scene->system()->fext.data() : solver->getSystem().fext.data();
+}
+
+void SimulationThread::wakeIslands() {
+	colliders.clear();
+	if (cgRoot != nullptr) {
+		CgBoundsVisitor visitor;
+		visitor.collect(*cgRoot, colliders);
+	}
+	sleep.check(externalForces(), colliders);
+}
+
+void SimulationThread::sleepIslands() {
+	for (unsigned int i = 0; i < sleep.nIslands(); i++) {
+		if (sleep.asleep(i)) continue;
+		float energy = scene != nullptr ? scene->kineticEnergy(i) : solver->kineticEnergy();
+		sleep.update(i, energy, &positions[0], externalForces());
+	}
+
+	// no interpolation towards the last step, the rest pose is what stays on screen
+	if (sleep.allAsleep()) std::copy(positions.begin(), positions.end(), prev_positions.begin());
+}
+
+void SimulationThread::processCommands() {
+	SimulationCommand c;
+	while (commands.pop(c)) {
+		bool isUserCommand = c.type == SimulationCommand::GRAB
+			|| c.type == SimulationCommand::MOVE || c.type == SimulationCommand::RELEASE;
+		if (isUserCommand && userFixer == nullptr) continue;
+		if (isUserCommand) sleep.wakePoint(c.i);
+		switch (c.type) {
+		case SimulationCommand::GRAB:
+			userFixer->fixPoint(c.i);
+			break;
+		case SimulationCommand::MOVE:
+			userFixer->releasePoint(c.i);
+			for (int j = 0; j < 3; j++)
+				positions[3 * c.i + j] += c.v[j];
+			userFixer->fixPoint(c.i);
+			break;
+		case SimulationCommand::RELEASE:
+			userFixer->releasePoint(c.i);
+			break;
+		case SimulationCommand::SET_LOD:
+			if (c.i >= 0 && c.i <= (int)levels.size()) lod = c.i;
+			resting = false;
+			break;
+		case SimulationCommand::SCALE_STIFFNESS:
+			sleep.wakeAll();
+			// refactors on the pattern analyzed at startup, every block of a scene
+			if (scene != nullptr) scene->scaleStiffness(c.v[0]);
+			else if (solver != nullptr) {
+				const mass_spring_system& system = solver->getSystem();
+				solver->setParameters(c.v[0] * system.stiffnesses, system.masses, system.time_step);
+			}
+			break;
+		case SimulationCommand::SAVE_CHECKPOINT:
+		case SimulationCommand::LOAD_CHECKPOINT:
+			if (c.type == SimulationCommand::LOAD_CHECKPOINT) sleep.wakeAll();
+			// a bad checkpoint must not take down the simulation thread
+			try {
+				if (c.type == SimulationCommand::SAVE_CHECKPOINT) saveCheckpoint();
+				else loadCheckpoint();
+			}
+			catch (const std::runtime_error& e) {
+				std::cerr << "Checkpoint failed: " << e.what() << std::endl;
+			}
+			break;
+		}
+	}
+}
+
+void SimulationThread::saveCheckpoint() {
+	std::ofstream out(checkpoint_path, std::ios::binary);
+	if (!out) throw std::runtime_error("Failed to open checkpoint file " + checkpoint_path);
+
+	out.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+	out.write((const char*)&CHECKPOINT_VERSION, sizeof(CHECKPOINT_VERSION));
+	out.write((const char*)&stats.sim_time, sizeof(stats.sim_time));
+	if (scene != nullptr) scene->saveState(out);
+	else solver->saveState(out);
+	if (cgRoot != nullptr) {
+		CgSaveStateVisitor visitor;
+		visitor.save(*cgRoot, out);
+	}
+	if (!out) throw std::runtime_error("Failed to write checkpoint file " + checkpoint_path);
+}
+
+void SimulationThread::loadCheckpoint() {
+	std::ifstream in(checkpoint_path, std::ios::binary);
+	if (!in) throw std::runtime_error("Failed to open checkpoint file " + checkpoint_path);
+
+	char magic[sizeof(CHECKPOINT_MAGIC)];
+	unsigned int version;
+	in.read(magic, sizeof(magic));
+	in.read((char*)&version, sizeof(version));
+	if (!in || std::memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0
+		|| version != CHECKPOINT_VERSION)
+		throw std::runtime_error("Invalid checkpoint file " + checkpoint_path);
+
+	double sim_time;
+	in.read((char*)&sim_time, sizeof(sim_time));
+	if (scene != nullptr) scene->loadState(in);
+	else solver->loadState(in);
+	if (cgRoot != nullptr) {
+		CgLoadStateVisitor visitor;
+		visitor.load(*cgRoot, in);
+	}
+
+	// restart interpolation from the restored state
+	std::copy(positions.begin(), positions.end(), prev_positions.begin());
+	stats.sim_time = sim_time;
+	accumulator = 0.0;
+}
+
+void SimulationThread::updateNormals(const Buffer& points, const IndexBuffer& ibuff) {
+	PROFILE_SCOPE("updateNormals");
+	normals.resize(points.size());
+	Mesh::computeNormals(points.data(), (unsigned int)points.size() / 3, ibuff.data(),
+		(unsigned int)ibuff.size(), normals.data());
+}
+
+void SimulationThread::publishFrame() {
+	SimulationFrame& frame = frames.backBuffer();
+	frame.nbuff.assign(normals.begin(), normals.end());
+	frame.index = stats.frames;
+	frame.stats = stats;
+	if (recorder != nullptr) recorder->push(&render_positions[0]); // always the simulated mesh
+	if (server != nullptr && frame.lod == 0) server->publish(&frame.vbuff[0], &frame.nbuff[0], stats.sim_time);
+	frames.publish();
+}
+
+void SimulationThread::pushCommand(const SimulationCommand& command) {
+	// the queue only fills up if the simulation stalls, wait for it rather than drop input
+	while (!commands.push(command)) std::this_thread::yield();
+}
+
+bool SimulationThread::acquireFrame() { return frames.update(); }
+const SimulationFrame& SimulationThread::frame() const { return frames.frontBuffer(); }
@@ -0,0 +1,141 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MassSpringSolver.h"
+#include "Aerodynamics.h"
+#include "Scene.h"
+#include "Embedding.h"
+#include "LockFree.h"
+#include "Trajectory.h"
+#include "FrameServer.h"
+#include "Sleep.h"
+
+// Simulation timing statistics
+struct SimulationStats {
+	unsigned long long frames; // published frames
+	unsigned long long substeps; // time steps taken since start
+	unsigned long long dropped; // time steps skipped by the catch-up limit
+	unsigned int frame_substeps; // time steps taken for the last frame
+	float frame_ms; // wall time spent simulating the last frame
+	float substep_ms; // mean wall time per time step in the last frame
+	float mean_frame_ms; // running mean of frame_ms
+	float max_frame_ms; // largest frame_ms since start
+	float alpha; // interpolation factor of the last frame
+	unsigned int solver_iterations; // global steps in the last time step
+	float residual; // relative residual of the last time step, 0 without solver telemetry
+	unsigned int asleep; // sleeping islands, cloths or scene objects
+	unsigned long long slept; // frames not simulated, rendered or published, every island slept
+	double sim_time; // simulated time in seconds
+};
+
+// Simulation frame published to the renderer
+struct SimulationFrame {
+	std::vector<float> vbuff; // vertex positions, interpolated between the last two states
+	std::vector<float> nbuff; // vertex normals
+	unsigned int lod; // detail level of vbuff and nbuff, 0 is the simulated mesh
+	unsigned long long index; // frame counter
+	SimulationStats stats; // statistics at the time of publishing
+};
+
+// User command sent to the simulation
+struct SimulationCommand {
+	enum Type { GRAB, MOVE, RELEASE, SAVE_CHECKPOINT, LOAD_CHECKPOINT, SET_LOD, SCALE_STIFFNESS };
+	Type type;
+	int i; // point index, detail level (SET_LOD)
+	float v[3]; // displacement (MOVE), stiffness factor in v[0] (SCALE_STIFFNESS)
+};
+
+// Simulation thread class
+class SimulationThread {
+private:
+	typedef std::vector<float> Buffer;
+	typedef std::vector<float, StateAllocator<float> > StateBuffer; // from the solver state allocator
+	typedef std::vector<unsigned int> IndexBuffer;
+	typedef SpscQueue<SimulationCommand, 1024> CommandQueue;
+
+	// simulation state, owned by the simulation thread once started
+	StateBuffer positions; // vertex buffer the solver and constraints map onto
+	StateBuffer prev_positions; // positions before the last time step
+	Buffer render_positions; // interpolated positions the detail levels are embedded in
+	Buffer normals; // vertex normals
+	IndexBuffer ibuff; // triangle index buffer, needed for normals
+	std::vector<MeshEmbedding*> levels; // detail levels above the simulated mesh, not owned
+	unsigned int lod; // published detail level
+	MassSpringSolver* solver;
+	ClothScene* scene; // replaces the solver for several cloths
+	CgNode* cgRoot;
+	CgPointFixNode* userFixer; // fixer driven by user commands
+	AerodynamicForce* aerodynamics; // per-step force stage, optional, not owned
+	TrajectoryWriter* recorder; // receives every published frame, optional
+	FrameServer* server; // shares every published frame with other processes, optional
+	std::string checkpoint_path; // checkpoint file for save and load commands
+	SleepTracker sleep; // rest detection, one island per cloth
+	SleepTracker::BoxList colliders; // collider bounds, scratch
+	bool resting; // every island slept through the last published frame
+
+	// settings
+	unsigned int n_iter; // solver iterations per time step
+	float time_step; // simulated seconds per time step
+	unsigned int max_substeps; // catch-up limit, time steps per frame
+	unsigned int frame_ms; // frame period in milliseconds
+
+	// scheduler
+	double accumulator; // real time not yet simulated, in seconds
+	SimulationStats stats;
+
+	// communication
+	TripleBuffer<SimulationFrame> frames;
+	CommandQueue commands;
+	std::atomic<bool> running;
+	std::thread worker;
+
+	void run(); // thread entry
+	void advance(double elapsed); // simulate elapsed seconds of real time
+	void substep(); // simulate one time step
+	void processCommands();
+	void wakeIslands(); // on force and collider changes
+	void sleepIslands(); // on low kinetic energy
+	const float* externalForces();
+	void updateNormals(const Buffer& points, const IndexBuffer& ibuff);
+	void publishFrame();
+
+public:
+	SimulationThread(const float* vbuff, unsigned int vbuffLen,
+		const unsigned int* ibuff, unsigned int ibuffLen);
+	~SimulationThread();
+
+	// buffer to build the solver and constraint graph on
+	float* vbuff();
+	const float* prevVbuff(); // positions at the start of the running time step
+
+	// setup, must be called before start()
+	void setSolver(MassSpringSolver* solver, unsigned int n_iter);
+	void setScene(ClothScene* scene, unsigned int n_iter);
+	void setTimeStep(float time_step);
+	void setMaxSubsteps(unsigned int max_substeps);
+	void setConstraintGraph(CgNode* root);
+	void setUserFixer(CgPointFixNode* fixer);
+	void setAerodynamics(AerodynamicForce* aerodynamics);
+	void setFramePeriod(unsigned int ms);
+	void setRecorder(TrajectoryWriter* recorder);
+	void setFrameServer(FrameServer* server);
+	void setCheckpointPath(const std::string& path);
+	void setSleeping(float energy, unsigned int frames); // kinetic energy threshold and calm frames, 0 never sleeps
+	unsigned int addDetailLevel(MeshEmbedding* embedding); // returns the level, select with SET_LOD
+
+	// checkpoint, call before start() or through SAVE/LOAD_CHECKPOINT commands
+	void saveCheckpoint();
+	void loadCheckpoint();
+
+	// thread control
+	void start();
+	void stop();
+
+	// render thread interface
+	void pushCommand(const SimulationCommand& command);
+	bool acquireFrame(); // returns true if a new frame was acquired
+	const SimulationFrame& frame() const; // most recently acquired frame
+};
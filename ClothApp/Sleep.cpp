@@ -0,0 +1,97 @@
+#include "Sleep.h"
+#include <algorithm>
+
+static bool overlap(const SleepTracker::Box& a, const SleepTracker::Box& b) {
+	return (a.first.array() <= b.second.array()).all() && (b.first.array() <= a.second.array()).all();
+}
+
+// S L E E P  T R A C K E R /////////////////////////////////////////////////////////////////////////
+SleepTracker::Island::Island(unsigned int point_offset, unsigned int n_points)
+	: point_offset(point_offset), n_points(n_points), calm_frames(0), asleep(false),
+	bounds(Vector3f::Zero(), Vector3f::Zero()) {}
+
+SleepTracker::SleepTracker() : threshold(0.0f), frames(30) {}
+
+unsigned int SleepTracker::addIsland(unsigned int point_offset, unsigned int n_points) {
+	islands.push_back(Island(point_offset, n_points));
+	return (unsigned int)islands.size() - 1;
+}
+
+void SleepTracker::setThreshold(float energy, unsigned int frames) {
+	threshold = energy;
+	this->frames = std::max(frames, 1u);
+	if (threshold <= 0.0f) wakeAll();
+}
+
+void SleepTracker::update(unsigned int island, float kinetic_energy, const float* vbuff, const float* fext) {
+	Island& s = islands[island];
+	if (s.asleep) return;
+	if (threshold <= 0.0f || kinetic_energy >= threshold) {
+		s.calm_frames = 0;
+		return;
+	}
+	if (++s.calm_frames < frames) return;
+
+	// fall asleep, remember what has to stay the same
+	const float* p = vbuff + 3 * s.point_offset;
+	s.bounds.first = s.bounds.second = Vector3f(p[0], p[1], p[2]);
+	for (unsigned int i = 1; i < s.n_points; i++) {
+		Vector3f q(p[3 * i + 0], p[3 * i + 1], p[3 * i + 2]);
+		s.bounds.first = s.bounds.first.cwiseMin(q);
+		s.bounds.second = s.bounds.second.cwiseMax(q);
+	}
+	s.fext = Eigen::Map<const Eigen::VectorXf>(fext + 3 * s.point_offset, 3 * s.n_points);
+	s.asleep = true;
+}
+
+void SleepTracker::check(const float* fext, const BoxList& colliders) {
+	for (unsigned int k = 0; k < islands.size(); k++) {
+		Island& s = islands[k];
+		if (!s.asleep) continue;
+
+		// drag still saw the last small motion when the island fell asleep, gusts are larger
+		Eigen::Map<const Eigen::VectorXf> current(fext + 3 * s.point_offset, 3 * s.n_points);
+		if ((current - s.fext).norm() > FORCE_TOLERANCE * s.fext.norm()) {
+			wake(k);
+			continue;
+		}
+
+		// a collider that moved, grew or was added and now reaches the island
+		for (size_t c = 0; c < colliders.size(); c++) {
+			bool changed = c >= this->colliders.size() || colliders[c] != this->colliders[c];
+			if (changed && overlap(colliders[c], s.bounds)) {
+				wake(k);
+				break;
+			}
+		}
+	}
+	this->colliders = colliders;
+}
+
+void SleepTracker::wake(unsigned int island) {
+	Island& s = islands[island];
+	s.asleep = false;
+	s.calm_frames = 0;
+	s.fext.resize(0);
+}
+
+void SleepTracker::wakePoint(unsigned int i) {
+	for (unsigned int k = 0; k < islands.size(); k++)
+		if (i >= islands[k].point_offset && i < islands[k].point_offset + islands[k].n_points) wake(k);
+}
+
+void SleepTracker::wakeAll() {
+	for (unsigned int k = 0; k < islands.size(); k++) wake(k);
+}
+
+bool SleepTracker::enabled() const { return threshold > 0.0f && !islands.empty(); }
+unsigned int SleepTracker::nIslands() const { return (unsigned int)islands.size(); }
+
+unsigned int SleepTracker::nAsleep() const {
+	unsigned int n = 0;
+	for (const Island& s : islands) n += s.asleep;
+	return n;
+}
+
+bool SleepTracker::asleep(unsigned int island) const { return islands[island].asleep; }
+bool SleepTracker::allAsleep() const { return !islands.empty() && nAsleep() == islands.size(); }
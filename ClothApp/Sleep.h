@@ -0,0 +1,59 @@
+#pragma once
+#include <Eigen/Dense>
+#include <utility>
+#include <vector>
+
+// Sleep Tracker class
+// Rest detection for islands of points that no spring connects, the cloth or every object of
+// a scene. An island falls asleep once its kinetic energy stayed below the threshold for a
+// number of frames, its owner then skips its solve, and the constraint pass, normals and frame
+// upload while every island sleeps. A sleeping island wakes when one of its points is pinned,
+// moved or released, when the external forces on its points change, or when a collider whose
+// bounds changed overlaps the island's bounds.
+class SleepTracker {
+public:
+	static constexpr float FORCE_TOLERANCE = 0.01f; // relative change of the island's forces that wakes it
+
+	typedef Eigen::Vector3f Vector3f;
+	typedef std::pair<Vector3f, Vector3f> Box; // lo, hi
+	typedef std::vector<Box> BoxList;
+
+private:
+	struct Island {
+		unsigned int point_offset; // first point in the vertex buffer
+		unsigned int n_points;
+		unsigned int calm_frames; // consecutive frames below the threshold
+		bool asleep;
+		Eigen::VectorXf fext; // external forces when falling asleep
+		Box bounds; // point bounds when falling asleep
+
+		Island(unsigned int point_offset, unsigned int n_points);
+	};
+
+	std::vector<Island> islands;
+	BoxList colliders; // collider bounds seen by the last check()
+	float threshold; // kinetic energy, 0 never sleeps
+	unsigned int frames; // calm frames before sleeping
+
+public:
+	SleepTracker();
+
+	// setup, islands in point order
+	unsigned int addIsland(unsigned int point_offset, unsigned int n_points);
+	void setThreshold(float energy, unsigned int frames);
+
+	// once per frame, update() after the time steps for every awake island, check() with the
+	// current forces and collider bounds wakes sleeping islands
+	void update(unsigned int island, float kinetic_energy, const float* vbuff, const float* fext);
+	void check(const float* fext, const BoxList& colliders);
+
+	void wake(unsigned int island);
+	void wakePoint(unsigned int i); // island holding point i
+	void wakeAll();
+
+	bool enabled() const; // positive threshold and islands to track
+	unsigned int nIslands() const;
+	unsigned int nAsleep() const;
+	bool asleep(unsigned int island) const;
+	bool allAsleep() const;
+};
@@ -0,0 +1,294 @@
+#include "Trajectory.h"
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// zigzag varint helpers
+static void putVarint(std::vector<unsigned char>& out, int32_t v) {
+	uint32_t u = ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+	while (u >= 0x80) {
+		out.push_back((unsigned char)(u | 0x80));
+		u >>= 7;
+	}
+	out.push_back((unsigned char)u);
+}
+
+// null if the varint runs past end or is longer than 5 bytes
+static const unsigned char* getVarint(const unsigned char* in, const unsigned char* end, int32_t& v) {
+	uint32_t u = 0;
+	int shift = 0;
+	while (in < end && (*in & 0x80) && shift < 28) {
+		u |= (uint32_t)(*in++ & 0x7f) << shift;
+		shift += 7;
+	}
+	if (in == end || (*in & 0x80)) return nullptr;
+	u |= (uint32_t)(*in++) << shift;
+	v = (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+	return in;
+}
+
+// W R I T E R //////////////////////////////////////////////////////////////////////////////////////
+TrajectoryWriter::TrajectoryWriter(
+	const std::string& path,
+	unsigned int n_points,
+	const unsigned int* ibuff,
+	unsigned int ibuffLen,
+	float frame_time,
+	float quantization,
+	unsigned int keyframe_interval,
+	unsigned int queue_size
+)
+	: file(path, std::ios::binary), path(path), offset(0), running(true), dropped(0),
+	current(3 * n_points), previous(3 * n_points) {
+	if (!file) throw std::runtime_error("Failed to open trajectory file " + path);
+	assert(keyframe_interval > 0 && quantization > 0.0f);
+
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, Trajectory::MAGIC, sizeof(header.magic));
+	header.version = Trajectory::VERSION;
+	header.n_points = n_points;
+	header.n_indices = ibuffLen;
+	header.keyframe_interval = keyframe_interval;
+	header.quantization = quantization;
+	header.frame_time = frame_time;
+
+	// header is rewritten on close
+	file.write((const char*)&header, sizeof(header));
+	offset = sizeof(header);
+
+	// topology
+	std::vector<uint32_t> indices(ibuff, ibuff + ibuffLen);
+	header.topology_offset = offset;
+	writeChunk(Trajectory::TAG_TOPOLOGY, 0, indices.data(), indices.size() * sizeof(uint32_t));
+
+	// frame buffers
+	if (queue_size > MAX_QUEUE) queue_size = MAX_QUEUE;
+	if (queue_size == 0) queue_size = 1;
+	buffers.resize(queue_size, Buffer(3 * n_points));
+	for (Buffer& b : buffers) spare.push(&b);
+
+	worker = std::thread(&TrajectoryWriter::run, this);
+}
+
+TrajectoryWriter::~TrajectoryWriter() {
+	try { close(); }
+	catch (const std::runtime_error& e) { std::cerr << e.what() << std::endl; }
+}
+
+bool TrajectoryWriter::push(const float* vbuff) {
+	Buffer* b;
+	if (!running || !spare.pop(b)) {
+		dropped++;
+		return false;
+	}
+	std::memcpy(b->data(), vbuff, b->size() * sizeof(float));
+	pending.push(b);
+	return true;
+}
+
+void TrajectoryWriter::run() {
+	Buffer* b;
+	while (true) {
+		if (pending.pop(b)) {
+			encode(*b);
+			spare.push(b);
+		}
+		else if (!running) break;
+		else std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	// a frame pushed between the empty pop and close() is still queued
+	while (pending.pop(b)) {
+		encode(*b);
+		spare.push(b);
+	}
+}
+
+void TrajectoryWriter::encode(const Buffer& frame) {
+	const uint32_t n = (uint32_t)header.n_frames;
+	const float inv = 1.0f / header.quantization;
+	for (unsigned int i = 0; i < frame.size(); i++)
+		current[i] = (int32_t)std::lround(frame[i] * inv);
+
+	TrajectoryIndexEntry entry;
+	entry.offset = offset;
+	entry.keyframe = n - n % header.keyframe_interval;
+	if (n % header.keyframe_interval == 0) {
+		writeChunk(Trajectory::TAG_KEYFRAME, n, current.data(), current.size() * sizeof(int32_t));
+	}
+	else {
+		payload.clear();
+		for (unsigned int i = 0; i < current.size(); i++)
+			putVarint(payload, current[i] - previous[i]);
+		writeChunk(Trajectory::TAG_DELTA, n, payload.data(), payload.size());
+	}
+	index.push_back(entry);
+	current.swap(previous);
+	header.n_frames++;
+}
+
+void TrajectoryWriter::writeChunk(uint32_t tag, uint32_t frame, const void* data, uint64_t size) {
+	TrajectoryChunk c;
+	c.tag = tag;
+	c.frame = frame;
+	c.size = size;
+	file.write((const char*)&c, sizeof(c));
+	file.write((const char*)data, size);
+
+	// keep the next chunk 8-byte aligned
+	const char zeros[8] = { 0 };
+	uint64_t pad = (8 - size % 8) % 8;
+	file.write(zeros, pad);
+	offset += sizeof(c) + size + pad;
+}
+
+void TrajectoryWriter::close() {
+	if (!worker.joinable()) return;
+	running = false;
+	worker.join();
+
+	// frame index and final header
+	header.index_offset = offset;
+	writeChunk(Trajectory::TAG_INDEX, 0, index.data(), index.size() * sizeof(TrajectoryIndexEntry));
+	file.seekp(0);
+	file.write((const char*)&header, sizeof(header));
+	file.close();
+
+	// the stream stays failed from the first write that did not go through
+	if (!file) throw std::runtime_error("Failed to write trajectory file " + path);
+}
+
+unsigned long long TrajectoryWriter::droppedFrames() const { return dropped; }
+
+// R E A D E R //////////////////////////////////////////////////////////////////////////////////////
+TrajectoryReader::TrajectoryReader(const std::string& path)
+	: data(nullptr), size(0), header(nullptr), index(nullptr), mapping(nullptr), decoded(-1) {
+#ifdef _WIN32
+	HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+	if (f == INVALID_HANDLE_VALUE) throw std::runtime_error("Failed to open trajectory file " + path);
+	LARGE_INTEGER fsize;
+	GetFileSizeEx(f, &fsize);
+	size = fsize.QuadPart;
+	mapping = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(f);
+	if (mapping == NULL) throw std::runtime_error("Failed to map trajectory file " + path);
+	data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) throw std::runtime_error("Failed to open trajectory file " + path);
+	struct stat st;
+	fstat(fd, &st);
+	size = st.st_size;
+	void* p = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+	::close(fd);
+	data = p == MAP_FAILED ? nullptr : (const unsigned char*)p;
+#endif
+	if (data == nullptr) throw std::runtime_error("Failed to map trajectory file " + path);
+
+	// validate header, the destructor does not run when the constructor throws
+	header = (const TrajectoryHeader*)data;
+	if (size < sizeof(TrajectoryHeader)
+		|| std::memcmp(header->magic, Trajectory::MAGIC, sizeof(header->magic)) != 0
+		|| header->version != Trajectory::VERSION
+		|| header->quantization <= 0.0f
+		|| !validChunk(header->topology_offset, Trajectory::TAG_TOPOLOGY)
+		|| chunk(header->topology_offset)->size != header->n_indices * (uint64_t)sizeof(uint32_t)
+		|| header->n_frames > size / sizeof(TrajectoryIndexEntry)
+		|| !validChunk(header->index_offset, Trajectory::TAG_INDEX)
+		|| chunk(header->index_offset)->size != header->n_frames * sizeof(TrajectoryIndexEntry)) {
+		unmap();
+		throw std::runtime_error("Invalid trajectory file " + path);
+	}
+	index = (const TrajectoryIndexEntry*)(chunk(header->index_offset) + 1);
+
+	// every frame decodes from a keyframe of the full state through deltas of its own frame number
+	const uint64_t keyframe_size = 3 * (uint64_t)header->n_points * sizeof(int32_t);
+	for (uint64_t f = 0; f < header->n_frames; f++) {
+		const TrajectoryIndexEntry& e = index[f];
+		bool key = e.keyframe == f;
+		if (e.keyframe > f || index[e.keyframe].keyframe != e.keyframe
+			|| !validChunk(e.offset, key ? Trajectory::TAG_KEYFRAME : Trajectory::TAG_DELTA)
+			|| chunk(e.offset)->frame != (uint32_t)f
+			|| (key && chunk(e.offset)->size != keyframe_size)) {
+			unmap();
+			throw std::runtime_error("Invalid trajectory index in " + path);
+		}
+	}
+
+	state.resize(3 * header->n_points);
+}
+
+TrajectoryReader::~TrajectoryReader() { unmap(); }
+
+void TrajectoryReader::unmap() {
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+	CloseHandle(mapping);
+#else
+	munmap((void*)data, size);
+#endif
+}
+
+unsigned int TrajectoryReader::nPoints() const { return header->n_points; }
+unsigned long long TrajectoryReader::nFrames() const { return header->n_frames; }
+float TrajectoryReader::frameTime() const { return header->frame_time; }
+
+std::vector<unsigned int> TrajectoryReader::indices() const {
+	const uint32_t* i = (const uint32_t*)(chunk(header->topology_offset) + 1);
+	return std::vector<unsigned int>(i, i + header->n_indices);
+}
+
+const TrajectoryChunk* TrajectoryReader::chunk(uint64_t offset) const {
+	return (const TrajectoryChunk*)(data + offset);
+}
+
+bool TrajectoryReader::validChunk(uint64_t offset, uint32_t tag) const {
+	// aligned, header and payload inside the file, written without overflow
+	if (offset % 8 != 0 || offset < sizeof(TrajectoryHeader) || offset > size - sizeof(TrajectoryChunk)) return false;
+	const TrajectoryChunk* c = chunk(offset);
+	return c->tag == tag && c->size <= size - offset - sizeof(TrajectoryChunk);
+}
+
+void TrajectoryReader::decode(uint64_t frame) {
+	// continue from the cached frame when it lies between the keyframe and the target
+	uint64_t first = index[frame].keyframe;
+	if (decoded < (int64_t)first || decoded > (int64_t)frame) {
+		const TrajectoryChunk* c = chunk(index[first].offset);
+		std::memcpy(state.data(), c + 1, state.size() * sizeof(int32_t));
+		decoded = first;
+	}
+
+	for (uint64_t f = decoded + 1; f <= frame; f++) {
+		const TrajectoryChunk* c = chunk(index[f].offset);
+		const unsigned char* p = (const unsigned char*)(c + 1);
+		const unsigned char* end = p + c->size;
+		for (unsigned int i = 0; i < state.size(); i++) {
+			int32_t d;
+			p = getVarint(p, end, d);
+			if (p == nullptr) {
+				decoded = -1; // partially applied
+				throw std::runtime_error("Corrupt trajectory frame " + std::to_string(f));
+			}
+			state[i] += d;
+		}
+	}
+	decoded = frame;
+}
+
+void TrajectoryReader::readFrame(unsigned long long frame, float* vbuff) {
+	assert(frame < header->n_frames);
+	if ((int64_t)frame != decoded) decode(frame);
+	for (unsigned int i = 0; i < state.size(); i++)
+		vbuff[i] = state[i] * header->quantization;
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "LockFree.h"
+
+// Trajectory file layout (little-endian)
+//
+//   TrajectoryHeader
+//   TrajectoryChunk 'TOPO' | n_indices x uint32 triangle indices
+//   TrajectoryChunk 'KEYF' | n_points x 3 x int32 quantized positions
+//   TrajectoryChunk 'DELT' | zigzag varint deltas to the previous frame
+//   ...
+//   TrajectoryChunk 'INDX' | n_frames x TrajectoryIndexEntry
+//
+// Chunk payloads are zero-padded to 8 bytes so every chunk header stays aligned in
+// the mapped file. Positions are quantized to multiples of the quantization step. Every
+// keyframe_interval-th frame is a keyframe, so decoding any frame touches at most
+// keyframe_interval chunks, which the index locates directly.
+namespace Trajectory {
+	const char MAGIC[8] = { 'F', 'M', 'S', 'T', 'R', 'A', 'J', '\0' };
+	const uint32_t VERSION = 1;
+
+	const uint32_t TAG_TOPOLOGY = 0x4f504f54; // 'TOPO'
+	const uint32_t TAG_KEYFRAME = 0x4659454b; // 'KEYF'
+	const uint32_t TAG_DELTA = 0x544c4544; // 'DELT'
+	const uint32_t TAG_INDEX = 0x58444e49; // 'INDX'
+}
+
+struct TrajectoryHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t n_points; // number of points
+	uint32_t n_indices; // number of triangle indices
+	uint32_t keyframe_interval; // frames between keyframes
+	float quantization; // position quantization step
+	float frame_time; // seconds between frames
+	uint64_t n_frames; // number of frames
+	uint64_t topology_offset; // file offset of the topology chunk
+	uint64_t index_offset; // file offset of the frame index chunk
+};
+
+struct TrajectoryChunk {
+	uint32_t tag;
+	uint32_t frame; // frame number, 0 for non-frame chunks
+	uint64_t size; // payload size in bytes, excluding this header
+};
+
+struct TrajectoryIndexEntry {
+	uint64_t offset; // file offset of the frame chunk
+	uint64_t keyframe; // frame number of the keyframe this frame decodes from
+};
+
+// Trajectory writer class, encodes and writes on a background thread
+class TrajectoryWriter {
+private:
+	typedef std::vector<float> Buffer;
+	typedef std::vector<int32_t> QBuffer;
+	typedef std::vector<unsigned char> Bytes;
+	static const unsigned int MAX_QUEUE = 64;
+
+	std::ofstream file;
+	std::string path;
+	TrajectoryHeader header;
+	uint64_t offset; // current write offset
+	std::vector<TrajectoryIndexEntry> index;
+
+	// bounded frame queue, buffers cycle between pending and spare
+	std::vector<Buffer> buffers;
+	SpscQueue<Buffer*, MAX_QUEUE> pending;
+	SpscQueue<Buffer*, MAX_QUEUE> spare;
+	std::atomic<bool> running;
+	std::atomic<unsigned long long> dropped;
+	std::thread worker;
+
+	// encoder state
+	QBuffer current, previous;
+	Bytes payload;
+
+	void run(); // thread entry
+	void encode(const Buffer& frame);
+	void writeChunk(uint32_t tag, uint32_t frame, const void* data, uint64_t size);
+
+public:
+	TrajectoryWriter(
+		const std::string& path,      // output file
+		unsigned int n_points,        // number of points
+		const unsigned int* ibuff,    // triangle indices
+		unsigned int ibuffLen,        // number of triangle indices
+		float frame_time,             // seconds between frames
+		float quantization = 1e-4f,   // position quantization step
+		unsigned int keyframe_interval = 30, // frames between keyframes
+		unsigned int queue_size = 16  // frames buffered before dropping, at most 64
+	);
+	~TrajectoryWriter(); // closes, reports write failures on stderr
+
+	bool push(const float* vbuff); // queue a frame, never blocks, returns false if dropped
+	void close(); // flush queued frames and finalize the file, throws if a write failed
+
+	unsigned long long droppedFrames() const;
+};
+
+// Trajectory reader class, maps the file and decodes frames on demand
+class TrajectoryReader {
+private:
+	typedef std::vector<int32_t> QBuffer;
+
+	const unsigned char* data; // mapped file
+	uint64_t size; // mapped size
+	const TrajectoryHeader* header;
+	const TrajectoryIndexEntry* index;
+	void* mapping; // platform mapping handle
+
+	// decoder cache, makes sequential playback one chunk per frame
+	QBuffer state;
+	int64_t decoded; // frame held in state, -1 if none
+
+	const TrajectoryChunk* chunk(uint64_t offset) const;
+	bool validChunk(uint64_t offset, uint32_t tag) const; // tag matches and the chunk lies in the file
+	void decode(uint64_t frame); // throws if a delta runs past its chunk
+	void unmap();
+
+public:
+	TrajectoryReader(const std::string& path); // throws if the file is not a complete trajectory
+	~TrajectoryReader();
+
+	unsigned int nPoints() const;
+	unsigned long long nFrames() const;
+	float frameTime() const;
+	std::vector<unsigned int> indices() const;
+
+	void readFrame(unsigned long long frame, float* vbuff); // decode frame into vbuff, throws on corrupt deltas
+};
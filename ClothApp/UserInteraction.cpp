@@ -1,48 +1,48 @@
 #include "UserInteraction.h"
-#include <GL/glew.h>
-#include <iostream>
-#include <cmath>
-
-UserInteraction::UserInteraction(Renderer* renderer, CgPointFixNode* fixer, float* vbuff) 
-	: renderer(renderer), vbuff(vbuff), fixer(fixer), i(-1) {}
-
-void UserInteraction::setModelview(const glm::mat4& mv) { renderer->setModelview(mv); }
-void UserInteraction::setProjection(const glm::mat4& p) { renderer->setProjection(p); }
-
-void UserInteraction::grabPoint(int mouse_x, int mouse_y){
-	// render scene
-	glClearColor(0, 0, 0, 0);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glDisable(GL_FRAMEBUFFER_SRGB);
-	renderer->draw();
-	glFlush();
-
-	// read color
-	color c(3);
-	glReadPixels(mouse_x, mouse_y, 1, 1, GL_RGB, GL_UNSIGNED_BYTE, &c[0]);
-	i = colorToIndex(c);
-	if (i != -1) fixer->fixPoint(i);
-
-	// return to normal state
-	glClearColor(0.25f, 0.25f, 0.25f, 0);
-	glEnable(GL_FRAMEBUFFER_SRGB);
+#include <glm/gtc/matrix_transform.hpp>
+
+UserInteraction::UserInteraction(SimulationThread* simulation)
+	: i(-1), simulation(simulation), viewport(0, 0, 1, 1), vbuff(nullptr), bvh(nullptr) {}
+
+UserInteraction::~UserInteraction() { delete bvh; }
+
+void UserInteraction::setModelview(const glm::mat4& mv) { modelview = mv; }
+void UserInteraction::setProjection(const glm::mat4& p) { projection = p; }
+void UserInteraction::setViewport(int width, int height) { viewport = glm::vec4(0, 0, width, height); }
+void UserInteraction::setIndexMap(const std::vector<unsigned int>& map) { indexMap = map; }
+
+void UserInteraction::setMesh(const float* vbuff, const unsigned int* ibuff, unsigned int ibuffLen) {
+	delete bvh;
+	this->vbuff = vbuff;
+	bvh = new TriangleBvh(vbuff, ibuff, ibuffLen);
 }
 
-void UserInteraction::releasePoint() { if (i == -1) return; fixer->releasePoint(i); i = -1; }
-void UserInteraction::movePoint(vec3 v) {
-	if (i == -1) return;
-	fixer->releasePoint(i);
-	for(int j = 0; j < 3; j++)
-		vbuff[3 * i + j] += v[j];
-	fixer->fixPoint(i);
+void UserInteraction::updateMesh() {
+	if (bvh != nullptr) bvh->refit(vbuff);
 }
 
-GridMeshUI::GridMeshUI(Renderer* renderer, CgPointFixNode* fixer, float* vbuff, unsigned int n)
-	: UserInteraction(renderer, fixer, vbuff), n(n) {}
+void UserInteraction::grabPoint(int mouse_x, int mouse_y) {
+	if (bvh == nullptr) return;
+
+	// mouse ray in model space, from the near to the far plane
+	glm::vec3 p0 = glm::unProject(glm::vec3(mouse_x, mouse_y, 0.0f), modelview, projection, viewport);
+	glm::vec3 p1 = glm::unProject(glm::vec3(mouse_x, mouse_y, 1.0f), modelview, projection, viewport);
+	Eigen::Vector3f origin(p0.x, p0.y, p0.z);
+	Eigen::Vector3f direction(p1.x - p0.x, p1.y - p0.y, p1.z - p0.z);
 
-int GridMeshUI::colorToIndex(color c) const {
-	if (c[2] != 51) return -1;
-	int vx = std::round((n - 1) * c[0] / 255.0);
-	int vy = std::round((n - 1) * c[1] / 255.0);
-	return n * vy + vx;
-}
\ No newline at end of file
+	TriangleBvh::Hit hit;
+	if (!bvh->intersect(vbuff, origin, direction, hit)) return;
+	i = (int)bvh->nearestVertex(hit);
+	if (!indexMap.empty()) i = indexMap[i];
+	simulation->pushCommand({ SimulationCommand::GRAB, i });
+}
+
+void UserInteraction::releasePoint() {
+	if (i == -1) return;
+	simulation->pushCommand({ SimulationCommand::RELEASE, i });
+	i = -1;
+}
+void UserInteraction::movePoint(vec3 v) {
+	if (i == -1) return;
+	simulation->pushCommand({ SimulationCommand::MOVE, i, { v[0], v[1], v[2] } });
+}
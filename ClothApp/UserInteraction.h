@@ -1,35 +1,39 @@
 #pragma once
 #include <glm/common.hpp>
 
-#include "MassSpringSolver.h"
-#include "Renderer.h"
+#include "SimulationThread.h"
+#include "Bvh.h"
 
+// User Interaction class
+// Picks cloth points on the CPU: the mouse ray is cast against a bounding volume hierarchy
+// over the displayed triangles, refit whenever a new frame is shown. Works for any mesh and
+// never reads back from the GPU.
 class UserInteraction {
 protected:
 	typedef glm::vec3 vec3;
-	typedef std::vector<unsigned char> color;
 
 	int i; // index of fixed point
-	float* vbuff; // vertex buffer
-	CgPointFixNode* fixer; // point fixer
-	Renderer* renderer; // pick shader renderer
-	virtual int colorToIndex(color c) const = 0;
+	SimulationThread* simulation; // receives grab, move and release commands
+	glm::mat4 modelview, projection;
+	glm::vec4 viewport;
+
+	const float* vbuff; // displayed positions, owned by the mesh
+	TriangleBvh* bvh; // over the displayed triangles
+	std::vector<unsigned int> indexMap; // picked index -> simulation index, empty for identity
 
 public:
-	UserInteraction(Renderer* renderer, CgPointFixNode* fixer, float* vbuff);
+	UserInteraction(SimulationThread* simulation);
+	~UserInteraction();
 
 	void setModelview(const glm::mat4& mv);
 	void setProjection(const glm::mat4& p);
+	void setViewport(int width, int height);
+	void setIndexMap(const std::vector<unsigned int>& map);
+
+	void setMesh(const float* vbuff, const unsigned int* ibuff, unsigned int ibuffLen); // rebuild
+	void updateMesh(); // refit after the positions changed
 
-	void grabPoint(int mouse_x, int mouse_y); // grab point with color c
+	void grabPoint(int mouse_x, int mouse_y); // grab vertex under the mouse
 	void movePoint(vec3 v); // move grabbed point along mouse
 	void releasePoint(); // release grabbed point;
 };
-
-class GridMeshUI : public UserInteraction {
-protected:
-	const unsigned int n; // grid width
-	virtual int colorToIndex(color c) const;
-public:
-	GridMeshUI(Renderer* renderer, CgPointFixNode* fixer, float* vbuff, unsigned int n);
-};
\ No newline at end of file
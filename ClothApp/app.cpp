@@ -3,15 +3,34 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <stdexcept>
+#include <csignal>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
 #include <iostream>
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <chrono>
+#include <thread>
 
 #include "Shader.h"
 #include "Mesh.h"
 #include "Renderer.h"
 #include "MassSpringSolver.h"
 #include "UserInteraction.h"
+#include "SimulationThread.h"
+#include "Trajectory.h"
+#include "Reordering.h"
+#include "Profiler.h"
+#include "Embedding.h"
+#include "Aerodynamics.h"
+#include "Scene.h"
+#include "FrameServer.h"
+#include "Parallel.h"
+#include "Memory.h"
+#include "FrameCapture.h"
+#include "Headless.h"
 
 // G L O B A L S ///////////////////////////////////////////////////////////////////
 
@@ -24,14 +43,12 @@ static int g_mouseClickY;
 
 // User Interaction
 static UserInteraction* UI;
-static Renderer* g_pickRenderer;
 
 // Constants
 static const float PI = glm::pi<float>();
 
 // Shader Handles
 static PhongShader* g_phongShader; // linked phong shader
-static PickShader* g_pickShader; // linked pick shader
 
 // Shader parameters
 static const glm::vec3 g_albedo(0.0f, 0.3f, 0.7f);
@@ -39,7 +56,16 @@ static const glm::vec3 g_ambient(0.01f, 0.01f, 0.01f);
 static const glm::vec3 g_light(1.0f, 1.0f, -1.0f);
 
 // Mesh
-static Mesh* g_clothMesh; // halfedge data structure
+static Mesh* g_clothMesh; // halfedge data structure, displayed detail level
+
+// Detail levels, finer grids driven by the simulated mesh
+static std::vector<Mesh*> g_lodMeshes; // level 0 is the simulated mesh
+static std::vector<ProgramInput*> g_lodTargets;
+static std::vector<MeshEmbedding*> g_lodEmbeddings; // level k embedded in level 0
+static unsigned int g_lod = 0; // displayed level
+static unsigned int g_lodRequest = 0; // level last requested from the simulation
+static const float g_lodEdgePixels = 8.0f; // refine while grid edges look longer | 8.0f
+static const float g_lodStrainLimit = 0.1f; // fine edge deformation, detail pass | 0.1f
 
 // Render Target
 static ProgramInput* g_render_target; // vertex, normal, texutre, index
@@ -47,12 +73,62 @@ static ProgramInput* g_render_target; // vertex, normal, texutre, index
 // Animation
 static const int g_fps = 60; // frames per second  | 60
 static const int g_iter = 5; // iterations per time step | 10
-static const int g_frame_time = 15; // approximate time for frame calculations | 15
-static const int g_animation_timer = (int) ((1.0f / g_fps) * 1000 - g_frame_time);
+static const int g_max_substeps = 4; // catch-up limit, time steps per frame | 4
+static const int g_animation_timer = (int) ((1.0f / g_fps) * 1000);
 
 // Mass Spring System
-static mass_spring_system* g_system;
+static mass_spring_system* g_system; // scene system with several cloths
 static MassSpringSolver* g_solver;
+static ClothScene* g_scene; // blocks of several cloths, replaces g_solver
+static const float g_clothSpacing = 0.25f; // offset between stacked cloths | 0.25f
+
+// Simulation thread, owns the solver and constraint graph once started
+static SimulationThread* g_simulation;
+
+// Command line options
+static std::string g_recordPath; // --record <file>
+static std::string g_replayPath; // --replay <file>
+static std::string g_checkpointPath; // --checkpoint <file>
+static std::string g_objPath; // --obj <file>
+static std::string g_reorderMode; // --reorder rcm|morton
+static std::string g_solverName = "llt-amd"; // --solver <backend>
+static std::string g_tracePath; // --trace <file>
+static float g_tolerance = 0.0f; // --tolerance <relative residual>
+static unsigned int g_lodLevels = 0; // --lod <levels>
+static unsigned int g_cloths = 1; // --cloths <count>
+static bool g_wind = false; // --wind <x,y,z>
+static glm::vec3 g_windVelocity; // mean wind
+static std::string g_serveName; // --serve <shared memory name>, runs without a window
+static float g_strainLimit = 0.0f; // --strain-limit <weight>, limit stiffness relative to the springs
+static float g_sleepEnergy = 1e-6f; // --sleep <joules>, kinetic energy a cloth sleeps below, 0 never sleeps
+static const unsigned int g_sleepFrames = 30; // frames below the threshold before sleeping | 30
+static std::string g_exportPath; // --export <dir>, writes every displayed frame
+static FrameEncoder::Format g_exportFormat = FrameEncoder::PNG; // --export-format png|raw
+static unsigned int g_exportWidth = 0, g_exportHeight = 0; // --export-size <width>x<height>, window size if 0
+static unsigned long long g_exportFrames = 0; // --export-frames <count>, exits after that many, 0 never
+static bool g_headless = false; // --headless, renders offscreen only, needs --export
+
+// Trajectory recording and replay
+static TrajectoryWriter* g_recorder;
+static TrajectoryReader* g_player;
+static unsigned long long g_playFrame = 0;
+
+// Headless frame server
+static FrameServer* g_server;
+static const unsigned int g_serverSlots = 4; // frames held in the ring | 4
+static volatile std::sig_atomic_t g_stopRequested = 0; // SIGINT or SIGTERM without a window
+
+// Frame export
+static HeadlessContext* g_context; // without a window
+static FrameEncoder* g_encoder;
+static FrameCapture* g_capture;
+static const unsigned int g_exportSlots = 3; // frames in flight between render and readback | 3
+static const unsigned int g_exportQueue = 8; // frames waiting for the encoder before dropping | 8
+static glm::mat4 g_exportProjection;
+static std::chrono::steady_clock::time_point g_exportStart;
+
+// Vertex reordering, mesh build order -> simulation order
+static VertexReordering g_reordering;
 
 // System parameters
 namespace SystemParam {
@@ -64,11 +140,21 @@ namespace SystemParam {
 	static const float m = 0.25f / (n * n); // point mass | 0.25f
 	static const float a = 0.993f; // damping, close to 1.0 | 0.993f
 	static const float g = 9.8f * m; // gravitational force | 9.8f
+	static const float rho = 0.25f / (w * w); // mass per unit area, imported meshes | 0.0625f
+	static const float ga = 9.8f; // gravitational acceleration, imported meshes | 9.8f
 }
 
 // Constraint Graph
 static CgRootNode* g_cgRootNode;
 
+// Aerodynamics
+static AerodynamicForce* g_aerodynamics;
+static const float g_airDensity = 0.2f; // drag comparable to gravity at 2 m/s | 0.2f
+static const float g_dragCoefficient = 1.0f; // | 1.0f
+static const float g_liftCoefficient = 0.5f; // | 0.5f
+static const float g_turbulence = 0.5f; // gust intensity relative to the mean wind | 0.5f
+static const float g_turbulenceScale = 1.0f; // eddy size | 1.0f
+
 // Scene parameters
 static const float g_camera_distance = 4.2f;
 
@@ -78,16 +164,33 @@ static glm::mat4 g_ProjectionMatrix;
 
 // F U N C T I O N S //////////////////////////////////////////////////////////////
 // state initialization
+static void initArgs(int, char**);
 static void initGlutState(int, char**);
 static void initGLState();
 
 static void initShaders(); // Read, compile and link shaders
 static void initCloth(); // Generate cloth mesh
+static void initDetailLevels(); // Generate finer render meshes
+static void initAerodynamics(); // Wind force stage
+static void initUserInteraction(); // Pick on the displayed mesh
 static void initScene(); // Generate scene matrices
+static void initTrajectory(); // Open trajectory for recording or replay
+static void initCheckpoint(); // Restore checkpoint if one exists
+static void initProfiler(); // Write a Chrome trace on exit if requested
+static void runServer(); // Simulate without a window, publish frames to shared memory
+static void initExport(); // Offscreen framebuffer and encoder for frame export
+static void runHeadless(); // Render and export frames without a window
 
 // demos
 static void demo_hang(); // curtain hanging from top corners
 static void demo_drop(); // curtain dropping on sphere
+static void demo_obj(); // imported mesh dropping on sphere
+static mass_spring_system* reorderSystem(mass_spring_system*, VertexReordering&);
+static MassSpringSolver* createSolver(mass_spring_system*);
+static void initSystem(mass_spring_system*);
+static std::vector<unsigned int> toScene(const std::vector<unsigned int>&);
+static void fixPoint(CgPointFixNode*, unsigned int);
+static CgSpringNode* initStrainLimit(float, unsigned int, const std::vector<unsigned int>&, bool);
 static void(*g_demo)() = demo_drop;
 
 // glut callbacks
@@ -95,17 +198,26 @@ static void display();
 static void reshape(int, int);
 static void mouse(int, int, int, int);
 static void motion(int, int);
+static void keyboard(unsigned char, int, int);
 
 // draw cloth function
-static void drawCloth();
+static void drawCloth(const glm::mat4& projection);
 static void animateCloth(int value);
+static bool nextFrame(); // Pick up a new frame, false if there is none yet
+static void exportFrame(); // Render offscreen and queue the frame for export
+static bool exportFinished(); // All --export-frames frames written
 
 // scene update
 static void updateProjection();
 static void updateRenderTarget();
+static void updateDetailLevel(); // Request a detail level for the screen size
+static void showDetailLevel(unsigned int level);
 
 // cleaning
 static void cleanUp();
+static void finishRecording();
+static void finishExport();
+static void writeTrace();
 
 // error checks
 void checkGlErrors();
@@ -115,6 +227,17 @@ void checkGlErrors();
 // M A I N //////////////////////////////////////////////////////////////////////////
 int main(int argc, char** argv) {
 	try {
+		initArgs(argc, argv);
+		if (!g_serveName.empty()) {
+			runServer();
+			cleanUp();
+			return 0;
+		}
+		if (g_headless) {
+			runHeadless();
+			cleanUp();
+			return 0;
+		}
 		initGlutState(argc, argv);
 		glewInit();
 		initGLState();
@@ -122,7 +245,13 @@ int main(int argc, char** argv) {
 		initShaders();
 		initCloth();
 		initScene();
+		initProfiler();
+		initTrajectory();
+		initCheckpoint();
+		initExport();
 
+		// a replay has no solver to run
+		if (g_player == nullptr) g_simulation->start();
 		glutTimerFunc(g_animation_timer, animateCloth, 0);
 		glutMainLoop();
 
@@ -137,6 +266,41 @@ int main(int argc, char** argv) {
 
 
 // S T A T E  I N I T I A L I Z A T O N /////////////////////////////////////////////
+static void initArgs(int argc, char** argv) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg(argv[i]);
+		if (arg == "--headless") g_headless = true; // the only option without a value
+		else if (i + 1 == argc) break;
+		else if (arg == "--record") g_recordPath = argv[++i];
+		else if (arg == "--replay") g_replayPath = argv[++i];
+		else if (arg == "--checkpoint") g_checkpointPath = argv[++i];
+		else if (arg == "--obj") g_objPath = argv[++i];
+		else if (arg == "--reorder") g_reorderMode = argv[++i];
+		else if (arg == "--solver") g_solverName = argv[++i];
+		else if (arg == "--trace") g_tracePath = argv[++i];
+		else if (arg == "--tolerance") g_tolerance = (float)std::atof(argv[++i]);
+		else if (arg == "--lod") g_lodLevels = std::atoi(argv[++i]);
+		else if (arg == "--cloths") g_cloths = std::max(1, std::atoi(argv[++i]));
+		else if (arg == "--wind") {
+			float* v = &g_windVelocity[0];
+			g_wind = std::sscanf(argv[++i], "%f,%f,%f", &v[0], &v[1], &v[2]) == 3;
+			if (!g_wind) throw std::runtime_error("Expected --wind x,y,z");
+		}
+		else if (arg == "--serve") g_serveName = argv[++i];
+		else if (arg == "--strain-limit") g_strainLimit = (float)std::atof(argv[++i]);
+		else if (arg == "--deterministic") Parallel::setDeterministic(std::atoi(argv[++i]) != 0);
+		else if (arg == "--sleep") g_sleepEnergy = (float)std::atof(argv[++i]);
+		else if (arg == "--memory") Allocator::setDefault(Allocator::create(argv[++i]));
+		else if (arg == "--export") g_exportPath = argv[++i];
+		else if (arg == "--export-format") g_exportFormat = FrameEncoder::parseFormat(argv[++i]);
+		else if (arg == "--export-size") {
+			if (std::sscanf(argv[++i], "%ux%u", &g_exportWidth, &g_exportHeight) != 2 || g_exportWidth == 0 || g_exportHeight == 0)
+				throw std::runtime_error("Expected --export-size <width>x<height>");
+		}
+		else if (arg == "--export-frames") g_exportFrames = std::strtoull(argv[++i], nullptr, 10);
+	}
+}
+
 static void initGlutState(int argc, char** argv) {
 	glutInit(&argc, argv);
 	glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH);
@@ -147,10 +311,11 @@ static void initGlutState(int argc, char** argv) {
 	glutReshapeFunc(reshape);
 	glutMouseFunc(mouse);
 	glutMotionFunc(motion);
+	glutKeyboardFunc(keyboard);
 }
 
 static void initGLState() {
-	glClearColor(0.25f, 0.25f, 0.25f, 0);
+	glClearColor(0.25f, 0.25f, 0.25f, 1); // opaque, exported frames keep the alpha
 	glClearDepth(1.);
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 	glPixelStorei(GL_PACK_ALIGNMENT, 1);
@@ -165,20 +330,15 @@ static void initGLState() {
 static void initShaders() {
 	GLShader basic_vert(GL_VERTEX_SHADER);
 	GLShader phong_frag(GL_FRAGMENT_SHADER);
-	GLShader pick_frag(GL_FRAGMENT_SHADER);
 
 	auto ibasic = std::ifstream("./shaders/basic.vshader");
 	auto iphong = std::ifstream("./shaders/phong.fshader");
-	auto ifrag = std::ifstream("./shaders/pick.fshader");
 
 	basic_vert.compile(ibasic);
 	phong_frag.compile(iphong);
-	pick_frag.compile(ifrag);
 
 	g_phongShader = new PhongShader;
-	g_pickShader = new PickShader;
 	g_phongShader->link(basic_vert, phong_frag);
-	g_pickShader->link(basic_vert, pick_frag);
 
 	checkGlErrors();
 }
@@ -188,23 +348,106 @@ static void initCloth() {
 	const int n = SystemParam::n;
 	const float w = SystemParam::w;
 
-	// generate mesh
+	// generate or load mesh
 	MeshBuilder meshBuilder;
-	meshBuilder.uniformGrid(w, n);
+	if (g_objPath.empty()) meshBuilder.uniformGrid(w, n);
+	else {
+		meshBuilder.loadObj(g_objPath);
+		g_demo = demo_obj;
+	}
 	g_clothMesh = meshBuilder.getResult();
 
-	// fill program input
-	g_render_target = new ProgramInput;
-	g_render_target->setPositionData(g_clothMesh->vbuff(), g_clothMesh->vbuffLen());
-	g_render_target->setNormalData(g_clothMesh->nbuff(), g_clothMesh->nbuffLen());
-	g_render_target->setTextureData(g_clothMesh->tbuff(), g_clothMesh->tbuffLen());
-	g_render_target->setIndexData(g_clothMesh->ibuff(), g_clothMesh->ibuffLen());
+	// reorder vertices for memory locality
+	const unsigned int n_vertices = (unsigned int)g_clothMesh->n_vertices();
+	if (g_reorderMode == "rcm")
+		g_reordering.reverseCuthillMcKee(n_vertices, g_clothMesh->ibuff(), g_clothMesh->ibuffLen());
+	else if (g_reorderMode == "morton")
+		g_reordering.morton(g_clothMesh->vbuff(), n_vertices);
+	else if (g_reorderMode.empty()) g_reordering.identity(n_vertices);
+	else throw std::runtime_error("Unknown vertex ordering " + g_reorderMode);
+	if (!g_reorderMode.empty()) {
+		meshBuilder.reorder(g_clothMesh, g_reordering.getOrder());
+		delete g_clothMesh;
+		g_clothMesh = meshBuilder.getResult();
+	}
 
-	// check errors
-	checkGlErrors();
+	// stack copies of the cloth, each one is a block of the scene
+	if (g_cloths > 1) {
+		meshBuilder.replicate(g_clothMesh, g_cloths, 0.0f, 0.0f, g_clothSpacing);
+		delete g_clothMesh;
+		g_clothMesh = meshBuilder.getResult();
+	}
 
-	// build demo system
+	// fill program input, none without a window
+	if (g_serveName.empty()) {
+		g_render_target = new ProgramInput;
+		g_render_target->setPositionData(g_clothMesh->vbuff(), g_clothMesh->vbuffLen());
+		g_render_target->setNormalData(g_clothMesh->nbuff(), g_clothMesh->nbuffLen());
+		g_render_target->setTextureData(g_clothMesh->tbuff(), g_clothMesh->tbuffLen());
+		g_render_target->setIndexData(g_clothMesh->ibuff(), g_clothMesh->ibuffLen());
+
+		// check errors
+		checkGlErrors();
+	}
+
+	// simulation buffers, the solver never touches the mesh directly
+	g_simulation = new SimulationThread(g_clothMesh->vbuff(), g_clothMesh->vbuffLen(),
+		g_clothMesh->ibuff(), g_clothMesh->ibuffLen());
+	g_simulation->setFramePeriod(g_animation_timer);
+	g_simulation->setSleeping(g_sleepEnergy, g_sleepFrames);
+	initDetailLevels();
+
+	// build demo system, a replay only draws the recorded frames
+	if (!g_replayPath.empty()) return;
 	g_demo();
+	if (g_wind) initAerodynamics();
+}
+
+static void initAerodynamics() {
+	Eigen::Vector3f mean(g_windVelocity[0], g_windVelocity[1], g_windVelocity[2]);
+	g_aerodynamics = new AerodynamicForce(g_system, g_clothMesh->ibuff(), g_clothMesh->ibuffLen());
+	g_aerodynamics->setCoefficients(g_airDensity, g_dragCoefficient, g_liftCoefficient);
+	g_aerodynamics->windField().setMean(mean);
+	g_aerodynamics->windField().setTurbulence(g_turbulence * mean.norm(), g_turbulenceScale);
+	g_simulation->setAerodynamics(g_aerodynamics);
+}
+
+static void initDetailLevels() {
+	g_lodMeshes.push_back(g_clothMesh);
+	g_lodTargets.push_back(g_render_target);
+	if (g_lodLevels == 0 || !g_replayPath.empty()) return;
+	if (!g_objPath.empty() || g_cloths > 1) throw std::runtime_error("Detail levels need a single grid cloth.");
+	if (!g_serveName.empty()) throw std::runtime_error("Detail levels need the window.");
+
+	// every level halves the grid spacing
+	for (unsigned int k = 1; k <= g_lodLevels; k++) {
+		MeshBuilder meshBuilder;
+		meshBuilder.uniformGrid(SystemParam::w, ((SystemParam::n - 1) << k) + 1);
+		Mesh* mesh = meshBuilder.getResult();
+
+		ProgramInput* target = new ProgramInput;
+		target->setPositionData(mesh->vbuff(), mesh->vbuffLen());
+		target->setNormalData(mesh->nbuff(), mesh->nbuffLen());
+		target->setTextureData(mesh->tbuff(), mesh->tbuffLen());
+		target->setIndexData(mesh->ibuff(), mesh->ibuffLen());
+
+		MeshEmbedding* embedding = new MeshEmbedding(
+			g_clothMesh->vbuff(), (unsigned int)g_clothMesh->n_vertices(),
+			g_clothMesh->ibuff(), g_clothMesh->ibuffLen(),
+			mesh->vbuff(), (unsigned int)mesh->n_vertices(), mesh->ibuff(), mesh->ibuffLen());
+		embedding->setStrainLimit(g_lodStrainLimit, 1);
+		g_simulation->addDetailLevel(embedding);
+
+		g_lodMeshes.push_back(mesh);
+		g_lodTargets.push_back(target);
+		g_lodEmbeddings.push_back(embedding);
+	}
+	checkGlErrors();
+}
+
+static void initUserInteraction() {
+	UI = new UserInteraction(g_simulation);
+	UI->setMesh(g_clothMesh->vbuff(), g_clothMesh->ibuff(), g_clothMesh->ibuffLen());
 }
 
 static void initScene() {
@@ -216,6 +459,177 @@ static void initScene() {
 	updateProjection();
 }
 
+static void initCheckpoint() {
+	if (g_checkpointPath.empty() || g_player != nullptr) return;
+	g_simulation->setCheckpointPath(g_checkpointPath);
+
+	// warm restart from an existing checkpoint
+	if (std::ifstream(g_checkpointPath)) g_simulation->loadCheckpoint();
+}
+
+static void requestStop(int) { g_stopRequested = 1; }
+
+static void runServer() {
+	if (!g_replayPath.empty()) throw std::runtime_error("Replay needs the window.");
+	initCloth();
+	initProfiler();
+	initTrajectory();
+	initCheckpoint();
+
+	// the simulated mesh, readers get the topology from the same mesh build
+	g_server = new FrameServer(g_serveName, (unsigned int)g_clothMesh->n_vertices(), g_serverSlots);
+	g_simulation->setFrameServer(g_server);
+
+	std::signal(SIGINT, requestStop);
+	std::signal(SIGTERM, requestStop);
+	std::cout << "Serving frames on " << g_serveName << ", Ctrl-C to stop." << std::endl;
+	g_simulation->start();
+	while (!g_stopRequested) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(g_animation_timer));
+		if (Profiler::enabled) Profiler::collect(); // drain the probe rings before they fill up
+	}
+	g_simulation->stop();
+	std::cout << "Published " << g_server->frames() << " frames." << std::endl;
+}
+
+static void initExport() {
+	if (g_exportPath.empty()) return;
+	if (g_exportWidth == 0) {
+		g_exportWidth = g_windowWidth;
+		g_exportHeight = g_windowHeight;
+	}
+	g_encoder = new FrameEncoder(g_exportPath, g_exportFormat, g_exportWidth, g_exportHeight, g_exportQueue);
+	g_capture = new FrameCapture(g_exportWidth, g_exportHeight, g_encoder, g_exportSlots);
+
+	// headless, replayed and counted exports keep every frame and slow down the render loop instead
+	g_encoder->setBlocking(g_headless || g_player != nullptr || g_exportFrames > 0);
+	g_exportProjection = glm::perspective(PI / 4.0f, g_exportWidth * 1.0f / g_exportHeight, 0.01f, 1000.0f);
+	g_exportStart = std::chrono::steady_clock::now();
+
+	// GLUT may exit without returning from the main loop
+	std::atexit(finishExport);
+	checkGlErrors();
+}
+
+static void runHeadless() {
+	if (g_exportPath.empty()) throw std::runtime_error("Headless mode needs --export <dir>.");
+	g_context = new HeadlessContext;
+	glewInit();
+	initGLState();
+
+	initShaders();
+	initCloth();
+	initScene();
+	initProfiler();
+	initTrajectory();
+	initCheckpoint();
+	initExport();
+
+	std::signal(SIGINT, requestStop);
+	std::signal(SIGTERM, requestStop);
+	std::cout << "Exporting frames to " << g_exportPath << " on " << g_context->renderer() << ", Ctrl-C to stop." << std::endl;
+
+	// frames come at the simulation's pace, a replay is exported once as fast as it renders
+	if (g_player == nullptr) g_simulation->start();
+	while (!g_stopRequested && !exportFinished()) {
+		if (nextFrame()) exportFrame();
+		else std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		if (Profiler::enabled) Profiler::collect(); // drain the probe rings before they fill up
+		if (g_player != nullptr && g_playFrame == 0) break;
+	}
+	finishExport();
+}
+
+static void initProfiler() {
+	if (g_tracePath.empty()) return;
+	if (!Profiler::enabled)
+		std::cerr << "Profiling is disabled, configure with -DFMS_PROFILING=ON to record a trace." << std::endl;
+
+	// GLUT may exit without returning from the main loop
+	std::atexit(writeTrace);
+}
+
+static void initTrajectory() {
+	if (!g_replayPath.empty()) {
+		g_player = new TrajectoryReader(g_replayPath);
+		if (g_player->nPoints() != g_clothMesh->n_vertices() || g_player->nFrames() == 0)
+			throw std::runtime_error("Trajectory does not match the cloth mesh.");
+	}
+	else if (!g_recordPath.empty()) {
+		g_recorder = new TrajectoryWriter(g_recordPath, (unsigned int)g_clothMesh->n_vertices(),
+			g_clothMesh->ibuff(), g_clothMesh->ibuffLen(), g_animation_timer / 1000.0f);
+		g_simulation->setRecorder(g_recorder);
+
+		// GLUT may exit without returning from the main loop
+		std::atexit(finishRecording);
+	}
+}
+
+static mass_spring_system* reorderSystem(mass_spring_system* system, VertexReordering& reordering) {
+	mass_spring_system* result = reordering.apply(system);
+	delete system;
+	return result;
+}
+
+static MassSpringSolver* createSolver(mass_spring_system* system) {
+	MassSpringSolver* solver = new MassSpringSolver(system, g_simulation->vbuff(),
+		LinearSolver::create(g_solverName));
+	solver->setTolerance(g_tolerance); // g_iter becomes the iteration cap
+	return solver;
+}
+
+static void initSystem(mass_spring_system* object) {
+	if (g_cloths == 1) {
+		g_system = object;
+		g_solver = createSolver(g_system);
+		g_simulation->setSolver(g_solver, g_iter);
+		return;
+	}
+
+	// one block per stacked cloth, factored and solved concurrently
+	g_scene = new ClothScene;
+	for (unsigned int i = 0; i < g_cloths; i++) g_scene->addObject(new mass_spring_system(*object));
+	delete object;
+	g_scene->build(g_simulation->vbuff(), g_solverName);
+	g_scene->setTolerance(g_tolerance);
+	g_system = g_scene->system();
+	g_simulation->setScene(g_scene, g_iter);
+}
+
+static std::vector<unsigned int> toScene(const std::vector<unsigned int>& springs) {
+	if (g_scene == nullptr) return springs;
+	std::vector<unsigned int> result;
+	result.reserve(springs.size() * g_scene->nObjects());
+	for (unsigned int o = 0; o < g_scene->nObjects(); o++)
+		for (unsigned int k : springs) result.push_back(g_scene->springOffset(o) + k);
+	return result;
+}
+
+static void fixPoint(CgPointFixNode* node, unsigned int i) {
+	if (g_scene == nullptr) node->fixPoint(i);
+	else for (unsigned int o = 0; o < g_scene->nObjects(); o++) node->fixPoint(g_scene->pointOffset(o) + i);
+}
+
+static CgSpringNode* initStrainLimit(float tauc, unsigned int n_iter, const std::vector<unsigned int>& springs,
+	bool pinned) {
+	// the solver does not see fixed points, a pinned cloth stretches without bound between its
+	// pins and the limit springs, so pinned demos keep the pass
+	if (g_strainLimit > 0.0f && pinned)
+		std::cerr << "--strain-limit ignored, pinned cloth keeps the deformation pass." << std::endl;
+	else if (g_strainLimit > 0.0f) {
+		if (g_scene != nullptr) g_scene->setStrainLimit(tauc, g_strainLimit, springs);
+		else g_solver->setStrainLimit(tauc, g_strainLimit, springs);
+		return g_cgRootNode;
+	}
+
+	// Provot pass after every time step
+	CgSpringDeformationNode* deformationNode =
+		new CgSpringDeformationNode(g_system, g_simulation->vbuff(), tauc, n_iter);
+	deformationNode->addSprings(toScene(springs));
+	g_cgRootNode->addChild(deformationNode);
+	return deformationNode;
+}
+
 static void demo_hang() {
 	// short hand
 	const int n = SystemParam::n;
@@ -231,10 +645,8 @@ static void demo_hang() {
 		SystemParam::a,
 		SystemParam::g
 	);
-	g_system = massSpringBuilder.getResult();
-
 	// initialize mass spring solver
-	g_solver = new MassSpringSolver(g_system, g_clothMesh->vbuff());
+	initSystem(reorderSystem(massSpringBuilder.getResult(), g_reordering));
 
 	// deformation constraint parameters
 	const float tauc = 0.4f; // critical spring deformation | 0.4f
@@ -242,40 +654,37 @@ static void demo_hang() {
 
 	// initialize constraints
 	// spring deformation constraint
-	CgSpringDeformationNode* deformationNode =
-		new CgSpringDeformationNode(g_system, g_clothMesh->vbuff(), tauc, deformIter);
-	deformationNode->addSprings(massSpringBuilder.getShearIndex());
-	deformationNode->addSprings(massSpringBuilder.getStructIndex());
+	std::vector<unsigned int> deformSprings = g_reordering.springsToNew(massSpringBuilder.getShearIndex());
+	std::vector<unsigned int> structSprings = g_reordering.springsToNew(massSpringBuilder.getStructIndex());
+	deformSprings.insert(deformSprings.end(), structSprings.begin(), structSprings.end());
 
 	// fix top corners
-	CgPointFixNode* cornerFixer = new CgPointFixNode(g_system, g_clothMesh->vbuff());
-	cornerFixer->fixPoint(0);
-	cornerFixer->fixPoint(n - 1);
+	CgPointFixNode* cornerFixer = new CgPointFixNode(g_system, g_simulation->vbuff());
+	fixPoint(cornerFixer, g_reordering.toNew(0));
+	fixPoint(cornerFixer, g_reordering.toNew(n - 1));
 
 	// initialize user interaction
-	g_pickRenderer = new Renderer();
-	g_pickRenderer->setProgram(g_pickShader);
-	g_pickRenderer->setProgramInput(g_render_target);
-	g_pickRenderer->setElementCount(g_clothMesh->ibuffLen());
-	g_pickShader->setTessFact(SystemParam::n);
-	CgPointFixNode* mouseFixer = new CgPointFixNode(g_system, g_clothMesh->vbuff());
-	UI = new GridMeshUI(g_pickRenderer, mouseFixer, g_clothMesh->vbuff(), n);
+	CgPointFixNode* mouseFixer = new CgPointFixNode(g_system, g_simulation->vbuff());
+	initUserInteraction();
 
 	// build constraint graph
-	g_cgRootNode = new CgRootNode(g_system, g_clothMesh->vbuff());
+	g_cgRootNode = new CgRootNode(g_system, g_simulation->vbuff());
 
-	// first layer
-	g_cgRootNode->addChild(deformationNode);
+	// first layer, the root takes the place of the deformation pass when the solver limits strain
+	CgSpringNode* deformationNode = initStrainLimit(tauc, deformIter, deformSprings, true);
 
 	// second layer
 	deformationNode->addChild(cornerFixer);
 	deformationNode->addChild(mouseFixer);
+
+	// hand over to simulation thread
+	g_simulation->setTimeStep(SystemParam::h);
+	g_simulation->setMaxSubsteps(g_max_substeps);
+	g_simulation->setConstraintGraph(g_cgRootNode);
+	g_simulation->setUserFixer(mouseFixer);
 }
 
 static void demo_drop() {
-	// short hand
-	const int n = SystemParam::n;
-
 	// initialize mass spring system
 	MassSpringBuilder massSpringBuilder;
 	massSpringBuilder.uniformGrid(
@@ -287,10 +696,71 @@ static void demo_drop() {
 		SystemParam::a,
 		SystemParam::g
 	);
-	g_system = massSpringBuilder.getResult();
+	// initialize mass spring solver
+	initSystem(reorderSystem(massSpringBuilder.getResult(), g_reordering));
+
+	// sphere collision constraint parameters
+	const float radius = 0.64f; // sphere radius | 0.64f
+	const Eigen::Vector3f center(0, 0, -1);// sphere center | (0, 0, -1)
+
+	// deformation constraint parameters
+	const float tauc = 0.12f; // critical spring deformation | 0.12f
+	const unsigned int deformIter = 15; // number of iterations | 15
+
+	// initialize constraints
+	// sphere collision constraint, continuous along every point path
+	CgContinuousCollisionNode* sphereCollisionNode =
+		new CgContinuousCollisionNode(g_system, g_simulation->vbuff(), g_simulation->prevVbuff());
+	sphereCollisionNode->addSphere(center, radius);
+
+	// spring deformation constraint
+	std::vector<unsigned int> deformSprings = g_reordering.springsToNew(massSpringBuilder.getShearIndex());
+	std::vector<unsigned int> structSprings = g_reordering.springsToNew(massSpringBuilder.getStructIndex());
+	deformSprings.insert(deformSprings.end(), structSprings.begin(), structSprings.end());
+
+	// initialize user interaction
+	CgPointFixNode* mouseFixer = new CgPointFixNode(g_system, g_simulation->vbuff());
+	initUserInteraction();
+
+	// build constraint graph
+	g_cgRootNode = new CgRootNode(g_system, g_simulation->vbuff());
+
+	// first layer, the root takes the place of the deformation pass when the solver limits strain
+	CgSpringNode* deformationNode = initStrainLimit(tauc, deformIter, deformSprings, false);
+	g_cgRootNode->addChild(sphereCollisionNode);
+
+	// second layer
+	deformationNode->addChild(mouseFixer);
+
+	// hand over to simulation thread
+	g_simulation->setTimeStep(SystemParam::h);
+	g_simulation->setMaxSubsteps(g_max_substeps);
+	g_simulation->setConstraintGraph(g_cgRootNode);
+	g_simulation->setUserFixer(mouseFixer);
+}
+
+static void demo_obj() {
+	// initialize mass spring system, on the first copy when several cloths are stacked
+	const unsigned int n_points = (unsigned int)g_clothMesh->n_vertices() / g_cloths;
+	MassSpringBuilder massSpringBuilder;
+	massSpringBuilder.triangleMesh(
+		g_simulation->vbuff(),
+		n_points,
+		g_clothMesh->ibuff(),
+		g_clothMesh->ibuffLen() / g_cloths,
+		SystemParam::h,
+		SystemParam::k,
+		SystemParam::rho,
+		SystemParam::a,
+		SystemParam::ga
+	);
+
+	// the imported mesh is already in simulation order, only sort springs
+	VertexReordering springOrder;
+	springOrder.identity(n_points);
 
 	// initialize mass spring solver
-	g_solver = new MassSpringSolver(g_system, g_clothMesh->vbuff());
+	initSystem(reorderSystem(massSpringBuilder.getResult(), springOrder));
 
 	// sphere collision constraint parameters
 	const float radius = 0.64f; // sphere radius | 0.64f
@@ -301,40 +771,39 @@ static void demo_drop() {
 	const unsigned int deformIter = 15; // number of iterations | 15
 
 	// initialize constraints
-	// sphere collision constraint
-	CgSphereCollisionNode* sphereCollisionNode =
-		new CgSphereCollisionNode(g_system, g_clothMesh->vbuff(), radius, center);
+	// sphere collision constraint, continuous along every point path
+	CgContinuousCollisionNode* sphereCollisionNode =
+		new CgContinuousCollisionNode(g_system, g_simulation->vbuff(), g_simulation->prevVbuff());
+	sphereCollisionNode->addSphere(center, radius);
 
 	// spring deformation constraint
-	CgSpringDeformationNode* deformationNode =
-		new CgSpringDeformationNode(g_system, g_clothMesh->vbuff(), tauc, deformIter);
-	deformationNode->addSprings(massSpringBuilder.getShearIndex());
-	deformationNode->addSprings(massSpringBuilder.getStructIndex());
+	std::vector<unsigned int> deformSprings = springOrder.springsToNew(massSpringBuilder.getStructIndex());
 
 	// initialize user interaction
-	g_pickRenderer = new Renderer();
-	g_pickRenderer->setProgram(g_pickShader);
-	g_pickRenderer->setProgramInput(g_render_target);
-	g_pickRenderer->setElementCount(g_clothMesh->ibuffLen());
-	g_pickShader->setTessFact(SystemParam::n);
-	CgPointFixNode* mouseFixer = new CgPointFixNode(g_system, g_clothMesh->vbuff());
-	UI = new GridMeshUI(g_pickRenderer, mouseFixer, g_clothMesh->vbuff(), n);
+	CgPointFixNode* mouseFixer = new CgPointFixNode(g_system, g_simulation->vbuff());
+	initUserInteraction();
 
 	// build constraint graph
-	g_cgRootNode = new CgRootNode(g_system, g_clothMesh->vbuff());
+	g_cgRootNode = new CgRootNode(g_system, g_simulation->vbuff());
 
-	// first layer
-	g_cgRootNode->addChild(deformationNode);
+	// first layer, the root takes the place of the deformation pass when the solver limits strain
+	CgSpringNode* deformationNode = initStrainLimit(tauc, deformIter, deformSprings, false);
 	g_cgRootNode->addChild(sphereCollisionNode);
 
 	// second layer
 	deformationNode->addChild(mouseFixer);
+
+	// hand over to simulation thread
+	g_simulation->setTimeStep(SystemParam::h);
+	g_simulation->setMaxSubsteps(g_max_substeps);
+	g_simulation->setConstraintGraph(g_cgRootNode);
+	g_simulation->setUserFixer(mouseFixer);
 }
 
 // G L U T  C A L L B A C K S //////////////////////////////////////////////////////
 static void display() {
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	drawCloth();
+	drawCloth(g_ProjectionMatrix);
 	glutSwapBuffers();
 
 	checkGlErrors();
@@ -345,6 +814,7 @@ static void reshape(int w, int h) {
 	g_windowHeight = h;
 	glViewport(0, 0, w, h);
 	updateProjection();
+	updateDetailLevel();
 	glutPostRedisplay();
 }
 
@@ -361,12 +831,13 @@ static void mouse(const int button, const int state, const int x, const int y) {
 	g_mouseMClickButton &= !(button == GLUT_MIDDLE_BUTTON && state == GLUT_UP);
 
 	g_mouseClickDown = g_mouseLClickButton || g_mouseRClickButton || g_mouseMClickButton;
+	if (UI == nullptr) return;
 
-	// TODO: move to UserInteraction class: add renderer member variable
 	// pick point
 	if (g_mouseLClickButton) {
 		UI->setModelview(g_ModelViewMatrix);
 		UI->setProjection(g_ProjectionMatrix);
+		UI->setViewport(g_windowWidth, g_windowHeight);
 		UI->grabPoint(g_mouseClickX, g_mouseClickY);
 	}
 	else UI->releasePoint();
@@ -376,7 +847,7 @@ static void motion(const int x, const int y) {
 	const float dx = float(x - g_mouseClickX);
 	const float dy = float (-(g_windowHeight - y - 1 - g_mouseClickY));
 
-	if (g_mouseLClickButton) {
+	if (g_mouseLClickButton && UI != nullptr) {
 		//glm::vec3 ux(g_ModelViewMatrix * glm::vec4(1, 0, 0, 0));
 		//glm::vec3 uy(g_ModelViewMatrix * glm::vec4(0, 1, 0, 0));
 		glm::vec3 ux(0, 1, 0);
@@ -388,12 +859,49 @@ static void motion(const int x, const int y) {
 	g_mouseClickY = g_windowHeight - y - 1;
 }
 
+static void keyboard(const unsigned char key, const int x, const int y) {
+	// print simulation statistics
+	if (key == 's') {
+		const SimulationStats& stats = g_simulation->frame().stats;
+		std::cout << "frames: " << stats.frames
+			<< " | sim time: " << stats.sim_time << "s"
+			<< " | substeps: " << stats.substeps << " (" << stats.frame_substeps << " last frame)"
+			<< " | dropped: " << stats.dropped
+			<< " | frame: " << stats.frame_ms << "ms (mean " << stats.mean_frame_ms
+			<< "ms, max " << stats.max_frame_ms << "ms)"
+			<< " | substep: " << stats.substep_ms << "ms"
+			<< " | iterations: " << stats.solver_iterations << " (residual " << stats.residual << ")"
+			<< " | asleep: " << stats.asleep << " (" << stats.slept << " frames skipped)"
+			<< std::endl;
+	}
+
+	// print per-phase timings
+	if (key == 'p') {
+		if (!Profiler::enabled) std::cout << "profiling disabled" << std::endl;
+		for (const ProfileStats& s : Profiler::stats()) {
+			std::cout << s.name << ": " << s.count << " calls"
+				<< " | min " << s.min << "ms | p50 " << s.p50 << "ms"
+				<< " | p99 " << s.p99 << "ms | max " << s.max << "ms" << std::endl;
+		}
+	}
+
+	// stiffer or softer cloth, the solver refactors without rebuilding
+	if (key == '+' || key == '-')
+		g_simulation->pushCommand({ SimulationCommand::SCALE_STIFFNESS, 0, { key == '+' ? 1.25f : 0.8f } });
+
+	// save or restore checkpoint
+	if (!g_checkpointPath.empty() && key == 'c')
+		g_simulation->pushCommand({ SimulationCommand::SAVE_CHECKPOINT });
+	if (!g_checkpointPath.empty() && key == 'r')
+		g_simulation->pushCommand({ SimulationCommand::LOAD_CHECKPOINT });
+}
+
 // C L O T H ///////////////////////////////////////////////////////////////////////
-static void drawCloth() {
+static void drawCloth(const glm::mat4& projection) {
 	Renderer renderer;
 	renderer.setProgram(g_phongShader);
 	renderer.setModelview(g_ModelViewMatrix);
-	renderer.setProjection(g_ProjectionMatrix);
+	renderer.setProjection(projection);
 	g_phongShader->setAlbedo(g_albedo);
 	g_phongShader->setAmbient(g_ambient);
 	g_phongShader->setLight(g_light);
@@ -403,28 +911,85 @@ static void drawCloth() {
 }
 
 static void animateCloth(int value) {
+	// drain the probe rings before they fill up, off the simulation thread's hot path
+	if (Profiler::enabled) Profiler::collect();
 
-	// solve two time-steps
-	g_solver->solve(g_iter);
-	g_solver->solve(g_iter);
+	if (nextFrame()) {
+		exportFrame();
 
-	// fix points
-	CgSatisfyVisitor visitor;
-	visitor.satisfy(*g_cgRootNode);
+		// redisplay
+		glutPostRedisplay();
+	}
 
-	// update normals
-	g_clothMesh->request_face_normals();
-	g_clothMesh->update_normals();
-	g_clothMesh->release_face_normals();
+	// GLUT does not return from the main loop, stop the simulation and release everything first
+	if (g_capture != nullptr && exportFinished()) {
+		cleanUp();
+		std::exit(0);
+	}
+
+	// reset timer, replay keeps the recorded frame time
+	int timer = g_player != nullptr ? (int)(g_player->frameTime() * 1000) : g_animation_timer;
+	glutTimerFunc(timer, animateCloth, 0);
+}
+
+static bool nextFrame() {
+
+	// replay recorded frames instead of simulating
+	if (g_player != nullptr) {
+		g_player->readFrame(g_playFrame, g_clothMesh->vbuff());
+		g_playFrame = (g_playFrame + 1) % g_player->nFrames();
+
+		// update normals
+		{
+			PROFILE_SCOPE("updateNormals");
+			g_clothMesh->request_face_normals();
+			g_clothMesh->update_normals();
+			g_clothMesh->release_face_normals();
+		}
+
+		updateRenderTarget();
+		return true;
+	}
+
+	// pick up the latest frame published by the simulation thread
+	if (!g_simulation->acquireFrame()) return false;
+	const SimulationFrame& frame = g_simulation->frame();
+	if (frame.lod != g_lod) showDetailLevel(frame.lod);
+	std::copy(frame.vbuff.begin(), frame.vbuff.end(), g_clothMesh->vbuff());
+	std::copy(frame.nbuff.begin(), frame.nbuff.end(), g_clothMesh->nbuff());
+	if (UI != nullptr) UI->updateMesh();
 
 	// update target
 	updateRenderTarget();
+	return true;
+}
 
-	// redisplay
-	glutPostRedisplay();
+static void exportFrame() {
+	if (g_capture == nullptr) return;
+	PROFILE_SCOPE("exportFrame");
+
+	// the readback is queued, the frame reaches the encoder a few frames later
+	g_capture->bind();
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	drawCloth(g_exportProjection);
+	g_capture->capture();
+	g_capture->unbind();
 
-	// reset timer
-	glutTimerFunc(g_animation_timer, animateCloth, 0);
+	checkGlErrors();
+}
+
+static bool exportFinished() {
+	if (g_exportFrames == 0) return false;
+	if (g_encoder->droppedFrames() >= g_exportFrames) return true; // writes keep failing, give up
+
+	// frames written or on their way to the encoder, dropped frames do not count
+	if (g_capture->capturedFrames() - g_encoder->droppedFrames() < g_exportFrames) return false;
+
+	// wait for the frames in flight, more are captured if a write failed
+	g_capture->finish();
+	while (g_encoder->encodedFrames() + g_encoder->droppedFrames() < g_capture->capturedFrames())
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	return g_encoder->encodedFrames() >= g_exportFrames;
 }
 
 // S C E N E  U P D A T E ///////////////////////////////////////////////////////////
@@ -433,7 +998,39 @@ static void updateProjection() {
 		g_windowWidth * 1.0f / g_windowHeight, 0.01f, 1000.0f);
 }
 
+static void updateDetailLevel() {
+	if (g_lodMeshes.size() < 2) return;
+
+	// on-screen length of a simulated grid edge at the distance of the cloth
+	float distance = glm::length(glm::vec3(g_ModelViewMatrix[3]));
+	float edge = SystemParam::w / (SystemParam::n - 1);
+	float pixels = edge / (2.0f * distance * std::tan(PI / 8.0f)) * g_windowHeight;
+
+	unsigned int level = 0;
+	while (level + 1 < g_lodMeshes.size() && pixels > g_lodEdgePixels) {
+		pixels /= 2.0f;
+		level++;
+	}
+	if (level == g_lodRequest) return;
+	g_lodRequest = level;
+	g_simulation->pushCommand({ SimulationCommand::SET_LOD, (int)level });
+}
+
+static void showDetailLevel(unsigned int level) {
+	g_lod = level;
+	g_clothMesh = g_lodMeshes[level];
+	g_render_target = g_lodTargets[level];
+
+	// pick on the displayed triangles, fine vertices grab the coarse point that drives them most
+	if (UI == nullptr) return;
+	UI->setMesh(g_clothMesh->vbuff(), g_clothMesh->ibuff(), g_clothMesh->ibuffLen());
+	if (level == 0) UI->setIndexMap(std::vector<unsigned int>());
+	else UI->setIndexMap(g_lodEmbeddings[level - 1]->dominantVertices());
+}
+
 static void updateRenderTarget() {
+	PROFILE_SCOPE("updateRenderTarget");
+
 	// update vertex positions
 	g_render_target->setPositionData(g_clothMesh->vbuff(), g_clothMesh->vbuffLen());
 
@@ -444,22 +1041,75 @@ static void updateRenderTarget() {
 
 // C L E A N  U P //////////////////////////////////////////////////////////////////
 static void cleanUp() {
-	// delete mesh
-	delete g_clothMesh;
+	// stop simulation and export before releasing what they use
+	finishExport();
+	finishRecording();
+
+	// delete meshes, every detail level
+	for (Mesh* mesh : g_lodMeshes) delete mesh;
 
 	// delete UI
-	delete g_pickRenderer;
 	delete UI;
 
-	// delete render target
-	delete g_render_target;
+	// delete render targets
+	for (ProgramInput* target : g_lodTargets) delete target;
+
+	delete g_simulation;
+	g_simulation = nullptr;
+	delete g_server;
+	delete g_player;
+	for (MeshEmbedding* embedding : g_lodEmbeddings) delete embedding;
+	delete g_aerodynamics;
 
 	// delete mass-spring system
-	delete g_system;
-	delete g_solver;
+	if (g_scene != nullptr) delete g_scene; // owns the scene system
+	else {
+		delete g_system;
+		delete g_solver;
+	}
 
 	// delete constraint graph
 	// TODO
+
+	// last, GL objects above belong to it
+	delete g_context;
+}
+
+static void finishRecording() {
+	if (g_simulation != nullptr) g_simulation->stop();
+	delete g_recorder; // finalizes the file
+	g_recorder = nullptr;
+}
+
+static void finishExport() {
+	if (g_capture == nullptr) return;
+	if (g_simulation != nullptr) g_simulation->stop();
+	g_capture->finish();
+	g_encoder->close();
+
+	// end to end, from setting up the export to the last frame written
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - g_exportStart).count();
+	std::cout << "Exported " << g_encoder->encodedFrames() << " frames (" << g_encoder->droppedFrames()
+		<< " dropped) in " << seconds << "s | " << g_encoder->encodedFrames() / seconds << " frames/s"
+		<< " | readback: " << g_capture->readbackMs() << "ms | encode: " << g_encoder->encodeMs() << "ms"
+		<< std::endl;
+
+	delete g_capture;
+	delete g_encoder;
+	g_capture = nullptr;
+	g_encoder = nullptr;
+}
+
+static void writeTrace() {
+	if (g_simulation != nullptr) g_simulation->stop();
+	try {
+		Profiler::writeChromeTrace(g_tracePath);
+		if (Profiler::droppedEvents() > 0)
+			std::cerr << "Trace is missing " << Profiler::droppedEvents() << " dropped events." << std::endl;
+	}
+	catch (const std::runtime_error& e) {
+		std::cerr << e.what() << std::endl;
+	}
 }
 
 // E R R O R S /////////////////////////////////////////////////////////////////////